@@ -4,229 +4,3343 @@
  * With virtual memory.
  * With virtual devices.
  * With virtal everything.
+ *
+ * This is the command line program: demos, benchmarks and tools on top of
+ * the core in pal6502.h.
  */
 
-#include <stdio.h>
-#include <stdlib.h>
+// PAL6502_LIB: link libpal6502.a for the non-inline half (`make lib-check`)
+#if !defined(PAL6502_LIB)
+	#define PAL6502_IMPLEMENTATION
+#endif
+#include "pal6502.h"
 
 
-using Byte = unsigned char;
-using Word = unsigned short;
+// NOTE: Image loading
+// Which chip to run an image as, by the variant's NAME. Null if there is no
+// such variant.
+static const char* const CHIPS[] = { Nmos6502::NAME, Cmos65C02::NAME, Ricoh2A03::NAME };
 
-using uint32 = unsigned int;
-
-
-struct MEM
+static const char* FindChip(const char* name)
 {
-	static constexpr uint32 MAX_MEM = 1024 * 64;
-	
-	Byte Data[MAX_MEM];
-	
-	void Init()
+	for (const char* chip : CHIPS)
 	{
-		for (uint32 i = 0; i < MAX_MEM; i++)
+		if (strcmp(chip, name) == 0)
 		{
-			Data[i] = 0;
+			return chip;
 		}
 	}
 	
+	return nullptr;
+}
+
+
+static sint32 ExecChip(const char* chip, CPU& cpu, sint32 cycles, MEM& memory)
+{
+	if (chip == Cmos65C02::NAME)
+	{
+		return cpu.ExecVariant<Cmos65C02>(cycles, memory);
+	}
 	
-	Byte operator[](uint32 address) const
+	if (chip == Ricoh2A03::NAME)
 	{
-		return Data[address];
+		return cpu.ExecVariant<Ricoh2A03>(cycles, memory);
 	}
 	
+	return cpu.Exec(cycles, memory);
+}
+
+
+static uint32 DisassembleChip(const char* chip, const MEM& memory, Word pc, char* text, uint32 size)
+{
+	if (chip == Cmos65C02::NAME)
+	{
+		return Disassemble<Cmos65C02>(memory, pc, text, size);
+	}
 	
-	Byte& operator[](uint32 address)
+	if (chip == Ricoh2A03::NAME)
 	{
-		return Data[address];
+		return Disassemble<Ricoh2A03>(memory, pc, text, size);
 	}
 	
+	return Disassemble(memory, pc, text, size);
+}
+
+
+// Runs a program image: loads it (see Image), starts at the entry point the
+// file gives if there is one, otherwise at the reset PC.
+static int RunImage(const char* path, sint32 cycles, uint32 load, const char* chip)
+{
+	MEM* mem = new MEM;
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	ImageInfo info;
 	
-	void WriteWord(uint32& cycles, uint32 address, Word val)
+	if (!Image::Load(*mem, path, load, info))
 	{
-		Data[address]	= val & 0xFF;
-		Data[address+1]	= (val >> 8);
-		
-		cycles -= 2;
+		fprintf(stderr, "%s: %s\n", path, info.Error);
+		delete mem;
+		return 1;
 	}
-};
+	
+	if (info.Start >= 0)
+	{
+		cpu.PC = info.Start;
+	}
+	
+	printf("image first=%04X last=%04X bytes=%u start=%04X\n", info.First, info.Last, info.Bytes, cpu.PC);
+	
+	sint32 used = ExecChip(chip, cpu, cycles, *mem);
+	
+	printf("run cycles=%d instructions=%llu unknown=%llu pc=%04X a=%02X x=%02X y=%02X p=%02X sp=%02X\n",
+		used, cpu.Instructions, cpu.Unknown, cpu.PC, cpu.A, cpu.X, cpu.Y, cpu.GetStatus(), cpu.SP);
+	
+	delete mem;
+	
+	return 0;
+}
 
 
-struct CPU
+// Lists count instructions of an image from address, or from where the
+// image says it starts (its first byte if it does not say).
+static int RunDisassemble(const char* path, sint32 address, uint32 count, uint32 load, const char* chip)
 {
-	Word PC;		// Program Counter
-	Word SP;		// Stack Pointer
+	MEM* mem = new MEM;
+	ImageInfo info;
 	
-	Byte A, X, Y;	// GPRs
+	mem->Clear();
 	
-	// Bit field (status flags) (yes this is new) (yes i just learned this)
+	if (!Image::Load(*mem, path, load, info))
+	{
+		fprintf(stderr, "%s: %s\n", path, info.Error);
+		delete mem;
+		return 1;
+	}
 	
-	Byte C : 1;		// Carry flag
-	Byte Z : 1;		// Zero flag
-	Byte I : 1;		// Interrupt disable
-	Byte D : 1;		// Decimal mode
-	Byte B : 1;		// Break command
-	Byte V : 1;		// Overflow flag
-	Byte N : 1;		// Negative flag
+	Word pc = address >= 0 ? address : info.Start >= 0 ? info.Start : info.First;
 	
-	void Reset(MEM& memory)
+	for (uint32 i = 0; i < count; i++)
 	{
-		PC = 0xFFFC;
-		SP = 0x0100;
+		char text[32];
+		uint32 bytes = DisassembleChip(chip, *mem, pc, text, sizeof(text));
+		
+		printf("%04X ", pc);
 		
-		C = Z = I = D = B = V = N = 0;
+		for (uint32 b = 0; b < 3; b++)
+		{
+			if (b < bytes)
+			{
+				printf(" %02X", mem->Peek((Word)(pc + b)));
+			}
+			else
+			{
+				printf("   ");
+			}
+		}
 		
-		A = X = Y = 0;
+		printf("  %s\n", text);
 		
-		memory.Init();
+		pc += bytes;
 	}
 	
+	delete mem;
 	
-	Byte FetchByte(uint32& cycles, MEM& memory)
+	return 0;
+}
+
+
+// How long swapping an image in takes, loaded (copied) and mapped as ROM
+// (not copied) at $0000. Per job in a fleet it would be one or the other.
+static int BenchImage(const char* path, uint32 count)
+{
+	MEM* mem = new MEM;
+	ImageInfo info;
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	for (uint32 i = 0; i < count; i++)
 	{
-		Byte data = memory[PC];
-		
-		PC++;
-		cycles--;
-		
-		return data;
+		if (!Image::Load(*mem, path, 0, info))
+		{
+			fprintf(stderr, "%s: %s\n", path, info.Error);
+			delete mem;
+			return 1;
+		}
 	}
 	
+	auto stop = std::chrono::steady_clock::now();
+	
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	
+	printf("image load bytes=%u count=%u us_per_load=%.2f\n", info.Bytes, count, seconds * 1e6 / count);
 	
-	Word FetchWord(uint32& cycles, MEM& memory)
+	start = std::chrono::steady_clock::now();
+	
+	uint32 pages = 0;
+	
+	for (uint32 i = 0; i < count; i++)
 	{
-		// !!6502 was LITTLE ENDIAN!!
+		MappedFile file;
 		
-		Word Data = memory[PC];
-		PC++;
+		if (!file.Open(path))
+		{
+			fprintf(stderr, "can not map %s\n", path);
+			delete mem;
+			return 1;
+		}
 		
-		Data |= (memory[PC] << 8);
-		PC++;
+		pages = (file.Size + 255) / 256;
 		
-		cycles -= 2;
+		mem->MapRom(0, pages, file.Data);
+		mem->MapRam(0, pages);
 		
-		return Data;
+		file.Close();
 	}
 	
+	stop = std::chrono::steady_clock::now();
+	
+	seconds = std::chrono::duration<double>(stop - start).count();
+	
+	printf("image map pages=%u count=%u us_per_map=%.2f\n", pages, count, seconds * 1e6 / count);
+	
+	delete mem;
+	
+	return 0;
+}
+
+
+// NOTE: Benchmark
+// Fills the whole address space with a random mix of the loads so every byte
+// the CPU lands on (the PC wraps at $FFFF) is a valid opcode, then runs it
+// through Exec (engine "exec"), ExecCached ("blocks") or ExecCached with
+// the JIT on ("jit"). "paged" is Exec with $FF00-$FFFF mapped as ROM over
+// its own RAM, so the program is the same but every access goes through
+// the page table test instead of RamBus.
+static void LoadBenchProgram(MEM& mem)
+{
+	static const Byte ops[] = { CPU::INS_LDA_IMM, CPU::INS_LDA_ZP, CPU::INS_LDA_ZPX };
+	
+	uint32 seed = 0x6502;
 	
-	Byte ReadByte(uint32& cycles, Byte address, MEM& memory)
+	for (uint32 i = 0; i < MEM::MAX_MEM; i++)
 	{
-		Byte data = memory[address];
+		seed = seed * 1664525 + 1013904223;
 		
-		cycles--;
+		mem[i] = ops[(seed >> 16) % 3];
+	}
+}
+
+
+static int Bench(sint32 cycles, const char* engine)
+{
+	bool blocks = strcmp(engine, "blocks") == 0;
+	bool jitted = strcmp(engine, "jit") == 0;
+	bool paged = strcmp(engine, "paged") == 0;
+	
+	MEM mem;
+	CPU cpu;
+	
+	cpu.Reset(mem);
+	
+	LoadBenchProgram(mem);
+	
+	if (paged)
+	{
+		mem.MapRom(0xFF, 1, mem.Data + 0xFF00);
+	}
+	
+	BlockCache* cache = nullptr;
+	Jit* jit = nullptr;
+	
+	if (blocks || jitted)
+	{
+		cache = new BlockCache;
+		cache->Init();
+	}
+	
+	if (jitted)
+	{
+		jit = new Jit;
 		
-		return data; 
+		if (!jit->Init())
+		{
+			printf("JIT not available in this build\n");
+			
+			jit->Free();
+			delete jit;
+			delete cache;
+			
+			return 1;
+		}
 	}
 	
-	// NOTE: ISA
-	static constexpr Byte
-		INS_LDA_IMM		= 0xA9,			// LOAD IMMEDIATE
-		INS_LDA_ZP		= 0xA5,			// LOAD FROM MEMORY
-		INS_LDA_ZPX		= 0xB5,			// LOAD FROM MEMORY OFFSET BY REG_X
-										
-		INS_JSR			= 0x20			// JUMP TO SUBROUTINE
-		;
-
+	auto start = std::chrono::steady_clock::now();
+	
+	sint32 used = cache ? cpu.ExecCached(cycles, mem, *cache, jit) : cpu.Exec(cycles, mem);
+	
+	auto stop = std::chrono::steady_clock::now();
+	
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	
+	printf("dispatch=%s cycles=%d seconds=%.3f mhz=%.1f pc=%04X a=%02X\n",
+		cache || paged ? engine : DISPATCH_NAME, used, seconds, used / seconds / 1e6, cpu.PC, cpu.A);
+	
+	if (cache)
+	{
+		cache->PrintStats();
+		delete cache;
+	}
 	
-	void LDA_set_status()
+	if (jit)
 	{
-		Z = (A == 0);
-		N = (A & 0b10000000) > 0;
+		jit->PrintStats();
+		jit->Free();
+		delete jit;
 	}
 	
+	return 0;
+}
+
+
+// NOTE: Profile run
+// The bench program with the counters on, then the report.
+static int RunProfile(sint32 cycles, uint32 top)
+{
+#if PROFILE
+	MEM* mem = new MEM;
+	Profile* profile = new Profile;
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	LoadBenchProgram(*mem);
+	
+	profile->Clear();
+	cpu.Counters = profile;
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	sint32 used = cpu.Exec(cycles, *mem);
+	
+	auto stop = std::chrono::steady_clock::now();
+	
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	
+	printf("profile dispatch=%s cycles=%d seconds=%.3f mhz=%.1f\n",
+		DISPATCH_NAME, used, seconds, used / seconds / 1e6);
+	
+	profile->Report(stdout, top);
+	
+	delete profile;
+	delete mem;
+	
+	return 0;
+#else
+	(void)cycles;
+	(void)top;
+	
+	fprintf(stderr, "profiling is not built in, build with PROFILE=1\n");
+	
+	return 1;
+#endif
+}
+
+
+// NOTE: Trace run
+// The bench program with a trace on and a second thread draining it as it
+// goes (it only counts and checksums, a real consumer would write the
+// records out), then the last records dumped to path.
+struct TraceConsumer
+{
+	Trace* Source;
+	std::atomic<bool> Stop;
+	uint64 Drained, Checksum;
 	
-	void Exec(uint32 cycles, MEM& memory)
+	void Run()
 	{
-		while (cycles > 0)
+		static Trace::Record batch[4096];
+		
+		for (;;)
 		{
-			Byte instruction = FetchByte(cycles, memory);
+			bool last = Stop.load(std::memory_order_acquire);
+			
+			uint32 count = Source->Drain(batch, 4096);
 			
-			switch (instruction)
+			for (uint32 i = 0; i < count; i++)
 			{
-				// Executing (FETCH - DECODE - EXECUTE)
-				case INS_LDA_IMM:
-				{
-					Byte val = FetchByte(cycles, memory);
-					
-					A = val;
-					
-					LDA_set_status();
-					
-				} break;
-				
-				
-				case INS_LDA_ZP:
-				{
-					Byte zeropageaddr = FetchByte(cycles, memory);
-					
-					A = ReadByte(cycles, zeropageaddr, memory);
-					
-					LDA_set_status();
-					
-				} break;
-				
-				
-				case INS_LDA_ZPX:
-				{
-					Byte zeropageaddr = FetchByte(cycles, memory);
-					
-					zeropageaddr += X;
-					
-					cycles--;
-					
-					A = ReadByte(cycles, zeropageaddr, memory);
-					
-					LDA_set_status();
-					
-				} break;
-				
-				
-				case INS_JSR:
+				Checksum = Checksum * 31 + batch[i].PC + batch[i].Opcode;
+			}
+			
+			Drained += count;
+			
+			if (count == 0)
+			{
+				if (last)
 				{
-					Word subaddr = FetchWord(cycles, memory);
-					
-					memory.WriteWord(cycles, SP, PC-1); // PUSH the return address to the stack (Because JSR)
-					
-					SP++;
-					
-					PC = subaddr;
-					
-					cycles--;
-					
-				} break;
-				
+					break;
+				}
 				
-				
-				
-				
-				default:
-				{
-					printf("INSTRUCTION UNCLEAR!\n");
-				} break;
+				std::this_thread::yield();
 			}
 		}
 	}
 };
 
 
-int main()
+static int RunTrace(sint32 cycles, const char* path, uint32 capacity)
 {
-	MEM mem;
+	MEM* mem = new MEM;
+	Trace* trace = new Trace;
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	LoadBenchProgram(*mem);
+	
+	trace->Init(capacity);
+	trace->TrapPath = path;
+	
+	cpu.Tracer = trace;
+	
+	TraceConsumer consumer;
+	
+	consumer.Source = trace;
+	consumer.Stop.store(false);
+	consumer.Drained = consumer.Checksum = 0;
+	
+	std::thread thread(&TraceConsumer::Run, &consumer);
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	sint32 used = cpu.Exec(cycles, *mem);
+	
+	auto stop = std::chrono::steady_clock::now();
+	
+	consumer.Stop.store(true, std::memory_order_release);
+	thread.join();
+	
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	
+	printf("trace cycles=%d seconds=%.3f mhz=%.1f records=%llu drained=%llu dropped=%llu\n",
+		used, seconds, used / seconds / 1e6, trace->Head.load(), consumer.Drained, trace->Dropped);
+	
+	bool ok = trace->Dump(path);
+	
+	if (!ok)
+	{
+		fprintf(stderr, "can not write %s\n", path);
+	}
+	
+	trace->Free();
+	
+	delete trace;
+	delete mem;
+	
+	return ok ? 0 : 1;
+}
+
+
+// Prints the last `count` records of a trace dump
+static int ShowTrace(const char* path, uint32 count)
+{
+	FILE* file = fopen(path, "rb");
+	
+	Trace::FileHeader header;
+	
+	if (!file || fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.Magic, "P6TR", 4) != 0
+		|| header.RecordSize != sizeof(Trace::Record))
+	{
+		fprintf(stderr, "%s is not a trace dump\n", path);
+		
+		if (file)
+		{
+			fclose(file);
+		}
+		
+		return 1;
+	}
+	
+	uint32 skip = header.Count > count ? header.Count - count : 0;
+	
+	fseek(file, (long)skip * sizeof(Trace::Record), SEEK_CUR);
+	
+	Trace::Record record;
+	uint64 index = header.Total - header.Count + skip;
+	
+	while (fread(&record, sizeof(record), 1, file) == 1)
+	{
+		const char* name = OP_INFO.Ops[record.Opcode].Name;
+		
+		printf("%10llu  cycle=%-10u pc=%04X op=%02X %-8s a=%02X x=%02X y=%02X p=%02X sp=%02X\n",
+			index++, record.Cycle, record.PC, record.Opcode, name ? name : "???",
+			record.A, record.X, record.Y, record.P, record.SP);
+	}
+	
+	fclose(file);
+	
+	return 0;
+}
+
+
+// NOTE: Instruction check
+// One instruction per case from a known state, compared against what the
+// chip does: the registers, P, PC, the cycles taken and one byte of memory,
+// and that the opcode is one the chip knows (nothing counted in Unknown).
+// Code goes at $0200. P is written as PHP would see it, less B (bit 5 on).
+struct IsaCase
+{
+	const char* Name;
+	const char* Chip;		// Exec (the 6502) when null
+	Byte Code[3];
+	Byte A, X, Y, P, SP;	// before
+	struct { Word Address; Byte Value; } Memory[3];	// before, Address 0 for none
+	Byte WantA, WantX, WantY, WantP, WantSP;
+	Word WantPC;
+	sint32 WantCycles;
+	Word CheckAddress;		// 0 for none
+	Byte WantValue;
+};
+
+static const IsaCase ISA_CASES[] =
+{
+	// Flags
+	{ "lda zero",		nullptr, { 0xA9, 0x00 },		0x55, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x22, 0xFF, 0x0202, 2, 0, 0 },
+	{ "lda negative",	nullptr, { 0xA9, 0x80 },		0x00, 0, 0, 0x22, 0xFF, {},	0x80, 0, 0, 0xA0, 0xFF, 0x0202, 2, 0, 0 },
+	{ "adc overflow",	nullptr, { 0x69, 0x50 },		0x50, 0, 0, 0x20, 0xFF, {},	0xA0, 0, 0, 0xE0, 0xFF, 0x0202, 2, 0, 0 },
+	{ "adc carry",		nullptr, { 0x69, 0x01 },		0xFF, 0, 0, 0x21, 0xFF, {},	0x01, 0, 0, 0x21, 0xFF, 0x0202, 2, 0, 0 },
+	{ "sbc borrow",		nullptr, { 0xE9, 0x01 },		0x00, 0, 0, 0x21, 0xFF, {},	0xFF, 0, 0, 0xA0, 0xFF, 0x0202, 2, 0, 0 },
+	{ "sbc overflow",	nullptr, { 0xE9, 0x01 },		0x80, 0, 0, 0x21, 0xFF, {},	0x7F, 0, 0, 0x61, 0xFF, 0x0202, 2, 0, 0 },
+	{ "cmp equal",		nullptr, { 0xC9, 0x40 },		0x40, 0, 0, 0x20, 0xFF, {},	0x40, 0, 0, 0x23, 0xFF, 0x0202, 2, 0, 0 },
+	{ "cmp less",		nullptr, { 0xC9, 0x41 },		0x40, 0, 0, 0x21, 0xFF, {},	0x40, 0, 0, 0xA0, 0xFF, 0x0202, 2, 0, 0 },
+	{ "bit",			nullptr, { 0x24, 0x10 },		0x01, 0, 0, 0x20, 0xFF, { { 0x0010, 0xC0 } },	0x01, 0, 0, 0xE2, 0xFF, 0x0202, 3, 0, 0 },
+	{ "rol a",			nullptr, { 0x2A },				0x80, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x23, 0xFF, 0x0201, 2, 0, 0 },
+	{ "ror a",			nullptr, { 0x6A },				0x01, 0, 0, 0x21, 0xFF, {},	0x80, 0, 0, 0xA1, 0xFF, 0x0201, 2, 0, 0 },
+	{ "inx wraps",		nullptr, { 0xE8 },				0x00, 0xFF, 0, 0x20, 0xFF, {},	0x00, 0x00, 0, 0x22, 0xFF, 0x0201, 2, 0, 0 },
+	{ "dey negative",	nullptr, { 0x88 },				0x00, 0, 0x00, 0x20, 0xFF, {},	0x00, 0, 0xFF, 0xA0, 0xFF, 0x0201, 2, 0, 0 },
+	{ "asl zp",			nullptr, { 0x06, 0x10 },		0x00, 0, 0, 0x20, 0xFF, { { 0x0010, 0x81 } },	0x00, 0, 0, 0x21, 0xFF, 0x0202, 5, 0x0010, 0x02 },
+	
+	// Decimal mode: the NMOS chip sets N and Z from the binary sum, the
+	// 65C02 from the result, for a cycle more
+	{ "adc decimal",	nullptr, { 0x69, 0x01 },		0x09, 0, 0, 0x28, 0xFF, {},	0x10, 0, 0, 0x28, 0xFF, 0x0202, 2, 0, 0 },
+	{ "adc decimal 99",	nullptr, { 0x69, 0x01 },		0x99, 0, 0, 0x28, 0xFF, {},	0x00, 0, 0, 0xA9, 0xFF, 0x0202, 2, 0, 0 },
+	{ "adc decimal 99",	Cmos65C02::NAME, { 0x69, 0x01 },	0x99, 0, 0, 0x28, 0xFF, {},	0x00, 0, 0, 0x2B, 0xFF, 0x0202, 3, 0, 0 },
+	{ "sbc decimal",	nullptr, { 0xE9, 0x01 },		0x10, 0, 0, 0x29, 0xFF, {},	0x09, 0, 0, 0x29, 0xFF, 0x0202, 2, 0, 0 },
+	{ "sbc decimal",	Cmos65C02::NAME, { 0xE9, 0x01 },	0x10, 0, 0, 0x29, 0xFF, {},	0x09, 0, 0, 0x29, 0xFF, 0x0202, 3, 0, 0 },
+	{ "sbc decimal v",	nullptr, { 0xE9, 0x90 },		0x10, 0, 0, 0x29, 0xFF, {},	0x20, 0, 0, 0xE8, 0xFF, 0x0202, 2, 0, 0 },
+	{ "sbc decimal v",	Cmos65C02::NAME, { 0xE9, 0x90 },	0x10, 0, 0, 0x29, 0xFF, {},	0x20, 0, 0, 0x68, 0xFF, 0x0202, 3, 0, 0 },
+	{ "adc no decimal",	Ricoh2A03::NAME, { 0x69, 0x01 },	0x09, 0, 0, 0x28, 0xFF, {},	0x0A, 0, 0, 0x28, 0xFF, 0x0202, 2, 0, 0 },
+	
+	// Stack
+	{ "pha",			nullptr, { 0x48 },				0x42, 0, 0, 0x20, 0xFF, {},	0x42, 0, 0, 0x20, 0xFE, 0x0201, 3, 0x01FF, 0x42 },
+	{ "pla",			nullptr, { 0x68 },				0x00, 0, 0, 0x22, 0xFE, { { 0x01FF, 0x80 } },	0x80, 0, 0, 0xA0, 0xFF, 0x0201, 4, 0, 0 },
+	{ "php",			nullptr, { 0x08 },				0x00, 0, 0, 0xE3, 0xFF, {},	0x00, 0, 0, 0xE3, 0xFE, 0x0201, 3, 0x01FF, 0xF3 },
+	{ "plp",			nullptr, { 0x28 },				0x00, 0, 0, 0x20, 0xFE, { { 0x01FF, 0xC3 } },	0x00, 0, 0, 0xE3, 0xFF, 0x0201, 4, 0, 0 },
+	{ "plp drops b",	nullptr, { 0x28 },				0x00, 0, 0, 0x20, 0xFE, { { 0x01FF, 0xFF } },	0x00, 0, 0, 0xEF, 0xFF, 0x0201, 4, 0, 0 },
+	{ "jsr",			nullptr, { 0x20, 0x34, 0x12 },	0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFD, 0x1234, 6, 0x01FE, 0x02 },
+	{ "rts",			nullptr, { 0x60 },				0x00, 0, 0, 0x20, 0xFD, { { 0x01FE, 0x33 }, { 0x01FF, 0x12 } },	0x00, 0, 0, 0x20, 0xFF, 0x1234, 6, 0, 0 },
+	{ "phx",			Cmos65C02::NAME, { 0xDA },		0x00, 0x77, 0, 0x20, 0xFF, {},	0x00, 0x77, 0, 0x20, 0xFE, 0x0201, 3, 0x01FF, 0x77 },
+	
+	// BRK pushes PC + 2 and P with B, then takes $FFFE with I set; the
+	// 65C02 clears D as well
+	{ "brk",			nullptr, { 0x00 },				0x00, 0, 0, 0x28, 0xFF, { { 0xFFFF, 0x30 } },	0x00, 0, 0, 0x2C, 0xFC, 0x3000, 7, 0x01FD, 0x38 },
+	{ "brk",			Cmos65C02::NAME, { 0x00 },		0x00, 0, 0, 0x28, 0xFF, { { 0xFFFF, 0x30 } },	0x00, 0, 0, 0x24, 0xFC, 0x3000, 7, 0x01FE, 0x02 },
+	{ "rti",			nullptr, { 0x40 },				0x00, 0, 0, 0x24, 0xFC, { { 0x01FD, 0xC3 }, { 0x01FE, 0x34 }, { 0x01FF, 0x12 } },	0x00, 0, 0, 0xE3, 0xFF, 0x1234, 6, 0, 0 },
+	
+	// Page crossings: a cycle for an indexed read that crosses (a store
+	// always pays it), a taken branch one, or two when it crosses
+	{ "lda abs,x",		nullptr, { 0xBD, 0x00, 0x12 },	0x00, 0x20, 0, 0x20, 0xFF, { { 0x1220, 0x33 } },	0x33, 0x20, 0, 0x20, 0xFF, 0x0203, 4, 0, 0 },
+	{ "lda abs,x cross",	nullptr, { 0xBD, 0xF0, 0x12 },	0x00, 0x20, 0, 0x20, 0xFF, { { 0x1310, 0x33 } },	0x33, 0x20, 0, 0x20, 0xFF, 0x0203, 5, 0, 0 },
+	{ "lda (zp),y cross",	nullptr, { 0xB1, 0x10 },	0x00, 0, 0x20, 0x20, 0xFF, { { 0x0010, 0xF0 }, { 0x0011, 0x12 }, { 0x1310, 0x80 } },	0x80, 0, 0x20, 0xA0, 0xFF, 0x0202, 6, 0, 0 },
+	{ "sta abs,x",		nullptr, { 0x9D, 0x00, 0x12 },	0x44, 0x20, 0, 0x20, 0xFF, {},	0x44, 0x20, 0, 0x20, 0xFF, 0x0203, 5, 0x1220, 0x44 },
+	{ "bne not taken",	nullptr, { 0xD0, 0x02 },		0x00, 0, 0, 0x22, 0xFF, {},	0x00, 0, 0, 0x22, 0xFF, 0x0202, 2, 0, 0 },
+	{ "bne taken",		nullptr, { 0xD0, 0x02 },		0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFF, 0x0204, 3, 0, 0 },
+	{ "beq cross",		nullptr, { 0xF0, 0x80 },		0x00, 0, 0, 0x22, 0xFF, {},	0x00, 0, 0, 0x22, 0xFF, 0x0182, 4, 0, 0 },
+	{ "bra",			Cmos65C02::NAME, { 0x80, 0x02 },	0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFF, 0x0204, 3, 0, 0 },
+	
+	// JMP ($xxFF) takes its high byte from $xx00 on the NMOS chip
+	{ "jmp ind bug",	nullptr, { 0x6C, 0xFF, 0x10 },	0x00, 0, 0, 0x20, 0xFF, { { 0x10FF, 0x34 }, { 0x1000, 0x12 }, { 0x1100, 0x56 } },	0x00, 0, 0, 0x20, 0xFF, 0x1234, 5, 0, 0 },
+	{ "jmp ind",		Cmos65C02::NAME, { 0x6C, 0xFF, 0x10 },	0x00, 0, 0, 0x20, 0xFF, { { 0x10FF, 0x34 }, { 0x1000, 0x12 }, { 0x1100, 0x56 } },	0x00, 0, 0, 0x20, 0xFF, 0x5634, 6, 0, 0 },
+	
+	// The rest of the 65C02 set, and the undocumented NMOS loads
+	{ "bit imm",		Cmos65C02::NAME, { 0x89, 0x00 },	0x01, 0, 0, 0xE0, 0xFF, {},	0x01, 0, 0, 0xE2, 0xFF, 0x0202, 2, 0, 0 },
+	{ "stz",			Cmos65C02::NAME, { 0x64, 0x10 },	0x00, 0, 0, 0x20, 0xFF, { { 0x0010, 0x99 } },	0x00, 0, 0, 0x20, 0xFF, 0x0202, 3, 0x0010, 0x00 },
+	{ "tsb",			Cmos65C02::NAME, { 0x04, 0x10 },	0x0F, 0, 0, 0x20, 0xFF, { { 0x0010, 0xF0 } },	0x0F, 0, 0, 0x22, 0xFF, 0x0202, 5, 0x0010, 0xFF },
+	{ "inc a",			Cmos65C02::NAME, { 0x1A },		0x7F, 0, 0, 0x20, 0xFF, {},	0x80, 0, 0, 0xA0, 0xFF, 0x0201, 2, 0, 0 },
+	// The 65C02's unused opcodes are NOPs of different lengths, the
+	// Rockwell/WDC bit instruction and WAI/STP columns 1 byte and 1 cycle
+	{ "nop imm",		Cmos65C02::NAME, { 0x02, 0xFF },	0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFF, 0x0202, 2, 0, 0 },
+	{ "nop zpx",		Cmos65C02::NAME, { 0x54, 0x10 },	0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFF, 0x0202, 4, 0, 0 },
+	{ "nop abs",		Cmos65C02::NAME, { 0xDC, 0x34, 0x12 },	0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFF, 0x0203, 4, 0, 0 },
+	{ "nop 5c",			Cmos65C02::NAME, { 0x5C, 0x34, 0x12 },	0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFF, 0x0203, 8, 0, 0 },
+	{ "nop bbr",		Cmos65C02::NAME, { 0x0F, 0x10, 0x02 },	0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFF, 0x0201, 1, 0, 0 },
+	{ "nop wai",		Cmos65C02::NAME, { 0xCB },		0x00, 0, 0, 0x20, 0xFF, {},	0x00, 0, 0, 0x20, 0xFF, 0x0201, 1, 0, 0 },
+	{ "lax",			Ricoh2A03::NAME, { 0xA7, 0x10 },	0x00, 0, 0, 0x20, 0xFF, { { 0x0010, 0x81 } },	0x81, 0x81, 0, 0xA0, 0xFF, 0x0202, 3, 0, 0 },
+	{ "sax",			Ricoh2A03::NAME, { 0x87, 0x10 },	0xF0, 0x3C, 0, 0x20, 0xFF, {},	0xF0, 0x3C, 0, 0x20, 0xFF, 0x0202, 3, 0x0010, 0x30 },
+};
+
+// Runs every case, prints the ones that come out wrong, and returns how many
+static uint32 CheckIsa()
+{
+	MEM* mem = new MEM();
 	CPU cpu;
 	
+	uint32 cases = sizeof(ISA_CASES) / sizeof(ISA_CASES[0]);
+	uint32 failures = 0;
+	
+	for (const IsaCase& test : ISA_CASES)
+	{
+		cpu.Reset(*mem);
+		
+		for (uint32 i = 0; i < 3; i++)
+		{
+			(*mem)[0x0200 + i] = test.Code[i];
+			
+			if (test.Memory[i].Address != 0)
+			{
+				(*mem)[test.Memory[i].Address] = test.Memory[i].Value;
+			}
+		}
+		
+		cpu.PC = 0x0200;
+		cpu.SP = test.SP;
+		cpu.A = test.A;
+		cpu.X = test.X;
+		cpu.Y = test.Y;
+		cpu.SetStatus(test.P);
+		
+		// A budget of 1 runs exactly one instruction
+		sint32 used = ExecChip(test.Chip, cpu, 1, *mem);
+		
+		Byte value = (*mem)[test.CheckAddress];
+		
+		bool ok = cpu.A == test.WantA && cpu.X == test.WantX && cpu.Y == test.WantY
+			&& cpu.GetStatus() == test.WantP && cpu.SP == test.WantSP && cpu.PC == test.WantPC
+			&& used == test.WantCycles && (test.CheckAddress == 0 || value == test.WantValue) && cpu.Unknown == 0;
+		
+		if (!ok)
+		{
+			printf("isa check failed=\"%s\" chip=%s a=%02X/%02X x=%02X/%02X y=%02X/%02X p=%02X/%02X sp=%02X/%02X pc=%04X/%04X cycles=%d/%d mem=%02X/%02X\n",
+				test.Name, test.Chip ? test.Chip : Nmos6502::NAME,
+				cpu.A, test.WantA, cpu.X, test.WantX, cpu.Y, test.WantY,
+				cpu.GetStatus(), test.WantP, cpu.SP, test.WantSP, cpu.PC, test.WantPC,
+				used, test.WantCycles, value, test.WantValue);
+			
+			failures++;
+		}
+	}
+	
+	printf("isa check cases=%u failures=%u\n", cases, failures);
+	
+	delete mem;
+	
+	return failures;
+}
+
+
+// NOTE: JIT check
+// The same code through Exec and through ExecCached with a Jit, compared
+// afterwards: registers, P, PC, SP, the cycles taken, the instruction count
+// and all of memory. First the 6502 instruction check cases, each followed
+// by a JMP back to it so the block gets hot and compiled; a loop that
+// rewrites its own compiled block; then random programs over the whole
+// documented instruction set, looped the same way. Their stores land in
+// the program's own page now and then, and their pointers anywhere.
+static const Word JIT_CODE = 0x0400;
+
+static void LoadJitCase(const IsaCase& test, CPU& cpu, MEM& mem)
+{
 	cpu.Reset(mem);
 	
-	// CHEATING
-	mem[0xFFFC] = CPU::INS_JSR; // reset vector
+	Byte bytes = OP_INFO.Ops[test.Code[0]].Bytes;
 	
-	mem[0xFFFD] = 0x42;
-	mem[0xFFFE] = 0x42;
+	for (uint32 i = 0; i < bytes; i++)
+	{
+		mem[0x0200 + i] = test.Code[i];
+	}
 	
-	mem[0x4242] = CPU::INS_LDA_IMM;
-	mem[0x4243] = 0x84;
+	mem[0x0200 + bytes] = CPU::INS_JMP_ABS;
+	mem[0x0201 + bytes] = 0x00;
+	mem[0x0202 + bytes] = 0x02;
+	
+	for (uint32 i = 0; i < 3; i++)
+	{
+		if (test.Memory[i].Address != 0)
+		{
+			mem[test.Memory[i].Address] = test.Memory[i].Value;
+		}
+	}
+	
+	cpu.PC = 0x0200;
+	cpu.SP = test.SP;
+	cpu.A = test.A;
+	cpu.X = test.X;
+	cpu.Y = test.Y;
+	cpu.SetStatus(test.P);
+}
+
+
+static void LoadJitProgram(uint32 seed, CPU& cpu, MEM& mem)
+{
+	auto next = [&seed]()
+	{
+		seed = seed * 1664525 + 1013904223;
+		
+		return seed >> 8;
+	};
+	
+	// Everything but what leaves the loop for good
+	Byte ops[256];
+	uint32 count = 0;
+	
+	for (uint32 i = 0; i < 256; i++)
+	{
+		const OpInfo& info = OP_INFO.Ops[i];
+		
+		bool leaves = info.Instruction == MN_BRK || info.Instruction == MN_RTI || info.Instruction == MN_JMP
+			|| info.Instruction == MN_JSR || info.Instruction == MN_RTS;
+		
+		if (info.Name && !leaves)
+		{
+			ops[count++] = i;
+		}
+	}
+	
+	cpu.Reset(mem);
+	
+	for (uint32 i = 0; i < 0x0400; i++)
+	{
+		mem[i] = next();
+	}
+	
+	Word at = JIT_CODE;
+	
+	for (uint32 i = 0; i < 24; i++)
+	{
+		Byte opcode = ops[next() % count];
+		const OpInfo& info = OP_INFO.Ops[opcode];
+		
+		// Data below the code, one address in 16 in the code's own page
+		Word address = next() % 16 == 0 ? JIT_CODE + next() % 0x100 : next() % JIT_CODE;
+		
+		mem[at++] = opcode;
+		
+		if (info.Mode == AM_REL)
+		{
+			mem[at++] = 0x00;		// taken or not, on to the next one
+		}
+		else if (info.Bytes == 2)
+		{
+			mem[at++] = next();
+		}
+		else if (info.Bytes == 3)
+		{
+			mem[at++] = address;
+			mem[at++] = address >> 8;
+		}
+	}
+	
+	mem[at++] = CPU::INS_JMP_ABS;
+	mem[at++] = (Byte)JIT_CODE;
+	mem[at++] = JIT_CODE >> 8;
+	
+	cpu.PC = JIT_CODE;
+	cpu.SP = next();
+	cpu.A = next();
+	cpu.X = next();
+	cpu.Y = next();
+	cpu.SetStatus(next() & ~0x08);		// binary mode until a SED
+}
+
+
+// A loop whose block is hot long before its own store reaches it: STA
+// ($20),Y writes page 3 until X gets to $20, then the operand of the LDA
+// right after it. Only the side exit after the store picks that up, the
+// sum in $10 is off for good without it.
+static void LoadJitSelfModifying(CPU& cpu, MEM& mem)
+{
+	static const Byte code[] =
+	{
+		0xBD, 0x00, 0x02,	// LDA $0200,X		the pointer's high byte
+		0x85, 0x21,			// STA $21
+		0x8A,				// TXA
+		0x91, 0x20,			// STA ($20),Y
+		0xA9, 0x00,			// LDA #$00			at $0408
+		0x18,				// CLC
+		0x65, 0x10,			// ADC $10
+		0x85, 0x10,			// STA $10
+		0xE8,				// INX
+		0x4C, 0x00, 0x04,	// JMP $0400
+	};
+	
+	cpu.Reset(mem);
+	
+	for (uint32 i = 0; i < sizeof(code); i++)
+	{
+		mem[JIT_CODE + i] = code[i];
+	}
+	
+	for (uint32 x = 0; x < 0x100; x++)
+	{
+		mem[0x0200 + x] = x < 0x20 ? 0x03 : 0x04;
+	}
+	
+	mem[0x20] = 0x09;
+	
+	cpu.PC = JIT_CODE;
+}
+
+
+// Runs both sides for cycles and prints what differs, if anything
+static bool SameAsExec(const char* name, CPU* cpus, MEM* mems, sint32 cycles, BlockCache& cache, Jit& jit)
+{
+	// The second side's memory is new to the cache, the page counters could
+	// match stale blocks
+	cache.Init();
+	
+	sint32 used[2] = { cpus[0].Exec(cycles, mems[0]), cpus[1].ExecCached(cycles, mems[1], cache, &jit) };
+	
+	const CPU& a = cpus[0];
+	const CPU& b = cpus[1];
+	
+	bool same = used[0] == used[1] && a.A == b.A && a.X == b.X && a.Y == b.Y && a.SP == b.SP && a.PC == b.PC
+		&& a.GetStatus() == b.GetStatus() && a.Instructions == b.Instructions && a.Unknown == b.Unknown
+		&& memcmp(mems[0].Data, mems[1].Data, MEM::MAX_MEM) == 0;
+	
+	if (!same)
+	{
+		printf("jit check failed=\"%s\" a=%02X/%02X x=%02X/%02X y=%02X/%02X p=%02X/%02X sp=%02X/%02X pc=%04X/%04X cycles=%d/%d instructions=%llu/%llu memory=%s\n",
+			name, a.A, b.A, a.X, b.X, a.Y, b.Y, a.GetStatus(), b.GetStatus(), a.SP, b.SP, a.PC, b.PC,
+			used[0], used[1], a.Instructions, b.Instructions,
+			memcmp(mems[0].Data, mems[1].Data, MEM::MAX_MEM) == 0 ? "same" : "differs");
+	}
+	
+	return same;
+}
+
+
+static int CheckJit(uint32 programs, sint32 cycles)
+{
+	Jit* jit = new Jit;
+	
+	if (!jit->Init())
+	{
+		printf("JIT not available in this build\n");
+		
+		jit->Free();
+		delete jit;
+		
+		return 1;
+	}
+	
+	BlockCache* cache = new BlockCache;
+	MEM* mems = new MEM[2];
+	CPU cpus[2];
+	
+	uint32 cases = 0;
+	uint32 failures = 0;
+	
+	for (const IsaCase& test : ISA_CASES)
+	{
+		if (test.Chip)
+		{
+			continue;
+		}
+		
+		LoadJitCase(test, cpus[0], mems[0]);
+		LoadJitCase(test, cpus[1], mems[1]);
+		
+		failures += !SameAsExec(test.Name, cpus, mems, 2000, *cache, *jit);
+		cases++;
+	}
+	
+	// 30 cycles a time round, up to a couple past X = $20
+	LoadJitSelfModifying(cpus[0], mems[0]);
+	LoadJitSelfModifying(cpus[1], mems[1]);
+	
+	failures += !SameAsExec("self-modifying", cpus, mems, 0x22 * 30, *cache, *jit);
+	cases++;
+	
+	for (uint32 i = 0; i < programs; i++)
+	{
+		char name[32];
+		
+		snprintf(name, sizeof(name), "program %u", i);
+		
+		LoadJitProgram(i, cpus[0], mems[0]);
+		LoadJitProgram(i, cpus[1], mems[1]);
+		
+		failures += !SameAsExec(name, cpus, mems, cycles, *cache, *jit);
+	}
+	
+	printf("jit check cases=%u programs=%u failures=%u\n", cases, programs, failures);
+	jit->PrintStats();
+	
+	jit->Free();
+	delete jit;
+	delete cache;
+	delete[] mems;
+	
+	return failures != 0;
+}
+
+
+// NOTE: Benchmark suite
+// A fixed set of workloads, each run `runs` times through Exec from a fresh
+// Reset. Prints one line per workload, key=value pairs, so scripts can pick
+// it apart; the MHz spread is the standard deviation over the runs.
+// Any 64 KiB image can be added with `rom`, it runs from the reset PC like
+// everything else.
+struct Workload
+{
+	const char* Name;
+	void (*Load)(MEM& mem);
+	bool (*Passed)(const CPU& cpu, const MEM& mem) = nullptr;	// self-checking ones only
+};
+
+
+// Assembles into memory from At on, for the workloads that are generated
+struct CodeWriter
+{
+	MEM* Memory;
+	Word At;
+	
+	void Put(std::initializer_list<Byte> bytes)
+	{
+		for (Byte b : bytes)
+		{
+			(*Memory)[At++] = b;
+		}
+	}
+	
+	
+	// `branch` has to be taken, or the CPU ends up in a JMP to itself
+	void Check(Byte branch)
+	{
+		Word trap = At + 2;
+		
+		Put({ branch, 0x03, CPU::INS_JMP_ABS, (Byte)trap, (Byte)(trap >> 8) });
+	}
+};
+
+
+static Byte SuiteRom[MEM::MAX_MEM];
+
+
+// LDA #$A9 over and over, the cheapest instruction there is
+static void LoadImmediateWorkload(MEM& mem)
+{
+	for (uint32 i = 0; i < MEM::MAX_MEM; i++)
+	{
+		mem[i] = CPU::INS_LDA_IMM;
+	}
+}
+
+
+// LDA $B5,X over and over, a memory read and an index add each
+static void LoadZeroPageWorkload(MEM& mem)
+{
+	for (uint32 i = 0; i < MEM::MAX_MEM; i++)
+	{
+		mem[i] = CPU::INS_LDA_ZPX;
+	}
+}
+
+
+// LDA #$A9 with a JSR now and then. After the one at $FFFC it goes round
+// $A5A5 .. JSR $A9A9 at $A9A7 .. JSR $A5A5 at $B5B3 for good. There is no
+// RTS, so the stack just wraps around page 1, which never runs. About one
+// call per thousand instructions, and every call writes the stack.
+static void LoadCallWorkload(MEM& mem)
+{
+	static const Word CALLS[] = { 0xFFFC, 0xB5B3, 0xA9A7 };
+	static const Byte TARGETS[] = { 0xA5, 0xA5, 0xA9 };		// $A5A5, $A5A5, $A9A9
+	
+	LoadImmediateWorkload(mem);
+	
+	for (uint32 i = 0; i < 3; i++)
+	{
+		mem[CALLS[i]] = CPU::INS_JSR;
+		mem[CALLS[i] + 1] = TARGETS[i];
+		mem[CALLS[i] + 2] = TARGETS[i];
+	}
+}
+
+
+// The status register in and out: PHP/PLP, BIT (N, V and Z from memory),
+// CMP, ROL through the carry and PHP/PLA to read P as a value. Every one of
+// them has to build P or take it apart.
+static void LoadFlagsWorkload(MEM& mem)
+{
+	static const Byte CODE[] =
+	{
+		0xA9, 0xC3,			// $0000	LDA #$C3
+		0x85, 0x10,			//			STA $10
+		0x08,				// $0004	PHP
+		0x24, 0x10,			//			BIT $10
+		0xC9, 0x40,			//			CMP #$40
+		0x2A,				//			ROL A
+		0x28,				//			PLP
+		0x08,				//			PHP
+		0x68,				//			PLA
+		0x4C, 0x04, 0x00,	//			JMP $0004
+	};
+	
+	for (uint32 i = 0; i < sizeof(CODE); i++)
+	{
+		mem[i] = CODE[i];
+	}
+	
+	mem[0xFFFC] = CPU::INS_JMP_ABS;
+	mem[0xFFFD] = 0x00;
+	mem[0xFFFE] = 0x00;
+}
+
+
+// Copies $2000-$2FFF to $4000-$4FFF a page at a time through two (zp),Y
+// pointers, then starts over
+static void LoadCopyWorkload(MEM& mem)
+{
+	static const Byte CODE[] =
+	{
+		0xA9, 0x20,			// $0000	LDA #$20
+		0x85, 0xF1,			//			STA $F1
+		0xA9, 0x40,			//			LDA #$40
+		0x85, 0xF3,			//			STA $F3
+		0xA9, 0x00,			//			LDA #$00
+		0x85, 0xF0,			//			STA $F0
+		0x85, 0xF2,			//			STA $F2
+		0xA2, 0x10,			//			LDX #$10
+		0xA0, 0x00,			//			LDY #$00
+		0xB1, 0xF0,			// $0012	LDA ($F0),Y
+		0x91, 0xF2,			//			STA ($F2),Y
+		0xC8,				//			INY
+		0xD0, 0xF9,			//			BNE $0012
+		0xE6, 0xF1,			//			INC $F1
+		0xE6, 0xF3,			//			INC $F3
+		0xCA,				//			DEX
+		0xD0, 0xF2,			//			BNE $0012
+		0x4C, 0x00, 0x00,	//			JMP $0000
+	};
+	
+	for (uint32 i = 0; i < sizeof(CODE); i++)
+	{
+		mem[i] = CODE[i];
+	}
+	
+	for (uint32 i = 0; i < 0x1000; i++)
+	{
+		mem[0x2000 + i] = (Byte)(i * 7 + 3);
+	}
+	
+	mem[0xFFFC] = CPU::INS_JMP_ABS;
+	mem[0xFFFD] = 0x00;
+	mem[0xFFFE] = 0x00;
+}
+
+
+// 16-bit ADC and SBC through zero page, then a decimal ADC and SBC
+static void LoadArithmeticWorkload(MEM& mem)
+{
+	static const Byte CODE[] =
+	{
+		0xD8,				// $0200	CLD
+		0x18,				// $0201	CLC
+		0xA5, 0x10,			//			LDA $10
+		0x69, 0x37,			//			ADC #$37
+		0x85, 0x10,			//			STA $10
+		0xA5, 0x11,			//			LDA $11
+		0x65, 0x12,			//			ADC $12
+		0x85, 0x11,			//			STA $11
+		0x38,				//			SEC
+		0xA5, 0x13,			//			LDA $13
+		0xE5, 0x10,			//			SBC $10
+		0x85, 0x13,			//			STA $13
+		0xA5, 0x14,			//			LDA $14
+		0xE5, 0x11,			//			SBC $11
+		0x85, 0x14,			//			STA $14
+		0xF8,				//			SED
+		0x18,				//			CLC
+		0xA5, 0x15,			//			LDA $15
+		0x69, 0x01,			//			ADC #$01
+		0x85, 0x15,			//			STA $15
+		0x38,				//			SEC
+		0xA5, 0x16,			//			LDA $16
+		0xE9, 0x01,			//			SBC #$01
+		0x85, 0x16,			//			STA $16
+		0xD8,				//			CLD
+		0x4C, 0x01, 0x02,	//			JMP $0201
+	};
+	
+	for (uint32 i = 0; i < sizeof(CODE); i++)
+	{
+		mem[0x0200 + i] = CODE[i];
+	}
+	
+	mem[0x12] = 0x05;
+	
+	mem[0xFFFC] = CPU::INS_JMP_ABS;
+	mem[0xFFFD] = 0x00;
+	mem[0xFFFE] = 0x02;
+}
+
+
+// An 8-bit LFSR in $10 drives three branches that go either way about half
+// the time, so the host's predictor can't learn them, then a compare
+// against a counter and the loop branch
+static void LoadBranchWorkload(MEM& mem)
+{
+	static const Byte CODE[] =
+	{
+		0xA9, 0x01,			// $0200	LDA #$01
+		0x85, 0x10,			//			STA $10
+		0xA5, 0x10,			// $0204	LDA $10
+		0x0A,				//			ASL A
+		0x90, 0x02,			//			BCC $020B
+		0x49, 0x1D,			//			EOR #$1D
+		0x85, 0x10,			// $020B	STA $10
+		0x4A,				//			LSR A
+		0x90, 0x01,			//			BCC $0211
+		0xE8,				//			INX
+		0x4A,				// $0211	LSR A
+		0xB0, 0x01,			//			BCS $0215
+		0xC8,				//			INY
+		0xC5, 0x11,			// $0215	CMP $11
+		0x30, 0x02,			//			BMI $021B
+		0xE6, 0x11,			//			INC $11
+		0xE0, 0x80,			// $021B	CPX #$80
+		0xD0, 0xE5,			//			BNE $0204
+		0xA2, 0x00,			//			LDX #$00
+		0x4C, 0x04, 0x02,	//			JMP $0204
+	};
+	
+	for (uint32 i = 0; i < sizeof(CODE); i++)
+	{
+		mem[0x0200 + i] = CODE[i];
+	}
+	
+	mem[0xFFFC] = CPU::INS_JMP_ABS;
+	mem[0xFFFD] = 0x00;
+	mem[0xFFFE] = 0x02;
+}
+
+
+// NOTE: Functional test
+// The instruction check's 6502 cases that run straight through and leave
+// the stack alone, assembled into one self-checking program. Each one sets
+// up its memory, registers and P (through PLP), runs its instruction, and
+// compares A, X, Y, P and its memory byte. Ahead of them JSR/RTS and the
+// branches get checked. A failed compare ends in a JMP to itself, a full
+// pass counts up $F0-$F2 and starts over.
+static const Word FUNCTIONAL_START	= 0x4000;
+static const Word FUNCTIONAL_SUB	= 0x3F00;
+
+static void LoadFunctionalWorkload(MEM& mem)
+{
+	CodeWriter code = { &mem, FUNCTIONAL_SUB };
+	
+	code.Put({ 0xA9, 0x5A, 0x60 });		// LDA #$5A, RTS
+	
+	code.At = FUNCTIONAL_START;
+	
+	code.Put({ 0xD8, 0xA9, 0x00 });		// CLD, LDA #0
+	code.Put({ CPU::INS_JSR, (Byte)FUNCTIONAL_SUB, (Byte)(FUNCTIONAL_SUB >> 8) });
+	code.Put({ 0xC9, 0x5A });			// CMP #$5A
+	code.Check(0xF0);					// BEQ
+	code.Put({ 0xA2, 0x00, 0xE8 });		// LDX #0, INX
+	code.Check(0xD0);					// BNE
+	code.Check(0x10);					// BPL
+	code.Put({ 0xCA, 0xCA });			// DEX, DEX
+	code.Check(0x30);					// BMI
+	code.Put({ 0x18 });					// CLC
+	code.Check(0x90);					// BCC
+	code.Put({ 0x38 });					// SEC
+	code.Check(0xB0);					// BCS
+	
+	for (const IsaCase& test : ISA_CASES)
+	{
+		const OpInfo& info = OP_INFO.Ops[test.Code[0]];
+		
+		if (test.Chip || !info.Name || test.SP != 0xFF || test.WantSP != 0xFF || test.WantPC != 0x0200 + info.Bytes)
+		{
+			continue;
+		}
+		
+		for (uint32 i = 0; i < 3; i++)
+		{
+			Word address = test.Memory[i].Address;
+			
+			if (address != 0)
+			{
+				code.Put({ 0xA9, test.Memory[i].Value, 0x8D, (Byte)address, (Byte)(address >> 8) });	// LDA #, STA abs
+			}
+		}
+		
+		code.Put({ 0xA9, test.P, 0x48 });							// LDA #P, PHA
+		code.Put({ 0xA9, test.A, 0xA2, test.X, 0xA0, test.Y });	// LDA, LDX, LDY
+		code.Put({ 0x28 });											// PLP
+		
+		for (uint32 i = 0; i < info.Bytes; i++)
+		{
+			code.Put({ test.Code[i] });
+		}
+		
+		code.Put({ 0x08 });											// PHP
+		code.Put({ 0xC9, test.WantA });								// CMP #
+		code.Check(0xF0);
+		code.Put({ 0xE0, test.WantX });								// CPX #
+		code.Check(0xF0);
+		code.Put({ 0xC0, test.WantY });								// CPY #
+		code.Check(0xF0);
+		code.Put({ 0x68, 0xC9, (Byte)(test.WantP | 0x10) });		// PLA, CMP # (PHP adds B)
+		code.Check(0xF0);
+		
+		if (test.CheckAddress != 0)
+		{
+			code.Put({ 0xAD, (Byte)test.CheckAddress, (Byte)(test.CheckAddress >> 8), 0xC9, test.WantValue });	// LDA abs, CMP #
+			code.Check(0xF0);
+		}
+	}
+	
+	code.Put({ 0xE6, 0xF0, 0xD0, 0x06 });	// INC $F0, BNE +6
+	code.Put({ 0xE6, 0xF1, 0xD0, 0x02 });	// INC $F1, BNE +2
+	code.Put({ 0xE6, 0xF2 });				// INC $F2
+	code.Put({ CPU::INS_JMP_ABS, (Byte)FUNCTIONAL_START, (Byte)(FUNCTIONAL_START >> 8) });
+	
+	mem[0xFFFC] = CPU::INS_JMP_ABS;
+	mem[0xFFFD] = (Byte)FUNCTIONAL_START;
+	mem[0xFFFE] = (Byte)(FUNCTIONAL_START >> 8);
+}
+
+
+// Made it round at least once, and not stuck in a trap
+static bool FunctionalPassed(const CPU& cpu, const MEM& mem)
+{
+	bool trapped = mem.Peek(cpu.PC) == CPU::INS_JMP_ABS
+		&& mem.Peek((cpu.PC + 1) & 0xFFFF) == (cpu.PC & 0xFF) && mem.Peek((cpu.PC + 2) & 0xFFFF) == (cpu.PC >> 8);
+	
+	return !trapped && (mem.Peek(0xF0) | mem.Peek(0xF1) | mem.Peek(0xF2)) != 0;
+}
+
+
+static void LoadRomWorkload(MEM& mem)
+{
+	for (uint32 i = 0; i < MEM::MAX_MEM; i++)
+	{
+		mem[i] = SuiteRom[i];
+	}
+}
+
+
+// Snapshot latency: Take on its own, then a write to each of `pages` pages
+// followed by a Restore, against the same writes followed by copying the
+// whole 64 KiB and the registers back by hand. The writes are in both.
+static void BenchSnapshots(uint32 runs)
+{
+	static const uint32 PAGES[] = { 1, 16, 256 };
+	const uint32 count = 10000 * runs;
+	
+	MEM* mem = new MEM;
+	Snapshot* snapshot = new Snapshot;
+	Byte* copy = new Byte[MEM::MAX_MEM];
+	CPU cpu, saved;
+	
+	cpu.Reset(*mem);
+	
+	LoadBenchProgram(*mem);
+	
+	for (uint32 p = 0; p < sizeof(PAGES) / sizeof(PAGES[0]); p++)
+	{
+		uint32 pages = PAGES[p];
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			snapshot->Take(cpu, *mem);
+		}
+		
+		auto stop = std::chrono::steady_clock::now();
+		
+		double take = std::chrono::duration<double>(stop - start).count();
+		
+		start = std::chrono::steady_clock::now();
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			for (uint32 page = 0; page < pages; page++)
+			{
+				mem->WriteByte(page * 256 + (i & 0xFF), i);
+			}
+			
+			snapshot->Restore(cpu, *mem);
+		}
+		
+		stop = std::chrono::steady_clock::now();
+		
+		double restore = std::chrono::duration<double>(stop - start).count();
+		
+		mem->Detach();
+		
+		memcpy(copy, mem->Data, MEM::MAX_MEM);
+		saved = cpu;
+		
+		start = std::chrono::steady_clock::now();
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			for (uint32 page = 0; page < pages; page++)
+			{
+				mem->WriteByte(page * 256 + (i & 0xFF), i);
+			}
+			
+			memcpy(mem->Data, copy, MEM::MAX_MEM);
+			cpu = saved;
+		}
+		
+		stop = std::chrono::steady_clock::now();
+		
+		double full = std::chrono::duration<double>(stop - start).count();
+		
+		printf("suite snapshot pages=%u count=%u take_ns=%.1f restore_ns=%.1f copy_restore_ns=%.1f\n",
+			pages, count, take * 1e9 / count, restore * 1e9 / count, full * 1e9 / count);
+	}
+	
+	delete[] copy;
+	delete snapshot;
+	delete mem;
+}
+
+
+static int BenchSuite(uint32 runs, sint32 cycles, const char* rom)
+{
+	Workload workloads[] =
+	{
+		{ "loads",		LoadBenchProgram },
+		{ "immediate",	LoadImmediateWorkload },
+		{ "zeropage",	LoadZeroPageWorkload },
+		{ "calls",		LoadCallWorkload },
+		{ "flags",		LoadFlagsWorkload },
+		{ "copy",		LoadCopyWorkload },
+		{ "arithmetic",	LoadArithmeticWorkload },
+		{ "branches",	LoadBranchWorkload },
+		{ "functional",	LoadFunctionalWorkload, FunctionalPassed },
+		{ "rom",		LoadRomWorkload },
+	};
+	
+	uint32 count = sizeof(workloads) / sizeof(workloads[0]);
+	
+	if (rom)
+	{
+		FILE* file = fopen(rom, "rb");
+		
+		if (!file || fread(SuiteRom, 1, MEM::MAX_MEM, file) != MEM::MAX_MEM)
+		{
+			fprintf(stderr, "can not read a 64 KiB image from %s\n", rom);
+			
+			if (file)
+			{
+				fclose(file);
+			}
+			
+			return 1;
+		}
+		
+		fclose(file);
+	}
+	else
+	{
+		count--;
+	}
+	
+	if (runs == 0)
+	{
+		runs = 1;
+	}
+	
+	MEM* mem = new MEM;
+	CPU cpu;
+	bool ok = true;
+	
+	for (uint32 w = 0; w < count; w++)
+	{
+		double sum = 0, sumSquares = 0, seconds = 0;
+		uint64 instructions = 0, used = 0;
+		bool passed = true;
+		
+		for (uint32 run = 0; run < runs; run++)
+		{
+			cpu.Reset(*mem);
+			
+			workloads[w].Load(*mem);
+			
+			auto start = std::chrono::steady_clock::now();
+			
+			sint32 ran = cpu.Exec(cycles, *mem);
+			
+			auto stop = std::chrono::steady_clock::now();
+			
+			double elapsed = std::chrono::duration<double>(stop - start).count();
+			double mhz = ran / elapsed / 1e6;
+			
+			sum += mhz;
+			sumSquares += mhz * mhz;
+			seconds += elapsed;
+			instructions += cpu.Instructions;
+			used += ran;
+			
+			passed = passed && (!workloads[w].Passed || workloads[w].Passed(cpu, *mem));
+		}
+		
+		double mean = sum / runs;
+		double variance = sumSquares / runs - mean * mean;
+		
+		printf("suite workload=%s dispatch=%s runs=%u cycles=%llu instructions=%llu seconds=%.3f"
+			" mhz=%.1f mhz_stddev=%.2f ips=%.0f ns_per_instruction=%.3f%s\n",
+			workloads[w].Name, DISPATCH_NAME, runs, used, instructions, seconds,
+			mean, sqrt(variance > 0 ? variance : 0), instructions / seconds, seconds * 1e9 / instructions,
+			!workloads[w].Passed ? "" : passed ? " check=pass" : " check=fail");
+		
+		ok = ok && passed;
+	}
+	
+	delete mem;
+	
+	BenchSnapshots(runs);
+	
+	return ok ? 0 : 1;
+}
+
+
+// NOTE: Delta trace benchmark
+// Records one of the suite's workloads into a delta trace, reads it all
+// back, then reads from the middle keyframe on, and compares the size with
+// plain 16-byte Trace records.
+static int RunDeltaTrace(const char* workload, sint32 cycles, const char* path, uint32 interval)
+{
+	void (*load)(MEM& mem) = nullptr;
+	
+	if (strcmp(workload, "loads") == 0)		load = LoadBenchProgram;
+	if (strcmp(workload, "immediate") == 0)	load = LoadImmediateWorkload;
+	if (strcmp(workload, "zeropage") == 0)	load = LoadZeroPageWorkload;
+	if (strcmp(workload, "calls") == 0)		load = LoadCallWorkload;
+	
+	if (!load)
+	{
+		fprintf(stderr, "unknown workload %s\n", workload);
+		return 1;
+	}
+	
+	MEM* mem = new MEM;
+	DeltaTraceWriter* writer = new DeltaTraceWriter;
+	DeltaTraceReader* reader = new DeltaTraceReader();	// zeroed, so Close is safe before Open
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	load(*mem);
+	
+	if (!writer->Open(path, cpu, *mem, interval))
+	{
+		fprintf(stderr, "can not write %s\n", path);
+		
+		delete reader;
+		delete writer;
+		delete mem;
+		
+		return 1;
+	}
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	sint32 used = cpu.Exec(cycles, *mem);
+	
+	bool ok = writer->Close(cpu, *mem);
+	
+	auto stop = std::chrono::steady_clock::now();
+	
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	
+	uint64 records = writer->State.Index;
+	uint64 size = writer->Offset;
+	
+	printf("deltatrace write workload=%s cycles=%d records=%llu seconds=%.3f mhz=%.1f records_per_sec=%.0f\n",
+		workload, used, records, seconds, used / seconds / 1e6, records / seconds);
+	
+	printf("deltatrace size bytes=%llu bits_per_record=%.2f raw_bytes=%llu ratio=%.1f keyframes=%u\n",
+		size, size * 8.0 / records, records * sizeof(Trace::Record),
+		(double)(records * sizeof(Trace::Record)) / size, writer->Keyframes);
+	
+	if (!ok || !reader->Open(path))
+	{
+		fprintf(stderr, "can not read back %s\n", path);
+		
+		reader->Close();
+		
+		delete reader;
+		delete writer;
+		delete mem;
+		
+		return 1;
+	}
+	
+	for (uint32 pass = 0; pass < 2; pass++)
+	{
+		uint32 keyframe = pass == 0 ? 0 : reader->Footer.Keyframes / 2;
+		
+		start = std::chrono::steady_clock::now();
+		
+		reader->Seek(keyframe);
+		
+		DeltaTrace::Record record = {};
+		uint64 count = 0, checksum = 0;
+		
+		while (reader->Next(record))
+		{
+			checksum = checksum * 31 + record.PC + record.A;
+			count++;
+		}
+		
+		stop = std::chrono::steady_clock::now();
+		
+		seconds = std::chrono::duration<double>(stop - start).count();
+		
+		printf("deltatrace read keyframe=%u records=%llu seconds=%.3f records_per_sec=%.0f last_pc=%04X last_a=%02X\n",
+			keyframe, count, seconds, count / seconds, record.PC, record.A);
+	}
+	
+	printf("cpu pc=%04X a=%02X\n", cpu.PC, cpu.A);
+	
+	reader->Close();
+	
+	delete reader;
+	delete writer;
+	delete mem;
+	
+	return 0;
+}
+
+
+// NOTE: Reverse execution
+// Runs the calls workload with an undo log, then goes back three ways and
+// checks every stop against a fresh run forward to the same instruction.
+static bool SameMachine(const CPU& a, const MEM& am, const CPU& b, const MEM& bm)
+{
+	return a.PC == b.PC && a.SP == b.SP && a.A == b.A && a.X == b.X && a.Y == b.Y &&
+		a.GetStatus() == b.GetStatus() && a.Instructions == b.Instructions &&
+		memcmp(am.Data, bm.Data, MEM::MAX_MEM) == 0;
+}
+
+
+static bool MatchesForwardRun(const CPU& cpu, const MEM& mem, uint64 instructions)
+{
+	MEM* ref = new MEM;
+	CPU other;
+	
+	other.Reset(*ref);
+	
+	LoadCallWorkload(*ref);
+	
+	for (uint64 i = 0; i < instructions; i++)
+	{
+		other.Step(*ref);
+	}
+	
+	bool same = SameMachine(cpu, mem, other, *ref);
+	
+	delete ref;
+	
+	return same;
+}
+
+
+static int RunReverse(sint32 cycles, uint32 back, uint32 interval)
+{
+	MEM* mem = new MEM;
+	MEM* plain = new MEM;
+	UndoLog* log = new UndoLog;
+	CPU cpu, other;
+	
+	other.Reset(*plain);
+	LoadCallWorkload(*plain);
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	other.Exec(cycles, *plain);
+	
+	double plainSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	cpu.Reset(*mem);
+	LoadCallWorkload(*mem);
+	
+	log->Attach(cpu, *mem, interval);
+	
+	start = std::chrono::steady_clock::now();
+	
+	sint32 used = cpu.Exec(cycles, *mem);
+	
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	uint64 bytes = log->Count * sizeof(UndoLog::Step) + log->WriteCount * sizeof(UndoLog::WriteEntry) +
+		log->CheckpointCount * MEM::MAX_MEM;
+	
+	printf("reverse record cycles=%d instructions=%llu writes=%llu checkpoints=%llu bytes=%llu mhz=%.1f plain_mhz=%.1f\n",
+		used, log->Count, log->WriteCount, log->CheckpointCount, bytes, used / seconds / 1e6, used / plainSeconds / 1e6);
+	
+	bool ok = true;
+	
+	// Back n instructions
+	start = std::chrono::steady_clock::now();
+	
+	uint64 went = log->StepBack(cpu, back);
+	
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	bool same = MatchesForwardRun(cpu, *mem, log->Count);
+	
+	printf("reverse stepback count=%llu at=%llu us=%.1f match=%s\n", went, log->Count, seconds * 1e6, same ? "yes" : "no");
+	
+	ok = ok && same;
+	
+	// Back to the last write of a stack byte the run passed halfway through
+	Word address = log->WriteCount ? log->Writes[log->WriteCount / 2].Address : 0x01FF;
+	uint64 from = log->Count;
+	
+	start = std::chrono::steady_clock::now();
+	
+	bool found = log->BackToWrite(cpu, address);
+	
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	same = MatchesForwardRun(cpu, *mem, log->Count);
+	
+	printf("reverse backtowrite address=%04X found=%s distance=%llu at=%llu us=%.1f match=%s\n",
+		address, found ? "yes" : "no", from - log->Count, log->Count, seconds * 1e6, same ? "yes" : "no");
+	
+	ok = ok && same;
+	
+	// Most of the way back, which goes through a checkpoint
+	uint64 target = log->Count / 3;
+	
+	start = std::chrono::steady_clock::now();
+	
+	log->GoTo(cpu, target);
+	
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	same = MatchesForwardRun(cpu, *mem, log->Count);
+	
+	printf("reverse goto at=%llu us=%.1f match=%s\n", log->Count, seconds * 1e6, same ? "yes" : "no");
+	
+	ok = ok && same;
+	
+	log->Detach(cpu);
+	log->Free();
+	
+	delete log;
+	delete plain;
+	delete mem;
+	
+	return ok ? 0 : 1;
+}
+
+
+// NOTE: Breakpoint benchmark
+// What breakpoints and watchpoints cost when they do not hit (immediate
+// workload: no breakpoints, the bitmap attached, a write watch on the stack
+// page, which the code runs over), then how often they hit on the calls
+// workload, through Exec and through the block cache.
+static double TimeBreakpoints(sint32 cycles, Breakpoints* breaks, bool watch)
+{
+	MEM* mem = new MEM;
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	LoadImmediateWorkload(*mem);
+	
+	cpu.Breaks = breaks;
+	
+	if (watch)
+	{
+		mem->Watch(0x0100, false, true);
+	}
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	sint32 used = cpu.Exec(cycles, *mem);
+	
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	delete mem;
+	
+	return used / seconds / 1e6;
+}
+
+
+static uint32 CountStops(sint32 cycles, bool blocks, CPU::StopReason reason, Word* first)
+{
+	MEM* mem = new MEM;
+	Breakpoints* breaks = new Breakpoints;
+	BlockCache* cache = blocks ? new BlockCache : nullptr;
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	LoadCallWorkload(*mem);
+	
+	breaks->Init();
+	cpu.Breaks = breaks;
+	
+	if (reason == CPU::STOP_BREAKPOINT)
+	{
+		breaks->Set(0xA5A5, *mem);
+	}
+	else
+	{
+		mem->Watch(0x0140, false, true);
+	}
+	
+	if (cache)
+	{
+		cache->Init();
+	}
+	
+	uint32 stops = 0;
+	
+	while (cycles > 0)
+	{
+		cycles -= cache ? cpu.ExecCached(cycles, *mem, *cache) : cpu.Exec(cycles, *mem);
+		
+		if (cpu.Stop == reason)
+		{
+			if (stops++ == 0)
+			{
+				*first = reason == CPU::STOP_BREAKPOINT ? cpu.PC : mem->TrapAddress;
+			}
+		}
+	}
+	
+	delete cache;
+	delete breaks;
+	delete mem;
+	
+	return stops;
+}
+
+
+static int RunBreakpoints(sint32 cycles)
+{
+	Breakpoints* breaks = new Breakpoints;
+	
+	breaks->Init();
+	
+	printf("breakpoints cost none_mhz=%.1f attached_mhz=%.1f watched_page_mhz=%.1f\n",
+		TimeBreakpoints(cycles, nullptr, false), TimeBreakpoints(cycles, breaks, false),
+		TimeBreakpoints(cycles, nullptr, true));
+	
+	bool ok = true;
+	
+	for (uint32 kind = 0; kind < 2; kind++)
+	{
+		CPU::StopReason reason = kind == 0 ? CPU::STOP_BREAKPOINT : CPU::STOP_WATCHPOINT;
+		Word first[2] = {};
+		
+		uint32 exec = CountStops(cycles, false, reason, &first[0]);
+		uint32 blocks = CountStops(cycles, true, reason, &first[1]);
+		
+		printf("breakpoints hits kind=%s exec=%u blocks=%u first=%04X\n",
+			kind == 0 ? "breakpoint" : "watchpoint", exec, blocks, first[0]);
+		
+		ok = ok && exec == blocks && exec > 0 && first[0] == first[1];
+	}
+	
+	delete breaks;
+	
+	return ok ? 0 : 1;
+}
+
+
+// NOTE: Condition benchmark
+// Evaluation cost of a few compiled conditions, then the calls workload
+// with a conditional breakpoint on the JSR target (stopping only for the
+// call from $B5B3, whose return address ends in $B5) and a tracepoint on
+// the other one, checked against plain breakpoints and the same tests
+// written out in C++.
+static uint32 CountConditionStops(sint32 cycles, const Condition* when, uint64* traced)
+{
+	MEM* mem = new MEM;
+	Breakpoints* breaks = new Breakpoints;
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	LoadCallWorkload(*mem);
+	
+	breaks->Init();
+	cpu.Breaks = breaks;
+	
+	if (when)
+	{
+		breaks->Add(0xA5A5, when[0], false, *mem);
+		breaks->Add(0xA9A9, when[1], true, *mem);
+	}
+	else
+	{
+		breaks->Set(0xA5A5, *mem);
+		breaks->Set(0xA9A9, *mem);
+	}
+	
+	uint32 stops = 0;
+	*traced = 0;
+	
+	while (cycles > 0)
+	{
+		cycles -= cpu.Exec(cycles, *mem);
+		
+		if (cpu.Stop != CPU::STOP_BREAKPOINT)
+		{
+			continue;
+		}
+		
+		if (when)
+		{
+			stops++;
+		}
+		else if (cpu.PC == 0xA5A5 && mem->Peek(0x101 + cpu.SP) == 0xB5)
+		{
+			stops++;
+		}
+		else if (cpu.PC == 0xA9A9 && (cpu.SP & 1))
+		{
+			(*traced)++;
+		}
+	}
+	
+	if (when)
+	{
+		*traced = breaks->Conditions[1].Hits;
+	}
+	
+	delete breaks;
+	delete mem;
+	
+	return stops;
+}
+
+
+static int RunConditions(sint32 cycles)
+{
+	static const char* const TEXTS[] =
+	{
+		"A == $42 && mem[$10] > 3",
+		"mem[$101 + SP] == $B5",
+		"SP & 1",
+		"(P & $80 == 0 || X + Y >= $100) && !(C | V)",
+	};
+	
+	const uint32 count = 10000000;
+	
+	Condition* conditions = new Condition[4];
+	MEM* mem = new MEM;
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	LoadCallWorkload(*mem);
+	
+	for (uint32 c = 0; c < 4; c++)
+	{
+		if (!conditions[c].Compile(TEXTS[c]))
+		{
+			fprintf(stderr, "%s: %s at %u\n", TEXTS[c], conditions[c].Error, conditions[c].ErrorAt);
+			
+			delete mem;
+			delete[] conditions;
+			
+			return 1;
+		}
+		
+		uint32 held = 0;
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			cpu.X = i;
+			held += conditions[c].Eval(cpu, *mem);
+		}
+		
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		
+		printf("conditions eval code_bytes=%u ns=%.1f held=%u text=\"%s\"\n",
+			conditions[c].Length, seconds * 1e9 / count, held, TEXTS[c]);
+	}
+	
+	uint64 traced, expectedTraced;
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	uint32 stops = CountConditionStops(cycles, conditions + 1, &traced);
+	
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	
+	uint32 expected = CountConditionStops(cycles, nullptr, &expectedTraced);
+	
+	printf("conditions run cycles=%d stops=%u expected=%u traced=%llu expected=%llu mhz=%.1f\n",
+		cycles, stops, expected, traced, expectedTraced, cycles / seconds / 1e6);
+	
+	delete mem;
+	delete[] conditions;
+	
+	return stops == expected && traced == expectedTraced ? 0 : 1;
+}
+
+
+// NOTE: ISA benchmark
+// The handlers generated from CPU_ISA against a representative set written
+// out by hand, the way they were before the table: loads and stores,
+// transfers and counters, the ALU, shifts, read-modify-write, branches,
+// the stack, jumps and the flags. Anything else goes through Dispatch.
+// Each workload runs through Exec and through ExecHandWritten on the same
+// bus (RamBus, which Exec picks on its own since nothing is mapped), best of
+// `runs` each, and both have to end up in the same state.
+template <typename Bus>
+static sint32 ExecHandWritten(CPU& cpu, sint32 cycles, Bus& memory)
+{
+	const sint32 requested = cycles;
+	
+	while (cycles > 0)
+	{
+		Byte instruction = cpu.FetchByte(cycles, memory);
+		
+		switch (instruction)
+		{
+			// Loads and stores
+			case CPU::INS_LDA_IMM:
+			{
+				cpu.A = cpu.NextByte(memory);
+				cpu.NZ = cpu.A;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_LDA_ZP:
+			{
+				cpu.A = memory.ReadByte(cpu.NextByte(memory));
+				cpu.NZ = cpu.A;
+				cycles -= 2;
+			} break;
+			
+			case CPU::INS_LDA_ZPX:
+			{
+				cpu.A = memory.ReadByte((Byte)(cpu.NextByte(memory) + cpu.X));
+				cpu.NZ = cpu.A;
+				cycles -= 3;
+			} break;
+			
+			case CPU::INS_LDA_IZY:
+			{
+				Byte pointer = cpu.NextByte(memory);
+				Word base = memory.ReadByte(pointer) | (memory.ReadByte((Byte)(pointer + 1)) << 8);
+				Word address = base + cpu.Y;
+				
+				cpu.A = memory.ReadByte(address);
+				cpu.NZ = cpu.A;
+				cycles -= 4 + ((base ^ address) > 0xFF);
+			} break;
+			
+			case CPU::INS_LDX_IMM:
+			{
+				cpu.X = cpu.NextByte(memory);
+				cpu.NZ = cpu.X;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_LDY_IMM:
+			{
+				cpu.Y = cpu.NextByte(memory);
+				cpu.NZ = cpu.Y;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_STA_ZP:
+			{
+				memory.WriteByte(cpu.NextByte(memory), cpu.A);
+				cycles -= 2;
+			} break;
+			
+			case CPU::INS_STA_IZY:
+			{
+				Byte pointer = cpu.NextByte(memory);
+				Word base = memory.ReadByte(pointer) | (memory.ReadByte((Byte)(pointer + 1)) << 8);
+				
+				memory.WriteByte((Word)(base + cpu.Y), cpu.A);
+				cycles -= 5;
+			} break;
+			
+			// Counters
+			case CPU::INS_INX:
+			{
+				cpu.X++;
+				cpu.NZ = cpu.X;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_INY:
+			{
+				cpu.Y++;
+				cpu.NZ = cpu.Y;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_DEX:
+			{
+				cpu.X--;
+				cpu.NZ = cpu.X;
+				cycles -= 1;
+			} break;
+			
+			// ALU
+			case CPU::INS_ADC_IMM:
+			{
+				cpu.Add<Nmos6502>(cycles, cpu.NextByte(memory));
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_ADC_ZP:
+			{
+				cpu.Add<Nmos6502>(cycles, memory.ReadByte(cpu.NextByte(memory)));
+				cycles -= 2;
+			} break;
+			
+			case CPU::INS_SBC_IMM:
+			{
+				cpu.Subtract<Nmos6502>(cycles, cpu.NextByte(memory));
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_SBC_ZP:
+			{
+				cpu.Subtract<Nmos6502>(cycles, memory.ReadByte(cpu.NextByte(memory)));
+				cycles -= 2;
+			} break;
+			
+			case CPU::INS_AND_IMM:
+			{
+				cpu.A &= cpu.NextByte(memory);
+				cpu.NZ = cpu.A;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_ORA_IMM:
+			{
+				cpu.A |= cpu.NextByte(memory);
+				cpu.NZ = cpu.A;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_EOR_IMM:
+			{
+				cpu.A ^= cpu.NextByte(memory);
+				cpu.NZ = cpu.A;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_CMP_IMM:
+			{
+				cpu.Compare(cpu.A, cpu.NextByte(memory));
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_CMP_ZP:
+			{
+				cpu.Compare(cpu.A, memory.ReadByte(cpu.NextByte(memory)));
+				cycles -= 2;
+			} break;
+			
+			case CPU::INS_CPX_IMM:
+			{
+				cpu.Compare(cpu.X, cpu.NextByte(memory));
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_BIT_ZP:
+			{
+				Byte m = memory.ReadByte(cpu.NextByte(memory));
+				
+				cpu.V = m >> 6;
+				cpu.NZ = (cpu.A & m) | ((m & 0x80) << 8);
+				cycles -= 2;
+			} break;
+			
+			// Shifts and read-modify-write
+			case CPU::INS_ASL_ACC:
+			{
+				cpu.C = cpu.A >> 7;
+				cpu.A <<= 1;
+				cpu.NZ = cpu.A;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_LSR_ACC:
+			{
+				cpu.C = cpu.A;
+				cpu.A >>= 1;
+				cpu.NZ = cpu.A;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_ROL_ACC:
+			{
+				Byte carry = cpu.C;
+				
+				cpu.C = cpu.A >> 7;
+				cpu.A = (cpu.A << 1) | carry;
+				cpu.NZ = cpu.A;
+				cycles -= 1;
+			} break;
+			
+			case CPU::INS_INC_ZP:
+			{
+				Byte address = cpu.NextByte(memory);
+				Byte val = memory.ReadByte(address) + 1;
+				
+				memory.WriteByte(address, val);
+				cpu.NZ = val;
+				cycles -= 4;
+			} break;
+			
+			// Branches
+			case CPU::INS_BNE:	{ cpu.Branch(cycles, cpu.NextByte(memory), !cpu.GetZ());	cycles -= 1; } break;
+			case CPU::INS_BEQ:	{ cpu.Branch(cycles, cpu.NextByte(memory), cpu.GetZ());		cycles -= 1; } break;
+			case CPU::INS_BCC:	{ cpu.Branch(cycles, cpu.NextByte(memory), !cpu.C);			cycles -= 1; } break;
+			case CPU::INS_BCS:	{ cpu.Branch(cycles, cpu.NextByte(memory), cpu.C);			cycles -= 1; } break;
+			case CPU::INS_BMI:	{ cpu.Branch(cycles, cpu.NextByte(memory), cpu.GetN());		cycles -= 1; } break;
+			case CPU::INS_BPL:	{ cpu.Branch(cycles, cpu.NextByte(memory), !cpu.GetN());	cycles -= 1; } break;
+			
+			// Stack and jumps
+			case CPU::INS_PHA:
+			{
+				cpu.Push(memory, cpu.A);
+				cycles -= 2;
+			} break;
+			
+			case CPU::INS_PLA:
+			{
+				cpu.A = cpu.Pull(memory);
+				cpu.NZ = cpu.A;
+				cycles -= 3;
+			} break;
+			
+			case CPU::INS_PHP:
+			{
+				cpu.Push(memory, cpu.GetStatus() | 0x10);
+				cycles -= 2;
+			} break;
+			
+			case CPU::INS_PLP:
+			{
+				cpu.SetStatus(cpu.Pull(memory));
+				cycles -= 3;
+			} break;
+			
+			case CPU::INS_JSR:
+			{
+				Word address = cpu.NextWord(memory);
+				
+				cpu.Push(memory, (cpu.PC - 1) >> 8);
+				cpu.Push(memory, (cpu.PC - 1) & 0xFF);
+				cpu.PC = address;
+				cycles -= 5;
+			} break;
+			
+			case CPU::INS_RTS:
+			{
+				Word address = cpu.Pull(memory);
+				
+				address |= cpu.Pull(memory) << 8;
+				cpu.PC = address + 1;
+				cycles -= 5;
+			} break;
+			
+			case CPU::INS_JMP_ABS:
+			{
+				cpu.PC = cpu.NextWord(memory);
+				cycles -= 2;
+			} break;
+			
+			// Flags
+			case CPU::INS_CLC:	{ cpu.C = 0; cycles -= 1; } break;
+			case CPU::INS_SEC:	{ cpu.C = 1; cycles -= 1; } break;
+			case CPU::INS_CLD:	{ cpu.D = 0; cycles -= 1; } break;
+			case CPU::INS_SED:	{ cpu.D = 1; cycles -= 1; } break;
+			
+			default:
+			{
+				cpu.Dispatch(instruction, cycles, memory);
+				continue;
+			} break;
+		}
+		
+		cpu.Instructions++;
+	}
+	
+	return requested - cycles;
+}
+
+
+static int BenchIsa(uint32 runs, sint32 cycles)
+{
+	Workload workloads[] =
+	{
+		{ "loads",		LoadBenchProgram },
+		{ "immediate",	LoadImmediateWorkload },
+		{ "zeropage",	LoadZeroPageWorkload },
+		{ "calls",		LoadCallWorkload },
+		{ "flags",		LoadFlagsWorkload },
+		{ "copy",		LoadCopyWorkload },
+		{ "arithmetic",	LoadArithmeticWorkload },
+		{ "branches",	LoadBranchWorkload },
+	};
+	
+	MEM* mems = new MEM[2];
+	CPU cpus[2];
+	bool ok = CheckIsa() == 0;
+	
+	uint32 opcodes = 0;
+	
+	for (uint32 i = 0; i < 256; i++)
+	{
+		opcodes += OP_INFO.Ops[i].Name != nullptr;
+	}
+	
+	printf("isa opcodes=%u\n", opcodes);
+	
+	for (const Workload& workload : workloads)
+	{
+		double best[2] = { 0, 0 };
+		
+		for (uint32 run = 0; run < runs; run++)
+		{
+			// Alternate, so neither side always gets the warmer machine
+			for (uint32 side = 0; side < 2; side++)
+			{
+				cpus[side].Reset(mems[side]);
+				
+				workload.Load(mems[side]);
+				
+				RamBus ram = { &mems[side] };
+				
+				auto start = std::chrono::steady_clock::now();
+				
+				sint32 used = side == 0 ? cpus[side].Exec(cycles, mems[side]) : ExecHandWritten(cpus[side], cycles, ram);
+				
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				
+				double mhz = used / seconds / 1e6;
+				
+				if (mhz > best[side])
+				{
+					best[side] = mhz;
+				}
+			}
+		}
+		
+		bool same = SameMachine(cpus[0], mems[0], cpus[1], mems[1]);
+		
+		printf("isa workload=%s dispatch=%s table_mhz=%.1f hand_mhz=%.1f ratio=%.3f match=%s\n",
+			workload.Name, DISPATCH_NAME, best[0], best[1], best[0] / best[1], same ? "yes" : "no");
+		
+		ok = ok && same;
+	}
+	
+	delete[] mems;
+	
+	return ok ? 0 : 1;
+}
+
+
+// NOTE: Variant benchmark
+// A probe program that comes out differently on each chip (decimal ADC, the
+// JMP ($xxFF) bug), then the loads and a decimal arithmetic loop through
+// Exec and through ExecVariant for each chip. Exec and ExecVariant<Nmos6502>
+// have to end up in the same state.
+static void LoadVariantProbe(MEM& mem)
+{
+	static const Byte CODE[] =
+	{
+		0xF8,				// $0200	SED
+		0x18,				//			CLC
+		0xA9, 0x09,			//			LDA #$09
+		0x69, 0x01,			//			ADC #$01
+		0x85, 0x20,			//			STA $20
+		0xD8,				//			CLD
+		0x6C, 0xFF, 0x10,	//			JMP ($10FF)
+	};
+	
+	static const Byte LANDING[] =
+	{
+		0xA9, 0x00,			// $0300 / $0400	LDA #$03 / #$04
+		0x85, 0x21,			//					STA $21
+		0x4C, 0x00, 0x05,	//					JMP $0500
+	};
+	
+	for (uint32 i = 0; i < sizeof(CODE); i++)
+	{
+		mem[0x0200 + i] = CODE[i];
+	}
+	
+	for (uint32 page = 3; page <= 4; page++)
+	{
+		for (uint32 i = 0; i < sizeof(LANDING); i++)
+		{
+			mem[page * 256 + i] = LANDING[i];
+		}
+		
+		mem[page * 256 + 1] = page;
+	}
+	
+	// $0500 JMP $0500
+	mem[0x0500] = CPU::INS_JMP_ABS;
+	mem[0x0501] = 0x00;
+	mem[0x0502] = 0x05;
+	
+	mem[0x10FF] = 0x00;
+	mem[0x1000] = 0x03;		// where the NMOS bug reads the high byte
+	mem[0x1100] = 0x04;
+}
+
+
+// SED, then ADC and SBC on A forever
+static void LoadDecimalWorkload(MEM& mem)
+{
+	static const Byte CODE[] =
+	{
+		0xF8,				// $0000	SED
+		0x18,				// $0001	CLC
+		0x69, 0x45,			//			ADC #$45
+		0xE9, 0x38,			//			SBC #$38
+		0x4C, 0x01, 0x00,	//			JMP $0001
+	};
+	
+	for (uint32 i = 0; i < sizeof(CODE); i++)
+	{
+		mem[i] = CODE[i];
+	}
+	
+	mem[0xFFFC] = CPU::INS_JMP_ABS;
+	mem[0xFFFD] = 0x00;
+	mem[0xFFFE] = 0x00;
+}
+
+
+template <typename Chip>
+static void ProbeVariant()
+{
+	MEM* mem = new MEM;
+	CPU cpu;
+	
+	cpu.Reset(*mem);
+	
+	LoadVariantProbe(*mem);
+	
+	cpu.PC = 0x0200;
+	cpu.ExecVariant<Chip>(100, *mem);
+	
+	printf("variants probe chip=%s decimal_09_plus_01=%02X jmp_10FF=%02X00\n", Chip::NAME, mem->Peek(0x20), mem->Peek(0x21));
+	
+	delete mem;
+}
+
+
+template <typename Chip>
+static double TimeVariant(const Workload& workload, sint32 cycles, uint32 runs, CPU& cpu, MEM& mem)
+{
+	double best = 0;
+	
+	for (uint32 run = 0; run < runs; run++)
+	{
+		cpu.Reset(mem);
+		
+		workload.Load(mem);
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		sint32 used = cpu.ExecVariant<Chip>(cycles, mem);
+		
+		double mhz = used / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+		
+		if (mhz > best)
+		{
+			best = mhz;
+		}
+	}
+	
+	return best;
+}
+
+
+static int BenchVariants(uint32 runs, sint32 cycles)
+{
+	ProbeVariant<Nmos6502>();
+	ProbeVariant<Cmos65C02>();
+	ProbeVariant<Ricoh2A03>();
+	
+	Workload workloads[] =
+	{
+		{ "loads",		LoadBenchProgram },
+		{ "decimal",	LoadDecimalWorkload },
+	};
+	
+	MEM* mems = new MEM[2];
+	CPU cpus[2];
+	bool ok = true;
+	
+	for (const Workload& workload : workloads)
+	{
+		double exec = 0;
+		
+		for (uint32 run = 0; run < runs; run++)
+		{
+			cpus[0].Reset(mems[0]);
+			
+			workload.Load(mems[0]);
+			
+			auto start = std::chrono::steady_clock::now();
+			
+			sint32 used = cpus[0].Exec(cycles, mems[0]);
+			
+			double mhz = used / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+			
+			if (mhz > exec)
+			{
+				exec = mhz;
+			}
+		}
+		
+		double nmos = TimeVariant<Nmos6502>(workload, cycles, runs, cpus[1], mems[1]);
+		
+		bool same = SameMachine(cpus[0], mems[0], cpus[1], mems[1]);
+		
+		double cmos = TimeVariant<Cmos65C02>(workload, cycles, runs, cpus[1], mems[1]);
+		double nes = TimeVariant<Ricoh2A03>(workload, cycles, runs, cpus[1], mems[1]);
+		
+		printf("variants workload=%s exec_mhz=%.1f %s_mhz=%.1f %s_mhz=%.1f %s_mhz=%.1f match=%s\n",
+			workload.Name, exec, Nmos6502::NAME, nmos, Cmos65C02::NAME, cmos, Ricoh2A03::NAME, nes, same ? "yes" : "no");
+		
+		ok = ok && same;
+	}
+	
+	delete[] mems;
+	
+	return ok ? 0 : 1;
+}
+
+
+// NOTE: Bus benchmark
+// The workloads through Exec on MEM (the paged bus everything else uses),
+// then through ExecVariant<Nmos6502> on MEM, on a FlatBus and on a
+// TracingBus around a FlatBus. The flat run has to end up in the same
+// state as Exec.
+template <typename Bus>
+static double TimeBus(sint32 cycles, uint32 runs, CPU& cpu, Bus& bus, const MEM& image)
+{
+	double best = 0;
+	
+	for (uint32 run = 0; run < runs; run++)
+	{
+		cpu.Reset(bus);
+		
+		for (uint32 i = 0; i < MEM::MAX_MEM; i++)
+		{
+			bus.WriteByte(i, image.Peek(i));
+		}
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		sint32 used = cpu.ExecVariant<Nmos6502>(cycles, bus);
+		
+		double mhz = used / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+		
+		if (mhz > best)
+		{
+			best = mhz;
+		}
+	}
+	
+	return best;
+}
+
+
+static int BenchBus(uint32 runs, sint32 cycles)
+{
+	Workload workloads[] =
+	{
+		{ "loads",		LoadBenchProgram },
+		{ "immediate",	LoadImmediateWorkload },
+		{ "zeropage",	LoadZeroPageWorkload },
+		{ "calls",		LoadCallWorkload },
+	};
+	
+	MEM* image = new MEM;
+	MEM* mem = new MEM;
+	FlatBus* flat = new FlatBus;
+	TracingBus<FlatBus>* tracing = new TracingBus<FlatBus>;
+	CPU cpu, reference;
+	bool ok = true;
+	
+	tracing->Init(flat);
+	
+	for (const Workload& workload : workloads)
+	{
+		image->Clear();
+		
+		workload.Load(*image);
+		
+		double exec = 0;
+		
+		for (uint32 run = 0; run < runs; run++)
+		{
+			reference.Reset(*mem);
+			
+			workload.Load(*mem);
+			
+			auto start = std::chrono::steady_clock::now();
+			
+			sint32 used = reference.Exec(cycles, *mem);
+			
+			double mhz = used / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / 1e6;
+			
+			if (mhz > exec)
+			{
+				exec = mhz;
+			}
+		}
+		
+		double paged = TimeBus(cycles, runs, cpu, *mem, *image);
+		double flatMhz = TimeBus(cycles, runs, cpu, *flat, *image);
+		
+		bool same = cpu.PC == reference.PC && cpu.SP == reference.SP && cpu.A == reference.A &&
+			cpu.GetStatus() == reference.GetStatus() && cpu.Instructions == reference.Instructions &&
+			memcmp(flat->Data, mem->Data, MEM::MAX_MEM) == 0;
+		
+		double traced = TimeBus(cycles, runs, cpu, *tracing, *image);
+		
+		printf("bus workload=%s exec_mhz=%.1f mem_mhz=%.1f flat_mhz=%.1f tracing_mhz=%.1f match=%s\n",
+			workload.Name, exec, paged, flatMhz, traced, same ? "yes" : "no");
+		
+		ok = ok && same;
+	}
+	
+	delete tracing;
+	delete flat;
+	delete mem;
+	delete image;
+	
+	return ok ? 0 : 1;
+}
+
+
+// NOTE: Fleet runner
+// Every instance runs the bench program with its own X, so the ZPX loads
+// differ between instances.
+static void LoadFleetInstance(uint32 index, CPU& cpu, MEM& memory)
+{
+	LoadBenchProgram(memory);
+	
+	cpu.X = index & 0xFF;
+}
+
+
+static int RunFleet(uint32 count, sint32 budget, sint32 slice, uint32 threads)
+{
+	Fleet* fleet = new Fleet;
+	
+	fleet->Init(count, threads, slice, budget, LoadFleetInstance);
+	
+	auto start = std::chrono::steady_clock::now();
+	
+	fleet->Run();
+	
+	auto stop = std::chrono::steady_clock::now();
+	
+	double seconds = std::chrono::duration<double>(stop - start).count();
+	
+	uint64 instructions = fleet->Instructions();
+	uint64 slices = 0, steals = 0;
+	
+	for (uint32 i = 0; i < fleet->Threads; i++)
+	{
+		slices += fleet->Workers[i].Slices;
+		steals += fleet->Workers[i].Steals;
+	}
+	
+	printf("fleet instances=%u threads=%u slice=%d instructions=%llu seconds=%.3f ips=%.0f bytes_per_instance=%u total_mb=%.1f slices=%llu steals=%llu\n",
+		count, fleet->Threads, slice, instructions, seconds, instructions / seconds, Fleet::BYTES_PER_INSTANCE,
+		(double)count * Fleet::BYTES_PER_INSTANCE / (1024 * 1024), slices, steals);
+	
+	fleet->Free();
+	delete fleet;
+	
+	return 0;
+}
+
+
+// NOTE: Reset benchmark
+// Resets per second through CPU::Reset (dirty pages only) against the bulk
+// MEM::Init, with the demo program loaded and run between resets so the
+// usual handful of pages (stack, code, reset vector) is dirty each time.
+static void LoadDemoProgram(MEM& mem)
+{
+	// CHEATING
+	mem[0xFFFC] = CPU::INS_JSR; // reset vector
+	
+	mem[0xFFFD] = 0x42;
+	mem[0xFFFE] = 0x42;
+	
+	mem[0x4242] = CPU::INS_LDA_IMM;
+	mem[0x4243] = 0x84;
+}
+
+
+static int BenchResets(uint32 count)
+{
+	MEM* mem = new MEM;
+	CPU cpu;
+	
+	for (uint32 pass = 0; pass < 2; pass++)
+	{
+		bool bulk = pass == 1;
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			if (bulk)
+			{
+				mem->Init();
+			}
+			
+			cpu.Reset(*mem);
+			
+			LoadDemoProgram(*mem);
+			
+			cpu.Exec(8, *mem);
+		}
+		
+		auto stop = std::chrono::steady_clock::now();
+		
+		double seconds = std::chrono::duration<double>(stop - start).count();
+		
+		printf("resets path=%s count=%u seconds=%.3f resets_per_sec=%.0f\n",
+			bulk ? "bulk" : "dirty", count, seconds, count / seconds);
+	}
+	
+	delete mem;
+	
+	return 0;
+}
+
+// NOTE: Device benchmark
+// The bench program with `count` periodic devices (think timers, a raster
+// counter, a UART baud clock) that each need attention every few hundred
+// cycles. "scheduled" runs through ExecScheduled, "polled" is what it looks
+// like without a scheduler: one instruction at a time, then ask every
+// device whether it is due.
+struct Ticker
+{
+	uint64 Period;
+	uint64 Due;		// for the polled run
+	uint64 Ticks;
+};
+
+
+static void FireTicker(void* context, Scheduler& scheduler)
+{
+	Ticker* ticker = (Ticker*)context;
+	
+	ticker->Ticks++;
+	
+	scheduler.Post(scheduler.Now + ticker->Period, FireTicker, ticker);
+}
+
+
+static int BenchDevices(uint32 count, sint32 cycles)
+{
+	MEM* mem = new MEM;
+	Scheduler* scheduler = new Scheduler;
+	Ticker* tickers = new Ticker[count];
+	CPU cpu;
+	
+	for (uint32 pass = 0; pass < 2; pass++)
+	{
+		bool polled = pass == 1;
+		
+		cpu.Reset(*mem);
+		
+		LoadBenchProgram(*mem);
+		
+		scheduler->Init();
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			tickers[i].Period	= 100 + 37 * i;
+			tickers[i].Due		= tickers[i].Period;
+			tickers[i].Ticks	= 0;
+			
+			scheduler->Post(tickers[i].Period, FireTicker, &tickers[i]);
+		}
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		sint32 used = 0;
+		
+		if (polled)
+		{
+			while (used < cycles)
+			{
+				used += cpu.Exec(1, *mem);
+				
+				for (uint32 i = 0; i < count; i++)
+				{
+					if ((uint64)used >= tickers[i].Due)
+					{
+						tickers[i].Ticks++;
+						tickers[i].Due += tickers[i].Period;
+					}
+				}
+			}
+		}
+		else
+		{
+			used = cpu.ExecScheduled(cycles, *mem, *scheduler);
+		}
+		
+		auto stop = std::chrono::steady_clock::now();
+		
+		double seconds = std::chrono::duration<double>(stop - start).count();
+		
+		uint64 ticks = 0;
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			ticks += tickers[i].Ticks;
+		}
+		
+		printf("devices mode=%s count=%u cycles=%d seconds=%.3f mhz=%.1f ticks=%llu\n",
+			polled ? "polled" : "scheduled", count, used, seconds, used / seconds / 1e6, ticks);
+	}
+	
+	delete[] tickers;
+	delete scheduler;
+	delete mem;
+	
+	return 0;
+}
+
+
+
+// NOTE: Lockstep benchmark
+// The same lanes through Batch and then one at a time through Exec, and a
+// check that they end up in the same place: registers, flags, cycles and
+// memory. "loads" is the bench program; "mixed" runs a loop over 256 bytes
+// of per-lane data with stores, transfers, logic, arithmetic, a compare and
+// a branch that goes a different way in different lanes.
+static void LoadLockstepLane(uint32 lane, CPU& cpu, MEM& memory)
+{
+	LoadBenchProgram(memory);
+	
+	cpu.X = lane * 7;
+}
+
+
+static void LoadLockstepMixedLane(uint32 lane, CPU& cpu, MEM& memory)
+{
+	static const Byte CODE[] =
+	{
+		0xA2, 0x00,			// $0200	LDX #$00
+		0xBD, 0x00, 0x10,	// $0202	LDA $1000,X
+		0x49, 0x5A,			//			EOR #$5A
+		0x18,				//			CLC
+		0x65, 0x10,			//			ADC $10
+		0x85, 0x10,			//			STA $10
+		0xBD, 0x00, 0x10,	//			LDA $1000,X
+		0xC9, 0x80,			//			CMP #$80
+		0x90, 0x05,			//			BCC $0218
+		0xA4, 0x11,			//			LDY $11
+		0xC8,				//			INY
+		0x84, 0x11,			//			STY $11
+		0x8A,				// $0218	TXA
+		0x29, 0x0F,			//			AND #$0F
+		0xA8,				//			TAY
+		0xB9, 0x00, 0x20,	//			LDA $2000,Y
+		0x38,				//			SEC
+		0xE5, 0x10,			//			SBC $10
+		0x99, 0x00, 0x20,	//			STA $2000,Y
+		0xE8,				//			INX
+		0xD0, 0xDA,			//			BNE $0202
+		0xE6, 0x12,			//			INC $12
+		0x4C, 0x00, 0x02,	//			JMP $0200
+	};
+	
+	for (uint32 i = 0; i < sizeof(CODE); i++)
+	{
+		memory[0x0200 + i] = CODE[i];
+	}
+	
+	uint32 seed = lane + 1;
+	
+	for (uint32 i = 0; i < 0x100; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		
+		memory[0x1000 + i] = seed >> 24;
+	}
+	
+	cpu.PC = 0x0200;
+}
+
+
+static int RunLockstep(uint32 lanes, sint32 budget, bool allowAvx2)
+{
+	static const struct { const char* Name; Batch::Loader Load; } PROGRAMS[] =
+	{
+		{ "loads",	LoadLockstepLane },
+		{ "mixed",	LoadLockstepMixedLane },
+	};
+	
+	uint32 failed = 0;
+	
+	for (const auto& program : PROGRAMS)
+	{
+		Batch* batch = new Batch;
+		
+		batch->Init(lanes, program.Load, allowAvx2);
+		
+		auto start = std::chrono::steady_clock::now();
+		
+		batch->Run(budget);
+		
+		auto stop = std::chrono::steady_clock::now();
+		
+		double batchSeconds = std::chrono::duration<double>(stop - start).count();
+		
+		// The same instances, one at a time
+		MEM* mem = new MEM;
+		CPU cpu;
+		
+		uint64 instructions = 0;
+		uint32 mismatches = 0;
+		double execSeconds = 0;
+		
+		for (uint32 l = 0; l < batch->Lanes; l++)
+		{
+			cpu.Reset(*mem);
+			
+			program.Load(l, cpu, *mem);
+			
+			start = std::chrono::steady_clock::now();
+			
+			sint32 used = cpu.Exec(budget, *mem);
+			
+			stop = std::chrono::steady_clock::now();
+			
+			execSeconds += std::chrono::duration<double>(stop - start).count();
+			instructions += cpu.Instructions;
+			
+			if (cpu.PC != batch->PC[l] || cpu.A != batch->A[l] || cpu.X != batch->X[l] || cpu.Y != batch->Y[l]
+				|| cpu.SP != batch->SP[l] || cpu.NZ != batch->NZ[l] || cpu.Flags != batch->Other[l]
+				|| budget - used != batch->Cycles[l]
+				|| memcmp(mem->Data, batch->Mems[l].Data, MEM::MAX_MEM) != 0)
+			{
+				mismatches++;
+			}
+		}
+		
+		printf("lockstep program=%s lanes=%u avx2=%d instructions=%llu batch_ips=%.0f exec_ips=%.0f speedup=%.2f vector_steps=%llu/%llu mismatches=%u\n",
+			program.Name, batch->Lanes, batch->Avx2, batch->Instructions, batch->Instructions / batchSeconds,
+			instructions / execSeconds, execSeconds / batchSeconds, batch->VectorSteps, batch->Steps, mismatches);
+		
+		failed += mismatches;
+		
+		delete mem;
+		batch->Free();
+		delete batch;
+	}
+	
+	return failed ? 1 : 0;
+}
+
+
+// NOTE: Ahead-of-time translation
+// Walks the code reachable from the reset PC in a ROM image and writes a C++
+// program to stdout with one function per basic block. The output includes
+// pal6502.h (and has its own main) and calls the same CPU::Execute the
+// interpreter's handlers do, so the compiler can inline the whole block.
+// Every block is built twice, for MEM and for a RamBus over it, and the
+// RamBus one runs while RamBus::Usable says it can. A PC with no block behind it (an opcode the ISA does not
+// know, or anything the walk could not see) goes to the interpreter, and so
+// does a block whose page was written since the ROM was loaded.
+static constexpr uint32 AOT_MAX_OPS = 64;	// instructions per block
+
+static int Aot(const char* path, uint32 load)
+{
+	static Byte image[MEM::MAX_MEM];
+	
+	if (load >= MEM::MAX_MEM)
+	{
+		fprintf(stderr, "load address %X is past the end of memory\n", load);
+		return 1;
+	}
+	
+	FILE* file = fopen(path, "rb");
+	
+	if (!file)
+	{
+		fprintf(stderr, "can not open %s\n", path);
+		return 1;
+	}
+	
+	uint32 size = fread(image, 1, MEM::MAX_MEM - load, file);
+	
+	fclose(file);
+	
+	// The bytes as the CPU will see them
+	static Byte rom[MEM::MAX_MEM];
+	static bool inRom[MEM::MAX_MEM];
+	
+	for (uint32 i = 0; i < size; i++)
+	{
+		rom[load + i] = image[i];
+		inRom[load + i] = true;
+	}
+	
+	// Find the blocks, starting from where CPU::Reset points the PC
+	static bool isLeader[MEM::MAX_MEM];
+	static Word leaders[MEM::MAX_MEM];
+	uint32 leaderCount = 0;
+	
+	static Word work[MEM::MAX_MEM];
+	uint32 workCount = 0;
+	
+	CPU reset;
+	MEM scratch;
+	reset.Reset(scratch);
+	
+	work[workCount++] = reset.PC;
+	
+	while (workCount > 0)
+	{
+		Word pc = work[--workCount];
+		
+		if (isLeader[pc] || !inRom[pc] || !OpInfoFor(rom[pc]).Name)
+		{
+			continue;
+		}
+		
+		isLeader[pc] = true;
+		leaders[leaderCount++] = pc;
+		
+		for (uint32 n = 0; ; n++)
+		{
+			OpInfo info = OpInfoFor(rom[pc]);
+			
+			if (!info.Name || !inRom[pc] || (n > 0 && isLeader[pc]))
+			{
+				break;
+			}
+			
+			if (n == AOT_MAX_OPS)
+			{
+				work[workCount++] = pc;
+				break;
+			}
+			
+			Word operand = rom[(Word)(pc + 1)] | (rom[(Word)(pc + 2)] << 8);
+			
+			pc += info.Bytes;
+			
+			if (info.Flags & OPF_JUMP)
+			{
+				if (info.Instruction == MN_JSR)
+				{
+					work[workCount++] = operand;	// the subroutine
+					work[workCount++] = pc;			// where it returns to
+				}
+				else if (info.Instruction == MN_JMP && info.Mode == AM_ABS)
+				{
+					work[workCount++] = operand;
+				}
+				else if (info.Mode == AM_REL)
+				{
+					work[workCount++] = pc + (signed char)operand;	// taken
+					work[workCount++] = pc;							// not taken
+				}
+				
+				// JMP (ind), RTS, RTI and BRK go where the data says, the
+				// interpreter picks those up
+				break;
+			}
+		}
+	}
+	
+	// Emit
+	printf("// Generated by `cpuemu aot %s %04X`, do not edit.\n", path, load);
+	printf("#define PAL6502_IMPLEMENTATION\n");
+	printf("#include \"pal6502.h\"\n\n");
+	
+	printf("static const Word ROM_LOAD = 0x%04X;\n", load);
+	printf("static const Byte ROM[%u] =\n{", size);
+	
+	for (uint32 i = 0; i < size; i++)
+	{
+		printf("%s0x%02X,", (i % 16) ? " " : "\n\t", image[i]);
+	}
+	
+	printf("\n};\n\n");
+	
+	// Page write counters right after the ROM went in, see AotValid
+	printf("static uint32 AOT_PAGES[MEM::PAGES];\n\n");
+	printf("static bool AotValid(const MEM& memory, Byte first, Byte last)\n{\n");
+	printf("\treturn memory.PageWrites[first] == AOT_PAGES[first] && memory.PageWrites[last] == AOT_PAGES[last];\n}\n\n");
+	
+	static sint32 blockCycles[MEM::MAX_MEM];
+	static sint32 blockExtra[MEM::MAX_MEM];		// see CPU::BranchOrPageExtra
+	static Word blockLast[MEM::MAX_MEM];
+	
+	for (uint32 b = 0; b < leaderCount; b++)
+	{
+		Word pc = leaders[b];
+		Word start = pc;
+		
+		// Returns the cycles on top of the table ones (page crossings,
+		// branches taken), as a negative number. On MEM or on a RamBus
+		// over it, see AotRun.
+		printf("template <typename Bus>\n");
+		printf("static sint32 Block_%04X(CPU& cpu, Bus& memory)\n{\n", start);
+		printf("\tsint32 scratch = 0;\n\n");
+		
+		sint32 cycles = 0;
+		sint32 extra = 0;
+		uint32 count = 0;
+		Word last = pc;
+		
+		for (uint32 n = 0; n < AOT_MAX_OPS; n++)
+		{
+			OpInfo info = OpInfoFor(rom[pc]);
+			
+			if (!info.Name || !inRom[pc] || (n > 0 && isLeader[pc]))
+			{
+				break;
+			}
+			
+			Word operand = 0;
+			
+			if (info.Bytes >= 2) operand = rom[(Word)(pc + 1)];
+			if (info.Bytes >= 3) operand |= rom[(Word)(pc + 2)] << 8;
+			
+			Word next = pc + info.Bytes;
+			
+			printf("\t// $%04X %s $%0*X\n", pc, info.Name, info.Bytes == 3 ? 4 : 2, operand);
+			
+			// Only jumps look at PC, everything else gets it at the end
+			if (info.Flags & OPF_JUMP)
+			{
+				printf("\tcpu.PC = 0x%04X;\n", next);
+			}
+			
+			printf("\tcpu.Execute<Nmos6502, 0x%02X>(scratch, memory, 0x%04X);\t// Do_%s\n", rom[pc], operand, info.Name);
+			
+			cycles += info.Cycles;
+			extra += CPU::BranchOrPageExtra(info.Mode, info.Flags);
+			count++;
+			last = next - 1;
+			pc = next;
+			
+			if (info.Flags & OPF_JUMP)
+			{
+				break;
+			}
+			
+			if (n + 1 == AOT_MAX_OPS || !OpInfoFor(rom[pc]).Name || !inRom[pc] || isLeader[pc])
+			{
+				printf("\tcpu.PC = 0x%04X;\n", pc);
+			}
+		}
+		
+		printf("\tcpu.Instructions += %u;\n\n", count);
+		printf("\treturn scratch;\n");
+		printf("}\n\n");
+		
+		blockCycles[start] = cycles;
+		blockExtra[start] = extra;
+		blockLast[start] = last;
+	}
+	
+	// A block is only entered with room for all of its extras, so like Exec
+	// no instruction starts once the budget is spent
+	printf("// Same contract as CPU::Exec\n");
+	printf("static sint32 AotRun(CPU& cpu, MEM& memory, sint32 cycles)\n{\n");
+	printf("\tconst sint32 requested = cycles;\n\n");
+	printf("\t// Straight to RAM when nothing needs the page table, so the compiler\n");
+	printf("\t// can see through the loads\n");
+	printf("\tRamBus ram = { &memory };\n");
+	printf("\tconst bool direct = RamBus::Usable(memory);\n\n");
+	printf("\twhile (cycles > 0)\n\t{\n");
+	printf("\t\tswitch (cpu.PC)\n\t\t{\n");
+	
+	for (uint32 b = 0; b < leaderCount; b++)
+	{
+		Word start = leaders[b];
+		
+		printf("\t\t\tcase 0x%04X: if (cycles >= %d && AotValid(memory, 0x%02X, 0x%02X)) { cycles -= %d; cycles += direct ? Block_%04X(cpu, ram) : Block_%04X(cpu, memory); continue; } break;\n",
+			start, blockCycles[start] + blockExtra[start], start >> 8, blockLast[start] >> 8, blockCycles[start], start, start);
+	}
+	
+	printf("\t\t}\n\n");
+	printf("\t\tcpu.Dispatch(cpu.FetchByte(cycles, memory), cycles, memory);\n");
+	printf("\t}\n\n");
+	printf("\treturn requested - cycles;\n}\n\n");
+	
+	printf("int main(int argc, char** argv)\n{\n");
+	printf("\tsint32 cycles = argc > 1 ? atoi(argv[1]) : 500000000;\n");
+	printf("\tbool interp = argc > 2 && strcmp(argv[2], \"exec\") == 0;\n\n");
+	printf("\tstatic MEM mem;\n\tCPU cpu;\n\n");
+	printf("\tcpu.Reset(mem);\n\n");
+	printf("\tfor (uint32 i = 0; i < sizeof(ROM); i++)\n\t{\n\t\tmem[ROM_LOAD + i] = ROM[i];\n\t}\n\n");
+	printf("\tmemcpy(AOT_PAGES, mem.PageWrites, sizeof(AOT_PAGES));\n\n");
+	printf("\tauto start = std::chrono::steady_clock::now();\n\n");
+	printf("\tsint32 used = interp ? cpu.Exec(cycles, mem) : AotRun(cpu, mem, cycles);\n\n");
+	printf("\tauto stop = std::chrono::steady_clock::now();\n\n");
+	printf("\tdouble seconds = std::chrono::duration<double>(stop - start).count();\n\n");
+	printf("\tprintf(\"dispatch=%%s cycles=%%d seconds=%%.3f mhz=%%.1f pc=%%04X a=%%02X\\n\",\n");
+	printf("\t\tinterp ? DISPATCH_NAME : \"aot\", used, seconds, used / seconds / 1e6, cpu.PC, cpu.A);\n\n");
+	printf("\treturn 0;\n}\n");
+	
+	fprintf(stderr, "aot: %u blocks from %u bytes\n", leaderCount, size);
+	
+	return 0;
+}
+
+
+// Writes the bench program out as a 64 KiB ROM image (load address 0)
+static int WriteBenchRom(const char* path)
+{
+	static MEM mem;
+	
+	mem.Init();
+	
+	LoadBenchProgram(mem);
+	
+	FILE* file = fopen(path, "wb");
+	
+	if (!file || fwrite(mem.Data, 1, MEM::MAX_MEM, file) != MEM::MAX_MEM)
+	{
+		fprintf(stderr, "can not write %s\n", path);
+		
+		if (file)
+		{
+			fclose(file);
+		}
+		
+		return 1;
+	}
+	
+	fclose(file);
+	
+	return 0;
+}
+
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+	{
+		sint32 cycles = argc > 2 ? atoi(argv[2]) : 500000000;
+		const char* engine = argc > 3 ? argv[3] : "exec";
+		
+		return Bench(cycles, engine);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "suite") == 0)
+	{
+		uint32 runs		= argc > 2 ? atoi(argv[2]) : 5;
+		sint32 cycles	= argc > 3 ? atoi(argv[3]) : 100000000;
+		const char* rom	= argc > 4 ? argv[4] : nullptr;
+		
+		return BenchSuite(runs, cycles, rom);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "profile") == 0)
+	{
+		sint32 cycles	= argc > 2 ? atoi(argv[2]) : 10000000;
+		uint32 top		= argc > 3 ? atoi(argv[3]) : 20;
+		
+		return RunProfile(cycles, top);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "trace") == 0)
+	{
+		sint32 cycles		= argc > 2 ? atoi(argv[2]) : 10000000;
+		const char* path	= argc > 3 ? argv[3] : "trace.bin";
+		uint32 capacity		= argc > 4 ? atoi(argv[4]) : 65536;
+		
+		return RunTrace(cycles, path, capacity);
+	}
+	
+	if (argc > 2 && strcmp(argv[1], "showtrace") == 0)
+	{
+		return ShowTrace(argv[2], argc > 3 ? atoi(argv[3]) : 20);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "deltatrace") == 0)
+	{
+		const char* workload	= argc > 2 ? argv[2] : "loads";
+		sint32 cycles			= argc > 3 ? atoi(argv[3]) : 100000000;
+		const char* path		= argc > 4 ? argv[4] : "trace.p6dt";
+		uint32 interval			= argc > 5 ? atoi(argv[5]) : 1 << 20;
+		
+		return RunDeltaTrace(workload, cycles, path, interval);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "reverse") == 0)
+	{
+		sint32 cycles	= argc > 2 ? atoi(argv[2]) : 20000000;
+		uint32 back		= argc > 3 ? atoi(argv[3]) : 1000;
+		uint32 interval	= argc > 4 ? atoi(argv[4]) : 1 << 16;
+		
+		return RunReverse(cycles, back, interval);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "breakpoints") == 0)
+	{
+		return RunBreakpoints(argc > 2 ? atoi(argv[2]) : 100000000);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "conditions") == 0)
+	{
+		return RunConditions(argc > 2 ? atoi(argv[2]) : 100000000);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "isa") == 0)
+	{
+		uint32 runs		= argc > 2 ? atoi(argv[2]) : 5;
+		sint32 cycles	= argc > 3 ? atoi(argv[3]) : 100000000;
+		
+		return BenchIsa(runs, cycles);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "jit") == 0)
+	{
+		uint32 programs	= argc > 2 ? atoi(argv[2]) : 500;
+		sint32 cycles	= argc > 3 ? atoi(argv[3]) : 20000;
+		
+		return CheckJit(programs, cycles);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "bus") == 0)
+	{
+		uint32 runs		= argc > 2 ? atoi(argv[2]) : 5;
+		sint32 cycles	= argc > 3 ? atoi(argv[3]) : 100000000;
+		
+		return BenchBus(runs, cycles);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "variants") == 0)
+	{
+		uint32 runs		= argc > 2 ? atoi(argv[2]) : 5;
+		sint32 cycles	= argc > 3 ? atoi(argv[3]) : 100000000;
+		
+		return BenchVariants(runs, cycles);
+	}
+	
+	if (argc > 2 && strcmp(argv[1], "run") == 0)
+	{
+		sint32 cycles	= argc > 3 ? atoi(argv[3]) : 1000000;
+		uint32 load		= argc > 4 ? strtoul(argv[4], nullptr, 16) : 0;
+		const char* chip	= FindChip(argc > 5 ? argv[5] : Nmos6502::NAME);
+		
+		if (!chip)
+		{
+			fprintf(stderr, "unknown chip %s\n", argv[5]);
+			return 1;
+		}
+		
+		return RunImage(argv[2], cycles, load, chip);
+	}
+	
+	if (argc > 2 && strcmp(argv[1], "disasm") == 0)
+	{
+		sint32 address	= argc > 3 ? strtol(argv[3], nullptr, 16) : -1;
+		uint32 count	= argc > 4 ? atoi(argv[4]) : 32;
+		uint32 load		= argc > 5 ? strtoul(argv[5], nullptr, 16) : 0;
+		const char* chip	= FindChip(argc > 6 ? argv[6] : Nmos6502::NAME);
+		
+		if (!chip)
+		{
+			fprintf(stderr, "unknown chip %s\n", argv[6]);
+			return 1;
+		}
+		
+		return RunDisassemble(argv[2], address, count, load, chip);
+	}
+	
+	if (argc > 2 && strcmp(argv[1], "imagebench") == 0)
+	{
+		return BenchImage(argv[2], argc > 3 ? atoi(argv[3]) : 10000);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "fleet") == 0)
+	{
+		uint32 count	= argc > 2 ? atoi(argv[2]) : 1000;
+		sint32 budget	= argc > 3 ? atoi(argv[3]) : 1000000;
+		sint32 slice	= argc > 4 ? atoi(argv[4]) : 10000;
+		uint32 threads	= argc > 5 ? atoi(argv[5]) : std::thread::hardware_concurrency();
+		
+		return RunFleet(count, budget, slice, threads);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "resets") == 0)
+	{
+		return BenchResets(argc > 2 ? atoi(argv[2]) : 1000000);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "devices") == 0)
+	{
+		uint32 count	= argc > 2 ? atoi(argv[2]) : 8;
+		sint32 cycles	= argc > 3 ? atoi(argv[3]) : 100000000;
+		
+		return BenchDevices(count, cycles);
+	}
+	
+	if (argc > 1 && strcmp(argv[1], "lockstep") == 0)
+	{
+		uint32 lanes	= argc > 2 ? atoi(argv[2]) : 32;
+		sint32 budget	= argc > 3 ? atoi(argv[3]) : 10000000;
+		bool scalar		= argc > 4 && strcmp(argv[4], "scalar") == 0;
+		
+		return RunLockstep(lanes, budget, !scalar);
+	}
+	
+	if (argc > 2 && strcmp(argv[1], "aot") == 0)
+	{
+		return Aot(argv[2], argc > 3 ? strtoul(argv[3], nullptr, 16) : 0);
+	}
+	
+	if (argc > 2 && strcmp(argv[1], "rom") == 0)
+	{
+		return WriteBenchRom(argv[2]);
+	}
+	
+	MEM mem;
+	CPU cpu;
+	
+	cpu.Reset(mem);
+	
+	LoadDemoProgram(mem);
 	
 	cpu.Exec(8, mem);
 	
 	return 0;
-}
\ No newline at end of file
+}
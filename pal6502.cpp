@@ -0,0 +1,3 @@
+// The non-inline half of pal6502.h, for libpal6502.a (`make lib`)
+#define PAL6502_IMPLEMENTATION
+#include "pal6502.h"
@@ -0,0 +1,6871 @@
+/*
+ * pal6502: the 6502 core. CPU, MEM and the other buses, program images, the
+ * block cache and JIT, traces, snapshots, breakpoints, the fleet and
+ * lockstep runners, the disassembler.
+ *
+ * Header-only: everything Exec needs is in here and inline, with any
+ * DISPATCH, so the host can inline it (and its own bus, see FlatBus) into
+ * its code. The cold parts
+ * (trace writer, conditions, undo log, JIT code generation) are at the end
+ * under PAL6502_IMPLEMENTATION. Define that in exactly one .cpp before the
+ * include, or link libpal6502.a (`make lib`) instead. Either way, build with
+ * the same DISPATCH, JIT and PROFILE as the rest (they change the structs).
+ *
+ * Nothing in here prints while the CPU runs. The only output is from the
+ * calls that are there to report (PrintStats, Profile::Report), tracepoints
+ * and Trace::TrapPath, all of them asked for.
+ */
+
+#ifndef PAL6502_H
+#define PAL6502_H
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include <atomic>
+#include <chrono>
+#include <initializer_list>
+#include <thread>
+
+#if defined(__linux__)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#include <immintrin.h>
+	#define SIMD_AVX2 1		// built in, used if the CPU has it
+#else
+	#define SIMD_AVX2 0
+#endif
+
+
+using Byte = unsigned char;
+using Word = unsigned short;
+
+using uint32 = unsigned int;
+using sint32 = signed int;
+
+using uint64 = unsigned long long;
+
+
+// For the few hot paths where the compiler's inlining budget gets it wrong
+#if defined(__GNUC__)
+	#define FORCE_INLINE inline __attribute__((always_inline))
+#else
+	#define FORCE_INLINE inline
+#endif
+
+
+// NOTE: Dispatch engine
+// Picked at build time (see DISPATCH in the Makefile).
+//   DISPATCH_SWITCH	one big switch in Exec (default)
+//   DISPATCH_TABLE	256-entry handler table indexed by the opcode
+//   DISPATCH_THREADED	computed goto, the dispatch is copied into every handler
+#if !defined(DISPATCH_SWITCH) && !defined(DISPATCH_TABLE) && !defined(DISPATCH_THREADED)
+	#define DISPATCH_SWITCH
+#endif
+
+#if defined(DISPATCH_THREADED) && !defined(__GNUC__)
+	#error "DISPATCH_THREADED needs computed goto (clang or gcc)"
+#endif
+
+// NOTE: JIT
+// The x86-64 block compiler is only there on x86-64 Linux, and can be left
+// out of the build with JIT=0 in the Makefile.
+#if !defined(JIT)
+	#define JIT 1
+#endif
+
+#if JIT && defined(__x86_64__) && defined(__linux__)
+	#define JIT_AVAILABLE 1
+#else
+	#define JIT_AVAILABLE 0
+#endif
+
+// NOTE: Profiling
+// Execution counters (see Profile), left out of the build unless PROFILE=1
+// in the Makefile.
+#if !defined(PROFILE)
+	#define PROFILE 0
+#endif
+
+#if defined(DISPATCH_TABLE)
+	#define DISPATCH_NAME "table"
+#elif defined(DISPATCH_THREADED)
+	#define DISPATCH_NAME "threaded"
+#else
+	#define DISPATCH_NAME "switch"
+#endif
+
+
+// NOTE: ISA
+// Every opcode the core knows about, in one place: the documented NMOS
+// 6502 set. The INS_ constants, the interpreter's handlers, the switch in
+// Exec, the dispatch table, the block decoder, the disassembler and the
+// cycle counts are all generated from this list, so an instruction is one
+// line here plus its case in CPU::Execute if the mnemonic is new.
+//	X(opcode, name, mnemonic, mode, cycles, flags)
+// cycles is the base count; OPF_PAGE adds one when an indexed address
+// crosses a page, and a taken branch adds one (two across a page).
+#define CPU_ISA(X) \
+	X(0x69, ADC_IMM,	ADC, IMM, 2, OPF_NZ) \
+	X(0x65, ADC_ZP,		ADC, ZP,  3, OPF_NZ) \
+	X(0x75, ADC_ZPX,	ADC, ZPX, 4, OPF_NZ) \
+	X(0x6D, ADC_ABS,	ADC, ABS, 4, OPF_NZ) \
+	X(0x7D, ADC_ABX,	ADC, ABX, 4, OPF_NZ | OPF_PAGE) \
+	X(0x79, ADC_ABY,	ADC, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0x61, ADC_IZX,	ADC, IZX, 6, OPF_NZ) \
+	X(0x71, ADC_IZY,	ADC, IZY, 5, OPF_NZ | OPF_PAGE) \
+	X(0x29, AND_IMM,	AND, IMM, 2, OPF_NZ) \
+	X(0x25, AND_ZP,		AND, ZP,  3, OPF_NZ) \
+	X(0x35, AND_ZPX,	AND, ZPX, 4, OPF_NZ) \
+	X(0x2D, AND_ABS,	AND, ABS, 4, OPF_NZ) \
+	X(0x3D, AND_ABX,	AND, ABX, 4, OPF_NZ | OPF_PAGE) \
+	X(0x39, AND_ABY,	AND, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0x21, AND_IZX,	AND, IZX, 6, OPF_NZ) \
+	X(0x31, AND_IZY,	AND, IZY, 5, OPF_NZ | OPF_PAGE) \
+	X(0x0A, ASL_ACC,	ASL, ACC, 2, OPF_NZ) \
+	X(0x06, ASL_ZP,		ASL, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0x16, ASL_ZPX,	ASL, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0x0E, ASL_ABS,	ASL, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0x1E, ASL_ABX,	ASL, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0x90, BCC,		BCC, REL, 2, OPF_JUMP) \
+	X(0xB0, BCS,		BCS, REL, 2, OPF_JUMP) \
+	X(0xF0, BEQ,		BEQ, REL, 2, OPF_JUMP) \
+	X(0x30, BMI,		BMI, REL, 2, OPF_JUMP) \
+	X(0xD0, BNE,		BNE, REL, 2, OPF_JUMP) \
+	X(0x10, BPL,		BPL, REL, 2, OPF_JUMP) \
+	X(0x50, BVC,		BVC, REL, 2, OPF_JUMP) \
+	X(0x70, BVS,		BVS, REL, 2, OPF_JUMP) \
+	X(0x24, BIT_ZP,		BIT, ZP,  3, OPF_NONE) \
+	X(0x2C, BIT_ABS,	BIT, ABS, 4, OPF_NONE) \
+	X(0x00, BRK,		BRK, IMP, 7, OPF_JUMP | OPF_WRITE) \
+	X(0x18, CLC,		CLC, IMP, 2, OPF_NONE) \
+	X(0xD8, CLD,		CLD, IMP, 2, OPF_NONE) \
+	X(0x58, CLI,		CLI, IMP, 2, OPF_NONE) \
+	X(0xB8, CLV,		CLV, IMP, 2, OPF_NONE) \
+	X(0xC9, CMP_IMM,	CMP, IMM, 2, OPF_NZ) \
+	X(0xC5, CMP_ZP,		CMP, ZP,  3, OPF_NZ) \
+	X(0xD5, CMP_ZPX,	CMP, ZPX, 4, OPF_NZ) \
+	X(0xCD, CMP_ABS,	CMP, ABS, 4, OPF_NZ) \
+	X(0xDD, CMP_ABX,	CMP, ABX, 4, OPF_NZ | OPF_PAGE) \
+	X(0xD9, CMP_ABY,	CMP, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0xC1, CMP_IZX,	CMP, IZX, 6, OPF_NZ) \
+	X(0xD1, CMP_IZY,	CMP, IZY, 5, OPF_NZ | OPF_PAGE) \
+	X(0xE0, CPX_IMM,	CPX, IMM, 2, OPF_NZ) \
+	X(0xE4, CPX_ZP,		CPX, ZP,  3, OPF_NZ) \
+	X(0xEC, CPX_ABS,	CPX, ABS, 4, OPF_NZ) \
+	X(0xC0, CPY_IMM,	CPY, IMM, 2, OPF_NZ) \
+	X(0xC4, CPY_ZP,		CPY, ZP,  3, OPF_NZ) \
+	X(0xCC, CPY_ABS,	CPY, ABS, 4, OPF_NZ) \
+	X(0xC6, DEC_ZP,		DEC, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0xD6, DEC_ZPX,	DEC, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0xCE, DEC_ABS,	DEC, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0xDE, DEC_ABX,	DEC, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0xCA, DEX,		DEX, IMP, 2, OPF_NZ) \
+	X(0x88, DEY,		DEY, IMP, 2, OPF_NZ) \
+	X(0x49, EOR_IMM,	EOR, IMM, 2, OPF_NZ) \
+	X(0x45, EOR_ZP,		EOR, ZP,  3, OPF_NZ) \
+	X(0x55, EOR_ZPX,	EOR, ZPX, 4, OPF_NZ) \
+	X(0x4D, EOR_ABS,	EOR, ABS, 4, OPF_NZ) \
+	X(0x5D, EOR_ABX,	EOR, ABX, 4, OPF_NZ | OPF_PAGE) \
+	X(0x59, EOR_ABY,	EOR, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0x41, EOR_IZX,	EOR, IZX, 6, OPF_NZ) \
+	X(0x51, EOR_IZY,	EOR, IZY, 5, OPF_NZ | OPF_PAGE) \
+	X(0xE6, INC_ZP,		INC, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0xF6, INC_ZPX,	INC, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0xEE, INC_ABS,	INC, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0xFE, INC_ABX,	INC, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0xE8, INX,		INX, IMP, 2, OPF_NZ) \
+	X(0xC8, INY,		INY, IMP, 2, OPF_NZ) \
+	X(0x4C, JMP_ABS,	JMP, ABS, 3, OPF_JUMP) \
+	X(0x6C, JMP_IND,	JMP, IND, 5, OPF_JUMP) \
+	X(0x20, JSR,		JSR, ABS, 6, OPF_JUMP | OPF_WRITE) \
+	X(0xA9, LDA_IMM,	LDA, IMM, 2, OPF_NZ) \
+	X(0xA5, LDA_ZP,		LDA, ZP,  3, OPF_NZ) \
+	X(0xB5, LDA_ZPX,	LDA, ZPX, 4, OPF_NZ) \
+	X(0xAD, LDA_ABS,	LDA, ABS, 4, OPF_NZ) \
+	X(0xBD, LDA_ABX,	LDA, ABX, 4, OPF_NZ | OPF_PAGE) \
+	X(0xB9, LDA_ABY,	LDA, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0xA1, LDA_IZX,	LDA, IZX, 6, OPF_NZ) \
+	X(0xB1, LDA_IZY,	LDA, IZY, 5, OPF_NZ | OPF_PAGE) \
+	X(0xA2, LDX_IMM,	LDX, IMM, 2, OPF_NZ) \
+	X(0xA6, LDX_ZP,		LDX, ZP,  3, OPF_NZ) \
+	X(0xB6, LDX_ZPY,	LDX, ZPY, 4, OPF_NZ) \
+	X(0xAE, LDX_ABS,	LDX, ABS, 4, OPF_NZ) \
+	X(0xBE, LDX_ABY,	LDX, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0xA0, LDY_IMM,	LDY, IMM, 2, OPF_NZ) \
+	X(0xA4, LDY_ZP,		LDY, ZP,  3, OPF_NZ) \
+	X(0xB4, LDY_ZPX,	LDY, ZPX, 4, OPF_NZ) \
+	X(0xAC, LDY_ABS,	LDY, ABS, 4, OPF_NZ) \
+	X(0xBC, LDY_ABX,	LDY, ABX, 4, OPF_NZ | OPF_PAGE) \
+	X(0x4A, LSR_ACC,	LSR, ACC, 2, OPF_NZ) \
+	X(0x46, LSR_ZP,		LSR, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0x56, LSR_ZPX,	LSR, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0x4E, LSR_ABS,	LSR, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0x5E, LSR_ABX,	LSR, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0xEA, NOP,		NOP, IMP, 2, OPF_NONE) \
+	X(0x09, ORA_IMM,	ORA, IMM, 2, OPF_NZ) \
+	X(0x05, ORA_ZP,		ORA, ZP,  3, OPF_NZ) \
+	X(0x15, ORA_ZPX,	ORA, ZPX, 4, OPF_NZ) \
+	X(0x0D, ORA_ABS,	ORA, ABS, 4, OPF_NZ) \
+	X(0x1D, ORA_ABX,	ORA, ABX, 4, OPF_NZ | OPF_PAGE) \
+	X(0x19, ORA_ABY,	ORA, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0x01, ORA_IZX,	ORA, IZX, 6, OPF_NZ) \
+	X(0x11, ORA_IZY,	ORA, IZY, 5, OPF_NZ | OPF_PAGE) \
+	X(0x48, PHA,		PHA, IMP, 3, OPF_WRITE) \
+	X(0x08, PHP,		PHP, IMP, 3, OPF_WRITE) \
+	X(0x68, PLA,		PLA, IMP, 4, OPF_NZ) \
+	X(0x28, PLP,		PLP, IMP, 4, OPF_NONE) \
+	X(0x2A, ROL_ACC,	ROL, ACC, 2, OPF_NZ) \
+	X(0x26, ROL_ZP,		ROL, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0x36, ROL_ZPX,	ROL, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0x2E, ROL_ABS,	ROL, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0x3E, ROL_ABX,	ROL, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0x6A, ROR_ACC,	ROR, ACC, 2, OPF_NZ) \
+	X(0x66, ROR_ZP,		ROR, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0x76, ROR_ZPX,	ROR, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0x6E, ROR_ABS,	ROR, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0x7E, ROR_ABX,	ROR, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0x40, RTI,		RTI, IMP, 6, OPF_JUMP) \
+	X(0x60, RTS,		RTS, IMP, 6, OPF_JUMP) \
+	X(0xE9, SBC_IMM,	SBC, IMM, 2, OPF_NZ) \
+	X(0xE5, SBC_ZP,		SBC, ZP,  3, OPF_NZ) \
+	X(0xF5, SBC_ZPX,	SBC, ZPX, 4, OPF_NZ) \
+	X(0xED, SBC_ABS,	SBC, ABS, 4, OPF_NZ) \
+	X(0xFD, SBC_ABX,	SBC, ABX, 4, OPF_NZ | OPF_PAGE) \
+	X(0xF9, SBC_ABY,	SBC, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0xE1, SBC_IZX,	SBC, IZX, 6, OPF_NZ) \
+	X(0xF1, SBC_IZY,	SBC, IZY, 5, OPF_NZ | OPF_PAGE) \
+	X(0x38, SEC,		SEC, IMP, 2, OPF_NONE) \
+	X(0xF8, SED,		SED, IMP, 2, OPF_NONE) \
+	X(0x78, SEI,		SEI, IMP, 2, OPF_NONE) \
+	X(0x85, STA_ZP,		STA, ZP,  3, OPF_WRITE) \
+	X(0x95, STA_ZPX,	STA, ZPX, 4, OPF_WRITE) \
+	X(0x8D, STA_ABS,	STA, ABS, 4, OPF_WRITE) \
+	X(0x9D, STA_ABX,	STA, ABX, 5, OPF_WRITE) \
+	X(0x99, STA_ABY,	STA, ABY, 5, OPF_WRITE) \
+	X(0x81, STA_IZX,	STA, IZX, 6, OPF_WRITE) \
+	X(0x91, STA_IZY,	STA, IZY, 6, OPF_WRITE) \
+	X(0x86, STX_ZP,		STX, ZP,  3, OPF_WRITE) \
+	X(0x96, STX_ZPY,	STX, ZPY, 4, OPF_WRITE) \
+	X(0x8E, STX_ABS,	STX, ABS, 4, OPF_WRITE) \
+	X(0x84, STY_ZP,		STY, ZP,  3, OPF_WRITE) \
+	X(0x94, STY_ZPX,	STY, ZPX, 4, OPF_WRITE) \
+	X(0x8C, STY_ABS,	STY, ABS, 4, OPF_WRITE) \
+	X(0xAA, TAX,		TAX, IMP, 2, OPF_NZ) \
+	X(0xA8, TAY,		TAY, IMP, 2, OPF_NZ) \
+	X(0xBA, TSX,		TSX, IMP, 2, OPF_NZ) \
+	X(0x8A, TXA,		TXA, IMP, 2, OPF_NZ) \
+	X(0x9A, TXS,		TXS, IMP, 2, OPF_NONE) \
+	X(0x98, TYA,		TYA, IMP, 2, OPF_NZ)
+
+// What the 65C02 adds or changes, looked up before CPU_ISA for the variants
+// that have it (see the variant policies below). Every other opcode is a NOP
+// on the CMOS chip, with its own length and cycles. The Rockwell/WDC bit
+// instructions (RMB, SMB, BBR, BBS) and WAI/STP are not in here: their
+// columns (x3, x7, xB, xF) are the original 65C02's 1-byte, 1-cycle NOPs.
+#define CPU_ISA_65C02(X) \
+	X(0x72, ADC_IZP,	ADC, IZP, 5, OPF_NZ) \
+	X(0x32, AND_IZP,	AND, IZP, 5, OPF_NZ) \
+	X(0xD2, CMP_IZP,	CMP, IZP, 5, OPF_NZ) \
+	X(0x52, EOR_IZP,	EOR, IZP, 5, OPF_NZ) \
+	X(0xB2, LDA_IZP,	LDA, IZP, 5, OPF_NZ) \
+	X(0x12, ORA_IZP,	ORA, IZP, 5, OPF_NZ) \
+	X(0xF2, SBC_IZP,	SBC, IZP, 5, OPF_NZ) \
+	X(0x92, STA_IZP,	STA, IZP, 5, OPF_WRITE) \
+	X(0x89, BIT_IMM,	BIT, IMM, 2, OPF_NONE) \
+	X(0x34, BIT_ZPX,	BIT, ZPX, 4, OPF_NONE) \
+	X(0x3C, BIT_ABX,	BIT, ABX, 4, OPF_PAGE) \
+	X(0x1A, INC_ACC,	INC, ACC, 2, OPF_NZ) \
+	X(0x3A, DEC_ACC,	DEC, ACC, 2, OPF_NZ) \
+	X(0x80, BRA,		BRA, REL, 2, OPF_JUMP) \
+	X(0x7C, JMP_IAX,	JMP, IAX, 6, OPF_JUMP) \
+	X(0x6C, JMP_IND,	JMP, IND, 6, OPF_JUMP) \
+	X(0xDA, PHX,		PHX, IMP, 3, OPF_WRITE) \
+	X(0x5A, PHY,		PHY, IMP, 3, OPF_WRITE) \
+	X(0xFA, PLX,		PLX, IMP, 4, OPF_NZ) \
+	X(0x7A, PLY,		PLY, IMP, 4, OPF_NZ) \
+	X(0x64, STZ_ZP,		STZ, ZP,  3, OPF_WRITE) \
+	X(0x74, STZ_ZPX,	STZ, ZPX, 4, OPF_WRITE) \
+	X(0x9C, STZ_ABS,	STZ, ABS, 4, OPF_WRITE) \
+	X(0x9E, STZ_ABX,	STZ, ABX, 5, OPF_WRITE) \
+	X(0x14, TRB_ZP,		TRB, ZP,  5, OPF_WRITE) \
+	X(0x1C, TRB_ABS,	TRB, ABS, 6, OPF_WRITE) \
+	X(0x04, TSB_ZP,		TSB, ZP,  5, OPF_WRITE) \
+	X(0x0C, TSB_ABS,	TSB, ABS, 6, OPF_WRITE) \
+	X(0x1E, ASL_ABX,	ASL, ABX, 6, OPF_NZ | OPF_WRITE | OPF_PAGE) \
+	X(0x5E, LSR_ABX,	LSR, ABX, 6, OPF_NZ | OPF_WRITE | OPF_PAGE) \
+	X(0x3E, ROL_ABX,	ROL, ABX, 6, OPF_NZ | OPF_WRITE | OPF_PAGE) \
+	X(0x7E, ROR_ABX,	ROR, ABX, 6, OPF_NZ | OPF_WRITE | OPF_PAGE) \
+	X(0x02, NOP_02,		NOP, IMM, 2, OPF_NONE) \
+	X(0x22, NOP_22,		NOP, IMM, 2, OPF_NONE) \
+	X(0x42, NOP_42,		NOP, IMM, 2, OPF_NONE) \
+	X(0x62, NOP_62,		NOP, IMM, 2, OPF_NONE) \
+	X(0x82, NOP_82,		NOP, IMM, 2, OPF_NONE) \
+	X(0xC2, NOP_C2,		NOP, IMM, 2, OPF_NONE) \
+	X(0xE2, NOP_E2,		NOP, IMM, 2, OPF_NONE) \
+	X(0x44, NOP_44,		NOP, ZP,  3, OPF_NONE) \
+	X(0x54, NOP_54,		NOP, ZPX, 4, OPF_NONE) \
+	X(0xD4, NOP_D4,		NOP, ZPX, 4, OPF_NONE) \
+	X(0xF4, NOP_F4,		NOP, ZPX, 4, OPF_NONE) \
+	X(0x5C, NOP_5C,		NOP, ABS, 8, OPF_NONE) \
+	X(0xDC, NOP_DC,		NOP, ABS, 4, OPF_NONE) \
+	X(0xFC, NOP_FC,		NOP, ABS, 4, OPF_NONE) \
+	X(0x03, NOP_03, NOP, IMP, 1, OPF_NONE) X(0x07, NOP_07, NOP, IMP, 1, OPF_NONE) X(0x0B, NOP_0B, NOP, IMP, 1, OPF_NONE) X(0x0F, NOP_0F, NOP, IMP, 1, OPF_NONE) \
+	X(0x13, NOP_13, NOP, IMP, 1, OPF_NONE) X(0x17, NOP_17, NOP, IMP, 1, OPF_NONE) X(0x1B, NOP_1B, NOP, IMP, 1, OPF_NONE) X(0x1F, NOP_1F, NOP, IMP, 1, OPF_NONE) \
+	X(0x23, NOP_23, NOP, IMP, 1, OPF_NONE) X(0x27, NOP_27, NOP, IMP, 1, OPF_NONE) X(0x2B, NOP_2B, NOP, IMP, 1, OPF_NONE) X(0x2F, NOP_2F, NOP, IMP, 1, OPF_NONE) \
+	X(0x33, NOP_33, NOP, IMP, 1, OPF_NONE) X(0x37, NOP_37, NOP, IMP, 1, OPF_NONE) X(0x3B, NOP_3B, NOP, IMP, 1, OPF_NONE) X(0x3F, NOP_3F, NOP, IMP, 1, OPF_NONE) \
+	X(0x43, NOP_43, NOP, IMP, 1, OPF_NONE) X(0x47, NOP_47, NOP, IMP, 1, OPF_NONE) X(0x4B, NOP_4B, NOP, IMP, 1, OPF_NONE) X(0x4F, NOP_4F, NOP, IMP, 1, OPF_NONE) \
+	X(0x53, NOP_53, NOP, IMP, 1, OPF_NONE) X(0x57, NOP_57, NOP, IMP, 1, OPF_NONE) X(0x5B, NOP_5B, NOP, IMP, 1, OPF_NONE) X(0x5F, NOP_5F, NOP, IMP, 1, OPF_NONE) \
+	X(0x63, NOP_63, NOP, IMP, 1, OPF_NONE) X(0x67, NOP_67, NOP, IMP, 1, OPF_NONE) X(0x6B, NOP_6B, NOP, IMP, 1, OPF_NONE) X(0x6F, NOP_6F, NOP, IMP, 1, OPF_NONE) \
+	X(0x73, NOP_73, NOP, IMP, 1, OPF_NONE) X(0x77, NOP_77, NOP, IMP, 1, OPF_NONE) X(0x7B, NOP_7B, NOP, IMP, 1, OPF_NONE) X(0x7F, NOP_7F, NOP, IMP, 1, OPF_NONE) \
+	X(0x83, NOP_83, NOP, IMP, 1, OPF_NONE) X(0x87, NOP_87, NOP, IMP, 1, OPF_NONE) X(0x8B, NOP_8B, NOP, IMP, 1, OPF_NONE) X(0x8F, NOP_8F, NOP, IMP, 1, OPF_NONE) \
+	X(0x93, NOP_93, NOP, IMP, 1, OPF_NONE) X(0x97, NOP_97, NOP, IMP, 1, OPF_NONE) X(0x9B, NOP_9B, NOP, IMP, 1, OPF_NONE) X(0x9F, NOP_9F, NOP, IMP, 1, OPF_NONE) \
+	X(0xA3, NOP_A3, NOP, IMP, 1, OPF_NONE) X(0xA7, NOP_A7, NOP, IMP, 1, OPF_NONE) X(0xAB, NOP_AB, NOP, IMP, 1, OPF_NONE) X(0xAF, NOP_AF, NOP, IMP, 1, OPF_NONE) \
+	X(0xB3, NOP_B3, NOP, IMP, 1, OPF_NONE) X(0xB7, NOP_B7, NOP, IMP, 1, OPF_NONE) X(0xBB, NOP_BB, NOP, IMP, 1, OPF_NONE) X(0xBF, NOP_BF, NOP, IMP, 1, OPF_NONE) \
+	X(0xC3, NOP_C3, NOP, IMP, 1, OPF_NONE) X(0xC7, NOP_C7, NOP, IMP, 1, OPF_NONE) X(0xCB, NOP_CB, NOP, IMP, 1, OPF_NONE) X(0xCF, NOP_CF, NOP, IMP, 1, OPF_NONE) \
+	X(0xD3, NOP_D3, NOP, IMP, 1, OPF_NONE) X(0xD7, NOP_D7, NOP, IMP, 1, OPF_NONE) X(0xDB, NOP_DB, NOP, IMP, 1, OPF_NONE) X(0xDF, NOP_DF, NOP, IMP, 1, OPF_NONE) \
+	X(0xE3, NOP_E3, NOP, IMP, 1, OPF_NONE) X(0xE7, NOP_E7, NOP, IMP, 1, OPF_NONE) X(0xEB, NOP_EB, NOP, IMP, 1, OPF_NONE) X(0xEF, NOP_EF, NOP, IMP, 1, OPF_NONE) \
+	X(0xF3, NOP_F3, NOP, IMP, 1, OPF_NONE) X(0xF7, NOP_F7, NOP, IMP, 1, OPF_NONE) X(0xFB, NOP_FB, NOP, IMP, 1, OPF_NONE) X(0xFF, NOP_FF, NOP, IMP, 1, OPF_NONE)
+
+// The undocumented NMOS opcodes that behave the same on every chip (no
+// XAA, LAS, SHA/SHX/SHY/TAS or the jams), for the variants that want them.
+#define CPU_ISA_UNDOCUMENTED(X) \
+	X(0x07, SLO_ZP,		SLO, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0x17, SLO_ZPX,	SLO, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0x0F, SLO_ABS,	SLO, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0x1F, SLO_ABX,	SLO, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0x1B, SLO_ABY,	SLO, ABY, 7, OPF_NZ | OPF_WRITE) \
+	X(0x03, SLO_IZX,	SLO, IZX, 8, OPF_NZ | OPF_WRITE) \
+	X(0x13, SLO_IZY,	SLO, IZY, 8, OPF_NZ | OPF_WRITE) \
+	X(0x27, RLA_ZP,		RLA, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0x37, RLA_ZPX,	RLA, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0x2F, RLA_ABS,	RLA, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0x3F, RLA_ABX,	RLA, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0x3B, RLA_ABY,	RLA, ABY, 7, OPF_NZ | OPF_WRITE) \
+	X(0x23, RLA_IZX,	RLA, IZX, 8, OPF_NZ | OPF_WRITE) \
+	X(0x33, RLA_IZY,	RLA, IZY, 8, OPF_NZ | OPF_WRITE) \
+	X(0x47, SRE_ZP,		SRE, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0x57, SRE_ZPX,	SRE, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0x4F, SRE_ABS,	SRE, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0x5F, SRE_ABX,	SRE, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0x5B, SRE_ABY,	SRE, ABY, 7, OPF_NZ | OPF_WRITE) \
+	X(0x43, SRE_IZX,	SRE, IZX, 8, OPF_NZ | OPF_WRITE) \
+	X(0x53, SRE_IZY,	SRE, IZY, 8, OPF_NZ | OPF_WRITE) \
+	X(0x67, RRA_ZP,		RRA, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0x77, RRA_ZPX,	RRA, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0x6F, RRA_ABS,	RRA, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0x7F, RRA_ABX,	RRA, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0x7B, RRA_ABY,	RRA, ABY, 7, OPF_NZ | OPF_WRITE) \
+	X(0x63, RRA_IZX,	RRA, IZX, 8, OPF_NZ | OPF_WRITE) \
+	X(0x73, RRA_IZY,	RRA, IZY, 8, OPF_NZ | OPF_WRITE) \
+	X(0x87, SAX_ZP,		SAX, ZP,  3, OPF_WRITE) \
+	X(0x97, SAX_ZPY,	SAX, ZPY, 4, OPF_WRITE) \
+	X(0x8F, SAX_ABS,	SAX, ABS, 4, OPF_WRITE) \
+	X(0x83, SAX_IZX,	SAX, IZX, 6, OPF_WRITE) \
+	X(0xA7, LAX_ZP,		LAX, ZP,  3, OPF_NZ) \
+	X(0xB7, LAX_ZPY,	LAX, ZPY, 4, OPF_NZ) \
+	X(0xAF, LAX_ABS,	LAX, ABS, 4, OPF_NZ) \
+	X(0xBF, LAX_ABY,	LAX, ABY, 4, OPF_NZ | OPF_PAGE) \
+	X(0xA3, LAX_IZX,	LAX, IZX, 6, OPF_NZ) \
+	X(0xB3, LAX_IZY,	LAX, IZY, 5, OPF_NZ | OPF_PAGE) \
+	X(0xC7, DCP_ZP,		DCP, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0xD7, DCP_ZPX,	DCP, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0xCF, DCP_ABS,	DCP, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0xDF, DCP_ABX,	DCP, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0xDB, DCP_ABY,	DCP, ABY, 7, OPF_NZ | OPF_WRITE) \
+	X(0xC3, DCP_IZX,	DCP, IZX, 8, OPF_NZ | OPF_WRITE) \
+	X(0xD3, DCP_IZY,	DCP, IZY, 8, OPF_NZ | OPF_WRITE) \
+	X(0xE7, ISC_ZP,		ISC, ZP,  5, OPF_NZ | OPF_WRITE) \
+	X(0xF7, ISC_ZPX,	ISC, ZPX, 6, OPF_NZ | OPF_WRITE) \
+	X(0xEF, ISC_ABS,	ISC, ABS, 6, OPF_NZ | OPF_WRITE) \
+	X(0xFF, ISC_ABX,	ISC, ABX, 7, OPF_NZ | OPF_WRITE) \
+	X(0xFB, ISC_ABY,	ISC, ABY, 7, OPF_NZ | OPF_WRITE) \
+	X(0xE3, ISC_IZX,	ISC, IZX, 8, OPF_NZ | OPF_WRITE) \
+	X(0xF3, ISC_IZY,	ISC, IZY, 8, OPF_NZ | OPF_WRITE) \
+	X(0x0B, ANC_IMM,	ANC, IMM, 2, OPF_NZ) \
+	X(0x2B, ANC_IMM2,	ANC, IMM, 2, OPF_NZ) \
+	X(0x4B, ALR_IMM,	ALR, IMM, 2, OPF_NZ) \
+	X(0x6B, ARR_IMM,	ARR, IMM, 2, OPF_NZ) \
+	X(0xCB, SBX_IMM,	SBX, IMM, 2, OPF_NZ) \
+	X(0xEB, SBC_IMM2,	SBC, IMM, 2, OPF_NZ) \
+	X(0x1A, NOP_1A,		NOP, IMP, 2, OPF_NONE) \
+	X(0x3A, NOP_3A,		NOP, IMP, 2, OPF_NONE) \
+	X(0x5A, NOP_5A,		NOP, IMP, 2, OPF_NONE) \
+	X(0x7A, NOP_7A,		NOP, IMP, 2, OPF_NONE) \
+	X(0xDA, NOP_DA,		NOP, IMP, 2, OPF_NONE) \
+	X(0xFA, NOP_FA,		NOP, IMP, 2, OPF_NONE) \
+	X(0x80, NOP_IMM,	NOP, IMM, 2, OPF_NONE) \
+	X(0x82, NOP_IMM2,	NOP, IMM, 2, OPF_NONE) \
+	X(0x89, NOP_IMM3,	NOP, IMM, 2, OPF_NONE) \
+	X(0xC2, NOP_IMM4,	NOP, IMM, 2, OPF_NONE) \
+	X(0xE2, NOP_IMM5,	NOP, IMM, 2, OPF_NONE) \
+	X(0x04, NOP_ZP,		NOP, ZP,  3, OPF_NONE) \
+	X(0x44, NOP_ZP2,	NOP, ZP,  3, OPF_NONE) \
+	X(0x64, NOP_ZP3,	NOP, ZP,  3, OPF_NONE) \
+	X(0x14, NOP_ZPX,	NOP, ZPX, 4, OPF_NONE) \
+	X(0x34, NOP_ZPX2,	NOP, ZPX, 4, OPF_NONE) \
+	X(0x54, NOP_ZPX3,	NOP, ZPX, 4, OPF_NONE) \
+	X(0x74, NOP_ZPX4,	NOP, ZPX, 4, OPF_NONE) \
+	X(0xD4, NOP_ZPX5,	NOP, ZPX, 4, OPF_NONE) \
+	X(0xF4, NOP_ZPX6,	NOP, ZPX, 4, OPF_NONE) \
+	X(0x0C, NOP_ABS,	NOP, ABS, 4, OPF_NONE) \
+	X(0x1C, NOP_ABX,	NOP, ABX, 4, OPF_PAGE) \
+	X(0x3C, NOP_ABX2,	NOP, ABX, 4, OPF_PAGE) \
+	X(0x5C, NOP_ABX3,	NOP, ABX, 4, OPF_PAGE) \
+	X(0x7C, NOP_ABX4,	NOP, ABX, 4, OPF_PAGE) \
+	X(0xDC, NOP_ABX5,	NOP, ABX, 4, OPF_PAGE) \
+	X(0xFC, NOP_ABX6,	NOP, ABX, 4, OPF_PAGE)
+
+#define CPU_MNEMONICS(X) \
+	X(ADC) X(AND) X(ASL) X(BCC) X(BCS) X(BEQ) X(BIT) X(BMI) X(BNE) X(BPL) X(BRK) X(BVC) X(BVS) X(CLC) \
+	X(CLD) X(CLI) X(CLV) X(CMP) X(CPX) X(CPY) X(DEC) X(DEX) X(DEY) X(EOR) X(INC) X(INX) X(INY) X(JMP) \
+	X(JSR) X(LDA) X(LDX) X(LDY) X(LSR) X(NOP) X(ORA) X(PHA) X(PHP) X(PLA) X(PLP) X(ROL) X(ROR) X(RTI) \
+	X(RTS) X(SBC) X(SEC) X(SED) X(SEI) X(STA) X(STX) X(STY) X(TAX) X(TAY) X(TSX) X(TXA) X(TXS) X(TYA) \
+	X(BRA) X(PHX) X(PHY) X(PLX) X(PLY) X(STZ) X(TRB) X(TSB) \
+	X(ALR) X(ANC) X(ARR) X(DCP) X(ISC) X(LAX) X(RLA) X(RRA) X(SAX) X(SBX) X(SLO) X(SRE)
+
+enum Mnemonic : Byte
+{
+#define X(name) MN_##name,
+	CPU_MNEMONICS(X)
+#undef X
+	MN_COUNT
+};
+
+static constexpr const char* MNEMONIC_NAMES[] =
+{
+#define X(name) #name,
+	CPU_MNEMONICS(X)
+#undef X
+};
+
+// Addressing modes, and the operand each one hands to the Do_ handlers
+enum AddressMode : Byte
+{
+	AM_IMP,		// none
+	AM_ACC,		// none, works on A
+	AM_IMM,		// the value
+	AM_ZP,		// zero page address
+	AM_ZPX,		// zero page address, X added (wraps in the zero page)
+	AM_ZPY,		// same with Y
+	AM_ABS,		// address
+	AM_ABX,		// address, X added
+	AM_ABY,		// address, Y added
+	AM_IND,		// address of the address (JMP only)
+	AM_IZX,		// zero page address of the address, X added first
+	AM_IZY,		// zero page address of the address, Y added after
+	AM_REL,		// signed branch offset
+	AM_IZP,		// zero page address of the address (65C02)
+	AM_IAX,		// address of the address, X added first (65C02 JMP)
+};
+
+static constexpr Byte ModeBytes(AddressMode mode)
+{
+	return mode <= AM_ACC ? 1 : (mode == AM_ABS || mode == AM_ABX || mode == AM_ABY || mode == AM_IND || mode == AM_IAX) ? 3 : 2;
+}
+
+// Opcode flags
+static constexpr Byte
+	OPF_NONE	= 0,
+	OPF_JUMP	= 1 << 0,	// changes PC, ends a decoded block
+	OPF_WRITE	= 1 << 1,	// writes memory
+	OPF_NZ		= 1 << 2,	// sets N and Z from its result
+	OPF_PAGE	= 1 << 3	// one cycle more when the indexed address crosses a page
+	;
+
+// NOTE: CPU variants
+// Compile-time policies for the chips the core can be. The handlers and
+// the loop in CPU::ExecVariant are instantiated per policy, so a variant
+// costs nothing at run time and one binary can have all of them. Plain
+// Exec and the tools around it (block cache, JIT, AOT, traces) are the
+// NMOS 6502.
+struct Nmos6502
+{
+	static constexpr const char* NAME = "6502";
+	static constexpr bool DECIMAL		= true;		// D selects BCD arithmetic
+	static constexpr bool CMOS			= false;	// 65C02 opcodes, cycle counts and decimal flags
+	static constexpr bool JMP_BUG		= true;		// JMP ($xxFF) takes the high byte from $xx00
+	static constexpr bool UNDOCUMENTED	= false;	// CPU_ISA_UNDOCUMENTED
+};
+
+struct Cmos65C02
+{
+	static constexpr const char* NAME = "65c02";
+	static constexpr bool DECIMAL		= true;
+	static constexpr bool CMOS			= true;
+	static constexpr bool JMP_BUG		= false;
+	static constexpr bool UNDOCUMENTED	= false;
+};
+
+// The NES CPU: an NMOS core with the decimal mode cut out (D still sets
+// and clears, it just does nothing) and games that use the illegal opcodes
+struct Ricoh2A03
+{
+	static constexpr const char* NAME = "2a03";
+	static constexpr bool DECIMAL		= false;
+	static constexpr bool CMOS			= false;
+	static constexpr bool JMP_BUG		= true;
+	static constexpr bool UNDOCUMENTED	= true;
+};
+
+// The same lists as data, for tools that work on opcodes at run time, and
+// for the handlers, which look themselves up in here at compile time.
+struct OpInfo
+{
+	const char* Name;	// nullptr if the ISA does not have the opcode
+	Mnemonic Instruction;	// MN_COUNT if not
+	AddressMode Mode;
+	Byte Bytes;
+	Byte Cycles;
+	Byte Flags;
+};
+
+template <typename Chip = Nmos6502>
+static constexpr OpInfo OpInfoFor(uint32 opcode)
+{
+#define X(op, name, mnemonic, mode, cycles, flags) \
+		case op: return OpInfo{ #name, MN_##mnemonic, AM_##mode, ModeBytes(AM_##mode), cycles, flags };
+	
+	if constexpr (Chip::CMOS)
+	{
+		switch (opcode)
+		{
+			CPU_ISA_65C02(X)
+		}
+	}
+	
+	if constexpr (Chip::UNDOCUMENTED)
+	{
+		switch (opcode)
+		{
+			CPU_ISA_UNDOCUMENTED(X)
+		}
+	}
+	
+	switch (opcode)
+	{
+		CPU_ISA(X)
+	}
+#undef X
+	
+	return OpInfo{ nullptr, MN_COUNT, AM_IMP, 0, 0, 0 };
+}
+
+struct OpInfoTable
+{
+	OpInfo Ops[256];
+};
+
+template <typename Chip>
+static constexpr OpInfoTable BuildOpInfoTable()
+{
+	OpInfoTable table = {};
+	
+	for (uint32 i = 0; i < 256; i++)
+	{
+		table.Ops[i] = OpInfoFor<Chip>(i);
+	}
+	
+	return table;
+}
+
+template <typename Chip>
+static constexpr OpInfoTable VARIANT_OPS = BuildOpInfoTable<Chip>();
+
+static constexpr const OpInfoTable& OP_INFO = VARIANT_OPS<Nmos6502>;
+
+// All 256 opcode values, for code that needs one entry per opcode whether the
+// ISA defines it or not (the threaded interpreter).
+#define CPU_ALL_OPCODES(X) \
+	X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13) X(14) X(15) \
+	X(16) X(17) X(18) X(19) X(20) X(21) X(22) X(23) X(24) X(25) X(26) X(27) X(28) X(29) X(30) X(31) \
+	X(32) X(33) X(34) X(35) X(36) X(37) X(38) X(39) X(40) X(41) X(42) X(43) X(44) X(45) X(46) X(47) \
+	X(48) X(49) X(50) X(51) X(52) X(53) X(54) X(55) X(56) X(57) X(58) X(59) X(60) X(61) X(62) X(63) \
+	X(64) X(65) X(66) X(67) X(68) X(69) X(70) X(71) X(72) X(73) X(74) X(75) X(76) X(77) X(78) X(79) \
+	X(80) X(81) X(82) X(83) X(84) X(85) X(86) X(87) X(88) X(89) X(90) X(91) X(92) X(93) X(94) X(95) \
+	X(96) X(97) X(98) X(99) X(100) X(101) X(102) X(103) X(104) X(105) X(106) X(107) X(108) X(109) X(110) X(111) \
+	X(112) X(113) X(114) X(115) X(116) X(117) X(118) X(119) X(120) X(121) X(122) X(123) X(124) X(125) X(126) X(127) \
+	X(128) X(129) X(130) X(131) X(132) X(133) X(134) X(135) X(136) X(137) X(138) X(139) X(140) X(141) X(142) X(143) \
+	X(144) X(145) X(146) X(147) X(148) X(149) X(150) X(151) X(152) X(153) X(154) X(155) X(156) X(157) X(158) X(159) \
+	X(160) X(161) X(162) X(163) X(164) X(165) X(166) X(167) X(168) X(169) X(170) X(171) X(172) X(173) X(174) X(175) \
+	X(176) X(177) X(178) X(179) X(180) X(181) X(182) X(183) X(184) X(185) X(186) X(187) X(188) X(189) X(190) X(191) \
+	X(192) X(193) X(194) X(195) X(196) X(197) X(198) X(199) X(200) X(201) X(202) X(203) X(204) X(205) X(206) X(207) \
+	X(208) X(209) X(210) X(211) X(212) X(213) X(214) X(215) X(216) X(217) X(218) X(219) X(220) X(221) X(222) X(223) \
+	X(224) X(225) X(226) X(227) X(228) X(229) X(230) X(231) X(232) X(233) X(234) X(235) X(236) X(237) X(238) X(239) \
+	X(240) X(241) X(242) X(243) X(244) X(245) X(246) X(247) X(248) X(249) X(250) X(251) X(252) X(253) X(254) X(255)
+
+
+// NOTE: Devices
+// Something on the bus that is not memory. Gets the full address, so one
+// device can sit on several pages.
+struct Device
+{
+	Byte (*Read)(void* context, Word address);
+	void (*Write)(void* context, Word address, Byte val);
+	void* Context;
+};
+
+
+// The memory half of a Snapshot. MEM saves a page in here the first time it
+// changes after the snapshot was taken, so taking one copies nothing.
+struct SnapshotPages
+{
+	Byte Data[1024 * 64];
+	uint64 Saved[4];	// bit set = Data holds that page as it was at the snapshot
+};
+
+
+// Gets told about every write before it happens (recorders, not devices).
+struct WriteObserver
+{
+	void (*Write)(void* context, uint32 address, Byte val);
+	void* Context;
+};
+
+
+struct MEM
+{
+	static constexpr uint32 MAX_MEM = 1024 * 64;
+	static constexpr uint32 PAGES = MAX_MEM / 256;
+	
+	Byte Data[MAX_MEM];		// RAM, what every page maps to unless told otherwise
+	
+	// NOTE: Page table
+	// One descriptor per 256-byte page, pointing at the host memory behind
+	// it. A null pointer sends the access to the page's device, and a null
+	// Write with no device is ROM.
+	// Most pages are RAM at their own address, and for those the descriptor
+	// is skipped: one bit in Special says so, and the access goes straight
+	// to Data. The bit test only feeds a well predicted branch, so the load
+	// from Data does not wait on it, where going through the descriptor
+	// makes every fetch wait on a pointer load first (35% slower on the
+	// bench program). With nothing mapped at all even the bit test is
+	// skipped.
+	struct Page
+	{
+		const Byte* Read;
+		Byte* Write;
+		Device* Dev;
+	};
+	
+	Page Pages[PAGES];
+	
+	uint64 Special[PAGES / 64];		// bit set = not plain RAM, use Pages
+	
+	// Count of set bits in Special. Code that goes straight to Data (the JIT,
+	// the lockstep gathers) only does so while this is 0.
+	uint32 Mapped;
+	
+	// Bumped on every write to the page, so anything decoded from memory
+	// (the block cache) can tell when it went stale.
+	uint32 PageWrites[PAGES];
+	
+	// Sees every write through WriteByte, one observer at a time. Code that
+	// writes Data directly (the JIT) stays off while this is set.
+	WriteObserver* Observer;
+	
+	// One bit per page written since the last Clear. Starts all set, so the
+	// first Clear of a brand new MEM wipes everything.
+	uint64 Dirty[PAGES / 64] = { ~0ULL, ~0ULL, ~0ULL, ~0ULL };
+	
+	// NOTE: Copy-on-write
+	// While a Snapshot is active, Shared has a bit set for every page that
+	// still holds what it held when the snapshot was taken (or last
+	// restored). The first change to such a page saves it into the snapshot
+	// and clears the bit, so a restore only has to copy back the pages with
+	// a saved copy and a clear bit. Without a snapshot Shared is all 0 and
+	// the write path only pays for the bit test. The JIT writes Data
+	// directly, so it stays off while a snapshot is active.
+	SnapshotPages* Snap;
+	uint64 Shared[PAGES / 64];
+	
+	// NOTE: Watchpoints
+	// A page with a watched byte on it counts as special, so accesses to any
+	// other page stay on the fast path and only the watched pages pay for the
+	// bit test. A hit is only noted here, the CPU stops at the end of the
+	// instruction (see CPU::Stopping). Instruction fetches are reads too.
+	uint64 WatchReads[MAX_MEM / 64];
+	uint64 WatchWrites[MAX_MEM / 64];
+	uint32 Watches;				// bytes with a watch of either kind
+	
+	mutable bool Trapped;		// by the first watched access since Exec was entered
+	mutable bool TrapWrite;
+	mutable Word TrapAddress;
+	
+	MEM()
+	{
+		Mapped = 0;
+		Observer = nullptr;
+		Snap = nullptr;
+		Watches = 0;
+		Trapped = false;
+		
+		for (uint32 w = 0; w < PAGES / 64; w++)
+		{
+			Special[w] = 0;
+			Shared[w] = 0;
+		}
+		
+		for (uint32 w = 0; w < MAX_MEM / 64; w++)
+		{
+			WatchReads[w] = 0;
+			WatchWrites[w] = 0;
+		}
+		
+		for (uint32 page = 0; page < PAGES; page++)
+		{
+			Pages[page] = Page{ Data + page * 256, Data + page * 256, nullptr };
+			PageWrites[page] = 0;
+		}
+	}
+	
+	// The page table points into Data, a copy would point into the original
+	MEM(const MEM&) = delete;
+	MEM& operator=(const MEM&) = delete;
+	
+	
+	// Whatever is visible on a page changed, as far as decoded code is
+	// concerned that is a write.
+	void Remap(uint32 page, const Page& to)
+	{
+		Pages[page] = to;
+		PageWrites[page]++;
+		
+		UpdateSpecial(page);
+	}
+	
+	
+	// Special unless it is plain RAM with nothing watched on it
+	void UpdateSpecial(uint32 page)
+	{
+		uint64 bit = 1ULL << (page & 63);
+		
+		bool wasSpecial = Special[page >> 6] & bit;
+		bool isSpecial = !IsPlain(page) || IsWatched(page);
+		
+		if (isSpecial)
+		{
+			Special[page >> 6] |= bit;
+		}
+		else
+		{
+			Special[page >> 6] &= ~bit;
+		}
+		
+		if (!wasSpecial && isSpecial) Mapped++;
+		if (wasSpecial && !isSpecial) Mapped--;
+	}
+	
+	
+	bool IsPlain(uint32 page) const
+	{
+		return Pages[page].Read == Data + page * 256 && Pages[page].Write == Data + page * 256;
+	}
+	
+	
+	bool IsSpecial(uint32 page) const
+	{
+		return Mapped != 0 && ((Special[page >> 6] >> (page & 63)) & 1);
+	}
+	
+	
+	bool IsWatched(uint32 page) const
+	{
+		for (uint32 w = page * 4; w < page * 4 + 4; w++)
+		{
+			if (WatchReads[w] | WatchWrites[w])
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	
+	// Both false drops the watch
+	void Watch(uint32 address, bool reads, bool writes)
+	{
+		address &= MAX_MEM - 1;
+		
+		uint64 bit = 1ULL << (address & 63);
+		uint32 w = address >> 6;
+		
+		bool was = (WatchReads[w] | WatchWrites[w]) & bit;
+		
+		WatchReads[w] = reads ? WatchReads[w] | bit : WatchReads[w] & ~bit;
+		WatchWrites[w] = writes ? WatchWrites[w] | bit : WatchWrites[w] & ~bit;
+		
+		if (!was && (reads || writes)) Watches++;
+		if (was && !(reads || writes)) Watches--;
+		
+		UpdateSpecial(address >> 8);
+	}
+	
+	
+	void CheckWatch(uint32 address, const uint64* watched, bool write) const
+	{
+		if (((watched[address >> 6] >> (address & 63)) & 1) && !Trapped)
+		{
+			Trapped = true;
+			TrapWrite = write;
+			TrapAddress = address;
+		}
+	}
+	
+	
+	void MapRam(uint32 first, uint32 count)
+	{
+		for (uint32 page = first; page < first + count && page < PAGES; page++)
+		{
+			Remap(page, Page{ Data + page * 256, Data + page * 256, nullptr });
+		}
+	}
+	
+	
+	// image has to stay alive (and unchanged) for as long as it is mapped
+	void MapRom(uint32 first, uint32 count, const Byte* image)
+	{
+		for (uint32 page = first; page < first + count && page < PAGES; page++)
+		{
+			Remap(page, Page{ image + (page - first) * 256, nullptr, nullptr });
+		}
+	}
+	
+	
+	void MapDevice(uint32 first, uint32 count, Device* device)
+	{
+		for (uint32 page = first; page < first + count && page < PAGES; page++)
+		{
+			Remap(page, Page{ nullptr, nullptr, device });
+		}
+	}
+	
+	
+	// Bulk path, for a completely fresh image
+	void Init()
+	{
+		for (uint32 i = 0; i < PAGES; i++)
+		{
+			Touch(i);
+		}
+		
+		memset(Data, 0, sizeof(Data));
+		
+		for (uint32 i = 0; i < PAGES; i++)
+		{
+			PageWrites[i]++;
+		}
+		
+		for (uint32 w = 0; w < PAGES / 64; w++)
+		{
+			Dirty[w] = 0;
+		}
+	}
+	
+	
+	// Reset path: zeroes only the pages written since the last Clear/Init,
+	// so the cost follows how much the program touched, not 64 KiB.
+	void Clear()
+	{
+		for (uint32 w = 0; w < PAGES / 64; w++)
+		{
+			uint64 bits = Dirty[w];
+			
+			while (bits)
+			{
+				uint32 page = w * 64 + __builtin_ctzll(bits);
+				
+				Touch(page);
+				memset(Data + page * 256, 0, 256);
+				PageWrites[page]++;
+				
+				bits &= bits - 1;
+			}
+			
+			Dirty[w] = 0;
+		}
+	}
+	
+	
+	// Every read goes through here.
+	Byte ReadByte(uint32 address) const
+	{
+		if (!IsSpecial(address >> 8))
+		{
+			return Data[address];
+		}
+		
+		CheckWatch(address, WatchReads, false);
+		
+		return ReadMapped(address);
+	}
+	
+	
+	// A read that is not the CPU's: no watchpoints
+	Byte Peek(uint32 address) const
+	{
+		if (!IsSpecial(address >> 8))
+		{
+			return Data[address];
+		}
+		
+		return ReadMapped(address);
+	}
+	
+	
+	Byte ReadMapped(uint32 address) const
+	{
+		const Page& page = Pages[address >> 8];
+		
+		if (page.Read)
+		{
+			return page.Read[address & 0xFF];
+		}
+		
+		return page.Dev ? page.Dev->Read(page.Dev->Context, address) : 0xFF;	// open bus
+	}
+	
+	
+	// The page is about to change, save it for the snapshot if it has to be
+	FORCE_INLINE void Touch(uint32 page)
+	{
+		if (Shared[page >> 6] & (1ULL << (page & 63)))
+		{
+			Diverge(page);
+		}
+	}
+	
+	
+	void Diverge(uint32 page)
+	{
+		uint64 bit = 1ULL << (page & 63);
+		
+		if (!(Snap->Saved[page >> 6] & bit))
+		{
+			memcpy(Snap->Data + page * 256, Data + page * 256, 256);
+			Snap->Saved[page >> 6] |= bit;
+		}
+		
+		Shared[page >> 6] &= ~bit;
+	}
+	
+	
+	// Stops sharing with the active snapshot. Pages it never had to save are
+	// copied into it now, so it can still be restored later on.
+	void Detach()
+	{
+		if (!Snap)
+		{
+			return;
+		}
+		
+		for (uint32 page = 0; page < PAGES; page++)
+		{
+			Touch(page);
+		}
+		
+		Snap = nullptr;
+	}
+	
+	
+	// Every write goes through here.
+	void WriteByte(uint32 address, Byte val)
+	{
+		if (Observer)
+		{
+			Observer->Write(Observer->Context, address, val);
+		}
+		
+		Touch(address >> 8);
+		
+		if (!IsSpecial(address >> 8))
+		{
+			Data[address] = val;
+		}
+		else
+		{
+			CheckWatch(address, WatchWrites, true);
+			WriteMapped(address, val);
+		}
+		
+		PageWrites[address >> 8]++;
+		Dirty[address >> 14] |= 1ULL << ((address >> 8) & 63);
+	}
+	
+	
+	void WriteMapped(uint32 address, Byte val)
+	{
+		const Page& page = Pages[address >> 8];
+		
+		if (page.Write)
+		{
+			page.Write[address & 0xFF] = val;
+		}
+		else if (page.Dev)
+		{
+			page.Dev->Write(page.Dev->Context, address, val);
+		}
+		
+		// else ROM, the write is dropped
+	}
+	
+	
+	// What the non-const operator[] hands out, so `mem[addr] = val` still
+	// goes through WriteByte.
+	struct ByteRef
+	{
+		MEM& memory;
+		uint32 address;
+		
+		operator Byte() const
+		{
+			return memory.ReadByte(address);
+		}
+		
+		ByteRef& operator=(Byte val)
+		{
+			memory.WriteByte(address, val);
+			return *this;
+		}
+	};
+	
+	
+	Byte operator[](uint32 address) const
+	{
+		return ReadByte(address);
+	}
+	
+	
+	ByteRef operator[](uint32 address)
+	{
+		return ByteRef{ *this, address };
+	}
+	
+	
+	void WriteWord(sint32& cycles, uint32 address, Word val)
+	{
+		WriteByte(address,							val & 0xFF);
+		WriteByte((address + 1) & (MAX_MEM - 1),	(val >> 8));	// wraps at $FFFF like the real bus
+		
+		cycles -= 2;
+	}
+	
+	
+	// Bulk write for loaders: no cycles, no Observer (it is not the CPU
+	// writing), but counted like any write so decoded code sees it.
+	void Load(uint32 address, const Byte* data, uint32 size)
+	{
+		address &= MAX_MEM - 1;
+		
+		while (size > 0)
+		{
+			uint32 page = address >> 8;
+			uint32 chunk = 256 - (address & 0xFF);
+			
+			if (chunk > size)
+			{
+				chunk = size;
+			}
+			
+			Touch(page);
+			
+			if (!IsSpecial(page))
+			{
+				memcpy(Data + address, data, chunk);
+			}
+			else
+			{
+				for (uint32 i = 0; i < chunk; i++)
+				{
+					WriteMapped(address + i, data[i]);
+				}
+			}
+			
+			PageWrites[page]++;
+			Dirty[page >> 6] |= 1ULL << (page & 63);
+			
+			address = (address + chunk) & (MAX_MEM - 1);
+			data += chunk;
+			size -= chunk;
+		}
+	}
+};
+
+
+// NOTE: Other buses
+// The CPU core reads and writes through ReadByte/WriteByte on whatever bus
+// type it is handed (a template parameter, see CPU::ExecVariant), so these
+// can stand in for MEM with every access resolved at compile time. A bus
+// needs ReadByte(address), WriteByte(address, val) and Clear(); addresses
+// are always below MAX_MEM.
+
+// Plain 64 KiB of RAM and nothing else: no pages, devices, ROM, write
+// counters or watchpoints. For programs that need none of that.
+struct FlatBus
+{
+	Byte Data[MEM::MAX_MEM];
+	
+	void Clear()
+	{
+		memset(Data, 0, sizeof(Data));
+	}
+	
+	
+	Byte ReadByte(uint32 address) const
+	{
+		return Data[address];
+	}
+	
+	
+	void WriteByte(uint32 address, Byte val)
+	{
+		Data[address] = val;
+	}
+};
+
+
+// Wraps another bus, counts what goes through it and keeps the last RING
+// accesses (the oldest at (Reads + Writes) % RING once it has wrapped).
+template <typename Inner>
+struct TracingBus
+{
+	static constexpr uint32 RING = 256;
+	
+	struct Access
+	{
+		Word Address;
+		Byte Value;
+		Byte Write;		// 1 for a write
+	};
+	
+	Inner* Bus;
+	uint64 Reads;
+	uint64 Writes;
+	Access Ring[RING];
+	
+	void Init(Inner* bus)
+	{
+		Bus = bus;
+		Reads = Writes = 0;
+	}
+	
+	
+	void Clear()
+	{
+		Bus->Clear();
+	}
+	
+	
+	Byte ReadByte(uint32 address)
+	{
+		Byte val = Bus->ReadByte(address);
+		
+		Ring[(Reads + Writes) % RING] = Access{ (Word)address, val, 0 };
+		Reads++;
+		
+		return val;
+	}
+	
+	
+	void WriteByte(uint32 address, Byte val)
+	{
+		Ring[(Reads + Writes) % RING] = Access{ (Word)address, val, 1 };
+		Writes++;
+		
+		Bus->WriteByte(address, val);
+	}
+};
+
+
+// A MEM's RAM without the page table, for when there is nothing but RAM to
+// go through: nothing mapped or watched, no observer, no snapshot (the same
+// test the JIT makes, see Usable). Writes still bump the page counters and
+// dirty bits, so the block cache, AOT blocks and Clear keep working. Exec
+// and the AOT output switch to it on their own.
+struct RamBus
+{
+	MEM* Memory;
+	
+	static bool Usable(const MEM& memory)
+	{
+		return memory.Mapped == 0 && !memory.Observer && !memory.Snap;
+	}
+	
+	
+	void Clear()
+	{
+		Memory->Clear();
+	}
+	
+	
+	Byte ReadByte(uint32 address) const
+	{
+		return Memory->Data[address];
+	}
+	
+	
+	void WriteByte(uint32 address, Byte val)
+	{
+		Memory->Data[address] = val;
+		
+		Memory->PageWrites[address >> 8]++;
+		Memory->Dirty[address >> 14] |= 1ULL << ((address >> 8) & 63);
+	}
+};
+
+
+// NOTE: Program images
+// Loading programs into MEM from a file: raw binary (at a given address),
+// .prg (a 2-byte little endian load address, then raw), Intel HEX and
+// Motorola S-record. The format is picked from the contents (':' or 'S'
+// and a digit up front) and the .prg extension, everything else is raw.
+// Files are read through MappedFile, which maps them (or reads them in
+// where there is no mmap). A ROM that should not be copied at all can be
+// mapped straight into the bus: MappedFile, then MEM::MapRom on its Data.
+struct MappedFile
+{
+	const Byte* Data;
+	uint32 Size;
+	
+	void* Map;			// what to munmap, or the malloc'd copy
+	uint64 MapSize;
+	
+	bool Open(const char* path)
+	{
+		Data = nullptr;
+		Size = 0;
+		Map = nullptr;
+		MapSize = 0;
+		
+#if defined(__linux__)
+		int fd = open(path, O_RDONLY);
+		
+		if (fd < 0)
+		{
+			return false;
+		}
+		
+		struct stat info;
+		
+		if (fstat(fd, &info) != 0 || info.st_size > 0xFFFFFFFF)
+		{
+			close(fd);
+			return false;
+		}
+		
+		Size = info.st_size;
+		
+		if (Size)
+		{
+			// Rounds up to whole host pages, past the end of the file reads as 0
+			void* map = mmap(nullptr, Size, PROT_READ, MAP_PRIVATE, fd, 0);
+			
+			if (map == MAP_FAILED)
+			{
+				close(fd);
+				return false;
+			}
+			
+			Map = map;
+			MapSize = Size;
+			Data = (const Byte*)map;
+		}
+		
+		close(fd);
+		
+		return true;
+#else
+		FILE* file = fopen(path, "rb");
+		
+		if (!file)
+		{
+			return false;
+		}
+		
+		fseek(file, 0, SEEK_END);
+		Size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+		
+		// Whole 256-byte pages, so MapRom never reads past the end
+		MapSize = (Size + 255) & ~255u;
+		Map = calloc(MapSize ? MapSize : 1, 1);
+		
+		bool ok = fread(Map, 1, Size, file) == Size;
+		
+		fclose(file);
+		
+		Data = (const Byte*)Map;
+		
+		return ok;
+#endif
+	}
+	
+	
+	void Close()
+	{
+#if defined(__linux__)
+		if (Map)
+		{
+			munmap(Map, MapSize);
+		}
+#else
+		free(Map);
+#endif
+		Map = nullptr;
+		Data = nullptr;
+	}
+};
+
+
+struct ImageInfo
+{
+	uint32 First, Last;		// lowest and highest address loaded
+	uint32 Bytes;
+	sint32 Start;			// entry point given by the file, -1 if none
+	const char* Error;		// why Load failed
+};
+
+
+struct Image
+{
+	enum Format
+	{
+		RAW,
+		PRG,
+		INTEL_HEX,
+		S_RECORD
+	};
+	
+	static Format Detect(const char* path, const Byte* data, uint32 size)
+	{
+		uint32 length = strlen(path);
+		
+		if (length > 4 && path[length - 4] == '.' && (path[length - 3] | 0x20) == 'p'
+			&& (path[length - 2] | 0x20) == 'r' && (path[length - 1] | 0x20) == 'g')
+		{
+			return PRG;
+		}
+		
+		if (size > 0 && data[0] == ':')
+		{
+			return INTEL_HEX;
+		}
+		
+		if (size > 1 && data[0] == 'S' && data[1] >= '0' && data[1] <= '9')
+		{
+			return S_RECORD;
+		}
+		
+		return RAW;
+	}
+	
+	
+	// Loads path into memory, raw images at address load
+	static bool Load(MEM& memory, const char* path, uint32 load, ImageInfo& info)
+	{
+		MappedFile file;
+		
+		info = ImageInfo{ MEM::MAX_MEM, 0, 0, -1, nullptr };
+		
+		if (!file.Open(path))
+		{
+			info.Error = "can not open the file";
+			return false;
+		}
+		
+		bool ok = false;
+		
+		switch (Detect(path, file.Data, file.Size))
+		{
+			case RAW:
+			{
+				ok = LoadRaw(memory, file.Data, file.Size, load, info);
+			} break;
+			
+			case PRG:
+			{
+				ok = LoadPrg(memory, file.Data, file.Size, info);
+			} break;
+			
+			case INTEL_HEX:
+			{
+				ok = LoadIntelHex(memory, file.Data, file.Size, info);
+			} break;
+			
+			case S_RECORD:
+			{
+				ok = LoadSRecord(memory, file.Data, file.Size, info);
+			} break;
+		}
+		
+		file.Close();
+		
+		return ok;
+	}
+	
+	
+	static bool Put(MEM& memory, uint32 address, const Byte* data, uint32 size, ImageInfo& info)
+	{
+		// Not address + size, a HEX or S3 address near 4 GiB would wrap
+		if (address >= MEM::MAX_MEM || size > MEM::MAX_MEM - address)
+		{
+			info.Error = "data outside the 64 KiB address space";
+			return false;
+		}
+		
+		if (size == 0)
+		{
+			return true;
+		}
+		
+		memory.Load(address, data, size);
+		
+		info.First	= address < info.First ? address : info.First;
+		info.Last	= address + size - 1 > info.Last ? address + size - 1 : info.Last;
+		info.Bytes	+= size;
+		
+		return true;
+	}
+	
+	
+	static bool LoadRaw(MEM& memory, const Byte* data, uint32 size, uint32 load, ImageInfo& info)
+	{
+		return Put(memory, load, data, size, info);
+	}
+	
+	
+	static bool LoadPrg(MEM& memory, const Byte* data, uint32 size, ImageInfo& info)
+	{
+		if (size < 2)
+		{
+			info.Error = "no load address";
+			return false;
+		}
+		
+		uint32 load = data[0] | (data[1] << 8);
+		
+		info.Start = load;
+		
+		return Put(memory, load, data + 2, size - 2, info);
+	}
+	
+	
+	static sint32 HexDigit(Byte c)
+	{
+		if (c >= '0' && c <= '9') return c - '0';
+		if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+		if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+		
+		return -1;
+	}
+	
+	
+	// The hex pairs of one line (after the start code) as bytes. False on
+	// anything that is not a hex pair.
+	static bool HexBytes(const Byte* line, uint32 length, Byte* out, uint32& count)
+	{
+		if (length % 2 != 0 || length / 2 > 260)
+		{
+			return false;
+		}
+		
+		count = length / 2;
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			sint32 high = HexDigit(line[i * 2]);
+			sint32 low = HexDigit(line[i * 2 + 1]);
+			
+			if (high < 0 || low < 0)
+			{
+				return false;
+			}
+			
+			out[i] = (high << 4) | low;
+		}
+		
+		return true;
+	}
+	
+	
+	// Calls record(bytes, count) for every line starting with start, minus
+	// the start code and the line end. Empty lines are skipped.
+	template <typename Fn>
+	static bool Lines(const Byte* data, uint32 size, char start, ImageInfo& info, Fn record)
+	{
+		uint32 i = 0;
+		
+		while (i < size)
+		{
+			uint32 end = i;
+			
+			while (end < size && data[end] != '\n' && data[end] != '\r')
+			{
+				end++;
+			}
+			
+			if (end > i)
+			{
+				Byte bytes[260];
+				uint32 count;
+				
+				if (data[i] != start || !HexBytes(data + i + 1 + (start == 'S'), end - i - 1 - (start == 'S'), bytes, count))
+				{
+					info.Error = "malformed line";
+					return false;
+				}
+				
+				if (!record(data[i + 1], bytes, count))
+				{
+					return false;
+				}
+			}
+			
+			i = end + 1;
+		}
+		
+		return true;
+	}
+	
+	
+	// :LLAAAATT data CC, the checksum makes the bytes sum to 0
+	static bool LoadIntelHex(MEM& memory, const Byte* data, uint32 size, ImageInfo& info)
+	{
+		uint32 base = 0;
+		bool done = false;
+		
+		return Lines(data, size, ':', info, [&](Byte, const Byte* bytes, uint32 count)
+		{
+			Byte sum = 0;
+			
+			for (uint32 i = 0; i < count; i++)
+			{
+				sum += bytes[i];
+			}
+			
+			if (count < 5 || bytes[0] != count - 5 || sum != 0)
+			{
+				info.Error = count < 5 || bytes[0] != count - 5 ? "bad record length" : "bad checksum";
+				return false;
+			}
+			
+			if (done)
+			{
+				return true;	// anything after the end record
+			}
+			
+			uint32 address = (bytes[1] << 8) | bytes[2];
+			const Byte* payload = bytes + 4;
+			uint32 length = bytes[0];
+			
+			// Every type but data has a fixed length, the payload reads
+			// below count on it
+			static constexpr sint32 LENGTHS[] = { -1, 0, 2, 4, 2, 4 };
+			
+			if (bytes[3] < sizeof(LENGTHS) / sizeof(LENGTHS[0]) && LENGTHS[bytes[3]] >= 0 && length != (uint32)LENGTHS[bytes[3]])
+			{
+				info.Error = "bad record length";
+				return false;
+			}
+			
+			switch (bytes[3])
+			{
+				case 0x00:	// data
+				{
+					return Put(memory, base + address, payload, length, info);
+				}
+				
+				case 0x01:	// end of file
+				{
+					done = true;
+				} break;
+				
+				case 0x02:	// extended segment address
+				{
+					base = ((payload[0] << 8) | payload[1]) << 4;
+				} break;
+				
+				case 0x03:	// start segment address (CS:IP)
+				{
+					info.Start = ((((payload[0] << 8) | payload[1]) << 4) + ((payload[2] << 8) | payload[3])) & 0xFFFF;
+				} break;
+				
+				case 0x04:	// extended linear address
+				{
+					base = ((payload[0] << 8) | payload[1]) << 16;
+				} break;
+				
+				case 0x05:	// start linear address
+				{
+					info.Start = ((payload[2] << 8) | payload[3]);
+				} break;
+			}
+			
+			return true;
+		});
+	}
+	
+	
+	// Stn LL AAAA data CC, LL counts address, data and checksum, and the
+	// checksum is the one's complement of their sum
+	static bool LoadSRecord(MEM& memory, const Byte* data, uint32 size, ImageInfo& info)
+	{
+		return Lines(data, size, 'S', info, [&](Byte type, const Byte* bytes, uint32 count)
+		{
+			Byte sum = 0;
+			
+			for (uint32 i = 0; i < count; i++)
+			{
+				sum += bytes[i];
+			}
+			
+			if (count < 3 || bytes[0] != count - 1 || sum != 0xFF)
+			{
+				info.Error = count < 3 || bytes[0] != count - 1 ? "bad record length" : "bad checksum";
+				return false;
+			}
+			
+			// Address bytes per record type, 0 for the ones without data
+			uint32 width = 0;
+			bool start = false;
+			
+			switch (type)
+			{
+				case '1': width = 2; break;
+				case '2': width = 3; break;
+				case '3': width = 4; break;
+				case '9': width = 2; start = true; break;
+				case '8': width = 3; start = true; break;
+				case '7': width = 4; start = true; break;
+				default: return true;	// header and counts
+			}
+			
+			if (count < 2 + width)
+			{
+				info.Error = "bad record length";
+				return false;
+			}
+			
+			uint32 address = 0;
+			
+			for (uint32 i = 0; i < width; i++)
+			{
+				address = (address << 8) | bytes[1 + i];
+			}
+			
+			if (start)
+			{
+				info.Start = address & 0xFFFF;
+				return true;
+			}
+			
+			return Put(memory, address, bytes + 1 + width, count - 2 - width, info);
+		});
+	}
+};
+
+
+// NOTE: Block cache
+// Straight-line runs of code decoded once into micro-ops (operands already
+// fetched, cycle cost summed) and replayed by CPU::ExecCached. Direct mapped
+// on the start PC. A block remembers the write count of the (at most two)
+// pages its bytes live on and is thrown away when either one moves, which
+// is what keeps self-modifying code honest.
+struct CPU;
+
+struct BlockCache
+{
+	static constexpr uint32 MAX_OPS = 32;		// micro-ops per block
+	static constexpr uint32 SLOTS	= 4096;		// blocks in the cache
+	
+	using DecodedHandler = void (*)(CPU& cpu, sint32& cycles, MEM& memory, Word operand);
+	
+	struct MicroOp
+	{
+		DecodedHandler Do;
+		Word Operand;	// immediate value or address, already fetched
+		Word Next;		// PC after this instruction
+		Byte Opcode;
+		Byte Cycles;
+		Byte Flags;
+	};
+	
+	// Native code for a block (see Jit). Leaves the CPU where the block
+	// got to (registers, flags, PC, Instructions) and returns the cycles it
+	// took, or -1 without doing anything if it can not run from this state.
+	using NativeCode = sint32 (*)(CPU* cpu, MEM* memory);
+	
+	struct Block
+	{
+		Word Start;
+		Byte Count;		// 0 = empty slot
+		Byte Flags;		// all micro-op flags OR'ed together
+		Byte Page[2];
+		uint32 Writes[2];
+		sint32 Cycles;
+		sint32 Extra;			// most the Do_ handlers can take on top (page crossings, branches)
+		uint32 Entries;			// times run since decoded, for finding hot blocks
+		NativeCode Native;		// compiled by the JIT, or nullptr
+		uint32 NativeEpoch;		// Native is only good while this matches Jit::Epoch
+		MicroOp Ops[MAX_OPS];
+	};
+	
+	Block Slots[SLOTS];
+	
+	// Stats
+	uint64 Hits, Misses, Invalidations;
+	
+	void Init()
+	{
+		for (uint32 i = 0; i < SLOTS; i++)
+		{
+			Slots[i].Count = 0;
+		}
+		
+		Hits = Misses = Invalidations = 0;
+	}
+	
+	
+	Block& SlotFor(Word pc)
+	{
+		return Slots[(pc ^ (pc >> 12)) & (SLOTS - 1)];
+	}
+	
+	
+	static bool IsValid(const Block& block, const MEM& memory)
+	{
+		return block.Writes[0] == memory.PageWrites[block.Page[0]]
+			&& block.Writes[1] == memory.PageWrites[block.Page[1]];
+	}
+	
+	
+	void PrintStats() const
+	{
+		uint64 lookups = Hits + Misses + Invalidations;
+		
+		printf("blocks: lookups=%llu hits=%llu misses=%llu invalidations=%llu hit_rate=%.2f%%\n",
+			lookups, Hits, Misses, Invalidations, lookups ? 100.0 * Hits / lookups : 0.0);
+	}
+};
+
+
+// NOTE: JIT
+// Turns hot blocks into x86-64 code in one mmap'd arena. A/X/Y, NZ and the
+// flags live in host registers for the length of a block, memory is
+// addressed straight off MEM::Data. Loads, stores, transfers, the ALU,
+// shifts, PHA/PLA, jumps and branches are compiled; a block with anything
+// else (PHP, PLP, SED, BRK, RTI, JMP indirect) is left to the interpreter,
+// and so is one with ADC/SBC while D is set. A store into the block's own
+// pages leaves the native code right after it, like the interpreter does.
+// The arena is mapped twice, read/write for Compile and read/execute for
+// running it, so no page is ever both (and compiling costs no mprotect
+// calls, which matters for code that keeps invalidating itself). When it
+// fills up it is reset and Epoch moves on, which orphans every compiled
+// block at once.
+struct Jit
+{
+	static constexpr uint32 ARENA_SIZE	= 4 * 1024 * 1024;
+	static constexpr uint32 MAX_CODE	= 4096;		// most one block can take
+	static constexpr uint32 HOT			= 16;		// entries before a block is compiled
+	
+	Byte* Arena;		// where the code runs from
+	Byte* Writable;		// the same memory, where it is written
+	uint32 Used;
+	uint32 Epoch;
+	
+	// Stats
+	uint64 Compiled, Rejected, NativeRuns, Flushes;
+	
+	bool Init()
+	{
+		Used = 0;
+		Epoch = 1;
+		Compiled = Rejected = NativeRuns = Flushes = 0;
+		Arena = Writable = nullptr;
+		
+#if JIT_AVAILABLE
+		int fd = memfd_create("pal6502-jit", MFD_CLOEXEC);
+		
+		if (fd < 0)
+		{
+			return false;
+		}
+		
+		if (ftruncate(fd, ARENA_SIZE) == 0)
+		{
+			void* writable = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			void* arena = mmap(nullptr, ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+			
+			if (writable != MAP_FAILED && arena != MAP_FAILED)
+			{
+				Writable = (Byte*)writable;
+				Arena = (Byte*)arena;
+			}
+			else
+			{
+				if (writable != MAP_FAILED) munmap(writable, ARENA_SIZE);
+				if (arena != MAP_FAILED) munmap(arena, ARENA_SIZE);
+			}
+		}
+		
+		// The mappings keep the memory
+		close(fd);
+#endif
+		
+		return Arena != nullptr;
+	}
+	
+	
+	void Free()
+	{
+#if JIT_AVAILABLE
+		if (Arena)
+		{
+			munmap(Arena, ARENA_SIZE);
+			munmap(Writable, ARENA_SIZE);
+		}
+#endif
+		Arena = Writable = nullptr;
+	}
+	
+	
+	bool IsNative(const BlockCache::Block& block) const
+	{
+		return block.Native != nullptr && block.NativeEpoch == Epoch;
+	}
+	
+	
+	// Compiles block into the arena. Returns false (and leaves the block to
+	// the interpreter) if it holds something the compiler can not do.
+	bool Compile(BlockCache::Block& block);
+	
+	
+	void PrintStats() const
+	{
+		printf("jit: compiled=%llu rejected=%llu native_runs=%llu flushes=%llu arena_used=%u\n",
+			Compiled, Rejected, NativeRuns, Flushes, Used);
+	}
+};
+
+
+// NOTE: Event scheduler
+// Devices do not get ticked every cycle. They post an event at the absolute
+// cycle they next need attention, and CPU::ExecScheduled runs the CPU flat
+// out up to the earliest one.
+// The events sit in a timing wheel: SLOTS buckets of 2^GRAIN cycles each,
+// so posting is a push onto a bucket list and finding the next deadline is
+// a ctz over the bitmap of non-empty buckets. Events further out than the
+// wheel reaches wait in an unsorted overflow list and move into the wheel
+// once it gets near them. Events due on the same cycle fire in no
+// particular order.
+struct Scheduler
+{
+	static constexpr uint32 SLOTS		= 256;
+	static constexpr uint32 GRAIN		= 6;		// bucket width is 64 cycles
+	static constexpr uint32 MAX_EVENTS	= 1024;
+	static constexpr uint32 NONE		= ~0u;
+	static constexpr uint64 NEVER		= ~0ULL;
+	
+	// Called with Now set to the cycle the event was posted for
+	using Callback = void (*)(void* context, Scheduler& scheduler);
+	
+	struct Event
+	{
+		uint64 When;
+		Callback Fire;
+		void* Context;
+		uint32 Next;	// next event in the same list, or NONE
+	};
+	
+	uint64 Now;			// cycles since Init
+	uint64 Deadline;	// When of the earliest pending event, or NEVER
+	
+	Event Events[MAX_EVENTS];
+	uint32 FreeList;
+	
+	uint32 Slots[SLOTS];			// list heads
+	uint64 Occupied[SLOTS / 64];	// bit set = slot list not empty
+	
+	uint32 Overflow;
+	uint64 OverflowMin;
+	
+	// Stats
+	uint64 Fired;
+	
+	void Init()
+	{
+		Now = 0;
+		Deadline = NEVER;
+		
+		for (uint32 i = 0; i < MAX_EVENTS; i++)
+		{
+			Events[i].Next = i + 1 < MAX_EVENTS ? i + 1 : NONE;
+		}
+		
+		FreeList = 0;
+		
+		for (uint32 i = 0; i < SLOTS; i++)
+		{
+			Slots[i] = NONE;
+		}
+		
+		for (uint32 w = 0; w < SLOTS / 64; w++)
+		{
+			Occupied[w] = 0;
+		}
+		
+		Overflow = NONE;
+		OverflowMin = NEVER;
+		
+		Fired = 0;
+	}
+	
+	
+	// False when all MAX_EVENTS are pending already. A time in the past
+	// fires as soon as possible.
+	bool Post(uint64 when, Callback fire, void* context)
+	{
+		if (FreeList == NONE)
+		{
+			return false;
+		}
+		
+		uint32 e = FreeList;
+		FreeList = Events[e].Next;
+		
+		Events[e].When		= when < Now ? Now : when;
+		Events[e].Fire		= fire;
+		Events[e].Context	= context;
+		
+		Insert(e);
+		
+		if (Events[e].When < Deadline)
+		{
+			Deadline = Events[e].When;
+		}
+		
+		return true;
+	}
+	
+	
+	bool InWheel(uint64 when) const
+	{
+		return (when >> GRAIN) - (Now >> GRAIN) < SLOTS;
+	}
+	
+	
+	void Insert(uint32 e)
+	{
+		uint64 when = Events[e].When;
+		
+		if (InWheel(when))
+		{
+			uint32 slot = (when >> GRAIN) & (SLOTS - 1);
+			
+			Events[e].Next = Slots[slot];
+			Slots[slot] = e;
+			Occupied[slot >> 6] |= 1ULL << (slot & 63);
+		}
+		else
+		{
+			Events[e].Next = Overflow;
+			Overflow = e;
+			
+			if (when < OverflowMin)
+			{
+				OverflowMin = when;
+			}
+		}
+	}
+	
+	
+	// Moves everything the wheel now reaches out of the overflow list.
+	void Migrate()
+	{
+		uint32 e = Overflow;
+		
+		Overflow = NONE;
+		OverflowMin = NEVER;
+		
+		while (e != NONE)
+		{
+			uint32 next = Events[e].Next;
+			
+			Insert(e);
+			
+			e = next;
+		}
+	}
+	
+	
+	// Earliest pending When, walking the wheel from Now's slot on.
+	uint64 FindDeadline()
+	{
+		if (OverflowMin != NEVER && InWheel(OverflowMin))
+		{
+			Migrate();
+		}
+		
+		uint32 start = (Now >> GRAIN) & (SLOTS - 1);
+		
+		for (uint32 i = 0; i <= SLOTS / 64; i++)
+		{
+			// Bits from start on, wrapping round once
+			uint32 w = ((start >> 6) + i) % (SLOTS / 64);
+			uint64 bits = Occupied[w];
+			
+			if (i == 0)
+			{
+				bits &= ~0ULL << (start & 63);
+			}
+			else if (i == SLOTS / 64)
+			{
+				bits &= (1ULL << (start & 63)) - 1;
+			}
+			
+			if (bits)
+			{
+				uint32 slot = w * 64 + __builtin_ctzll(bits);
+				uint64 best = NEVER;
+				
+				for (uint32 e = Slots[slot]; e != NONE; e = Events[e].Next)
+				{
+					if (Events[e].When < best)
+					{
+						best = Events[e].When;
+					}
+				}
+				
+				return best < OverflowMin ? best : OverflowMin;
+			}
+		}
+		
+		return OverflowMin;
+	}
+	
+	
+	// Moves time forward to `to`, firing every event due on the way in
+	// time order.
+	void RunUntil(uint64 to)
+	{
+		while (Deadline <= to)
+		{
+			Now = Deadline;
+			
+			// Take the due events off their slot first, so callbacks can
+			// post again (into the same slot too) while they run.
+			uint32 slot = (Now >> GRAIN) & (SLOTS - 1);
+			uint32 due = NONE;
+			uint32 e = Slots[slot];
+			
+			Slots[slot] = NONE;
+			
+			while (e != NONE)
+			{
+				uint32 next = Events[e].Next;
+				
+				if (Events[e].When == Now)
+				{
+					Events[e].Next = due;
+					due = e;
+				}
+				else
+				{
+					Events[e].Next = Slots[slot];
+					Slots[slot] = e;
+				}
+				
+				e = next;
+			}
+			
+			if (Slots[slot] == NONE)
+			{
+				Occupied[slot >> 6] &= ~(1ULL << (slot & 63));
+			}
+			
+			Deadline = FindDeadline();
+			
+			while (due != NONE)
+			{
+				uint32 next = Events[due].Next;
+				
+				Events[due].Next = FreeList;
+				FreeList = due;
+				
+				Events[due].Fire(Events[due].Context, *this);
+				Fired++;
+				
+				due = next;
+			}
+		}
+		
+		Now = to;
+	}
+};
+
+
+// NOTE: Profiling
+// Per-opcode and per-PC execution counts plus cycles per PC, filled in by
+// CPU::Dispatch and the threaded interpreter while CPU::Counters points at
+// one. Built in only with PROFILE=1 (see the Makefile), otherwise the hooks
+// and the Counters member are not there at all.
+// Only instructions that go through the interpreter are counted, blocks run
+// by ExecCached and the JIT are not.
+
+struct Profile
+{
+	uint64 Opcodes[256];
+	uint64 Pcs[MEM::MAX_MEM];
+	uint64 Cycles[MEM::MAX_MEM];
+	
+	void Clear()
+	{
+		memset(this, 0, sizeof(*this));
+	}
+	
+	
+	FORCE_INLINE void Count(Word pc, Byte opcode, sint32 cycles)
+	{
+		Opcodes[opcode]++;
+		Pcs[pc]++;
+		Cycles[pc] += cycles;
+	}
+	
+	
+	struct Entry
+	{
+		uint64 Key;
+		uint32 Index;
+	};
+	
+	static int ByKeyDescending(const void* a, const void* b)
+	{
+		uint64 x = ((const Entry*)a)->Key;
+		uint64 y = ((const Entry*)b)->Key;
+		
+		return x < y ? 1 : x > y ? -1 : 0;
+	}
+	
+	
+	// The opcodes by count, then the `top` PCs by cycles spent there
+	void Report(FILE* out, uint32 top) const
+	{
+		Entry* entries = new Entry[MEM::MAX_MEM];
+		
+		uint64 instructions = 0, cycles = 0;
+		
+		for (uint32 i = 0; i < 256; i++)
+		{
+			entries[i] = Entry{ Opcodes[i], i };
+			instructions += Opcodes[i];
+		}
+		
+		qsort(entries, 256, sizeof(Entry), ByKeyDescending);
+		
+		fprintf(out, "opcodes: instructions=%llu\n", instructions);
+		
+		for (uint32 i = 0; i < 256 && entries[i].Key; i++)
+		{
+			const char* name = OP_INFO.Ops[entries[i].Index].Name;
+			
+			fprintf(out, "  %02X %-8s count=%llu share=%.2f%%\n", entries[i].Index, name ? name : "???",
+				entries[i].Key, 100.0 * entries[i].Key / instructions);
+		}
+		
+		for (uint32 i = 0; i < MEM::MAX_MEM; i++)
+		{
+			entries[i] = Entry{ Cycles[i], i };
+			cycles += Cycles[i];
+		}
+		
+		qsort(entries, MEM::MAX_MEM, sizeof(Entry), ByKeyDescending);
+		
+		fprintf(out, "pcs: cycles=%llu top=%u\n", cycles, top);
+		
+		for (uint32 i = 0; i < top && i < MEM::MAX_MEM && entries[i].Key; i++)
+		{
+			uint32 pc = entries[i].Index;
+			
+			fprintf(out, "  %04X cycles=%llu count=%llu share=%.2f%%\n", pc,
+				Cycles[pc], Pcs[pc], 100.0 * Cycles[pc] / cycles);
+		}
+		
+		delete[] entries;
+	}
+};
+
+
+// NOTE: Trace
+// Flight recorder for the last Capacity instructions, filled in by
+// CPU::ExecHooked while CPU::Tracer points at one. Fixed-size records in a
+// power-of-two ring. The emulation thread only ever bumps Head, so it never
+// waits; a consumer on another thread drains behind it with Drain, and when
+// it falls more than a ring behind the oldest records are overwritten and
+// counted as Dropped instead of holding the CPU up.
+struct Trace
+{
+	// The state an instruction starts from, 16 bytes
+	struct Record
+	{
+		uint32 Cycle;	// low 32 bits of Trace::Cycle when it started
+		Word PC;
+		Word SP;
+		Byte Opcode;
+		Byte A, X, Y;
+		Byte P;			// CPU::GetStatus()
+		Byte Pad[3];
+	};
+	
+	static_assert(sizeof(Record) == 16, "trace records are written to disk as is");
+	
+	// Dump file: this header, then Count records oldest first
+	struct FileHeader
+	{
+		char Magic[4];		// "P6TR"
+		uint32 Version;		// 1
+		uint32 RecordSize;
+		uint32 Count;
+		uint64 Total;		// records ever pushed, the last one in the file is Total - 1
+	};
+	
+	Record* Records;
+	uint32 Mask;
+	
+	std::atomic<uint64> Head;	// records ever pushed, emulation thread writes
+	uint64 Cycle;				// cycles run under the trace, emulation thread only
+	
+	uint64 Tail;				// consumer side
+	uint64 Dropped;
+	
+	const char* TrapPath;		// Dump goes here on an unknown opcode, if set
+	
+	// capacity is rounded up to a power of two
+	void Init(uint32 capacity)
+	{
+		uint32 size = 1;
+		
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		
+		Records = new Record[size];
+		Mask = size - 1;
+		
+		Head.store(0);
+		Cycle = 0;
+		
+		Tail = 0;
+		Dropped = 0;
+		
+		TrapPath = nullptr;
+	}
+	
+	
+	void Free()
+	{
+		delete[] Records;
+	}
+	
+	
+	// Emulation thread
+	FORCE_INLINE void Push(const Record& record)
+	{
+		uint64 head = Head.load(std::memory_order_relaxed);
+		
+		Records[head & Mask] = record;
+		
+		Head.store(head + 1, std::memory_order_release);
+	}
+	
+	
+	// Consumer thread. Copies up to max of the records not drained yet into
+	// out and returns how many. A record the producer may have overwritten
+	// while it was being copied is not returned (it is counted in Dropped).
+	// Push may be halfway through writing record Head, which lands on the
+	// slot of Head - capacity, so that one counts as lapped already.
+	uint32 Drain(Record* out, uint32 max)
+	{
+		uint64 capacity = Mask + 1;
+		uint64 head = Head.load(std::memory_order_acquire);
+		
+		if (head + 1 - Tail > capacity)
+		{
+			Dropped += head + 1 - capacity - Tail;
+			Tail = head + 1 - capacity;
+		}
+		
+		uint32 count = head - Tail < max ? head - Tail : max;
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			out[i] = Records[(Tail + i) & Mask];
+		}
+		
+		// Anything the producer lapped while we were copying is suspect
+		std::atomic_thread_fence(std::memory_order_acquire);
+		
+		uint64 after = Head.load(std::memory_order_relaxed);
+		uint32 lost = 0;
+		
+		if (after + 1 - Tail > capacity)
+		{
+			uint64 lapped = after + 1 - capacity - Tail;
+			
+			lost = lapped < count ? lapped : count;
+		}
+		
+		if (lost)
+		{
+			memmove(out, out + lost, (count - lost) * sizeof(Record));
+			Dropped += lost;
+		}
+		
+		Tail += count;
+		
+		return count - lost;
+	}
+	
+	
+	// Writes the last (up to) Capacity records. Meant for the emulation
+	// thread, or for after it stopped.
+	bool Dump(const char* path) const
+	{
+		FILE* file = fopen(path, "wb");
+		
+		if (!file)
+		{
+			return false;
+		}
+		
+		uint64 head = Head.load(std::memory_order_acquire);
+		uint64 count = head < Mask + 1 ? head : Mask + 1;
+		
+		FileHeader header = { { 'P', '6', 'T', 'R' }, 1, sizeof(Record), (uint32)count, head };
+		
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		
+		for (uint64 i = head - count; ok && i < head; i++)
+		{
+			ok = fwrite(&Records[i & Mask], sizeof(Record), 1, file) == 1;
+		}
+		
+		return fclose(file) == 0 && ok;
+	}
+};
+
+
+// NOTE: Delta trace
+// A trace file for runs too long to keep every record whole. Each
+// instruction is stored as what could not be guessed from the one before:
+//	1 bit	PC is the previous PC plus the previous instruction's length,
+//			else 16 bits of PC
+//	1 bit	opcode is the byte at PC in the reader's copy of memory, else 8
+//	1 bit	cycles are the ISA's base cycles, else 8
+//	1 bit	X, Y and SP did not change and P is what A gives, then 1 bit
+//			A changed (and 8 bits of it), else a changed bit per A, X, Y
+//			(8 bits each if set) and SP (16), and 1 bit for P as
+//			predicted, else 8
+//	per memory write: 1 bit set, 1 bit address is the last one plus 1,
+//			else 16 bits of address, 8 bits of value
+//	1 bit	clear, no more writes
+// Registers are the state after the instruction. Every Interval records
+// there is a byte-aligned keyframe with the full state and a copy of
+// memory, so a reader can start from any of them; their file offsets go in
+// an index at the end.
+struct DeltaTrace
+{
+	static constexpr uint32 MAX_WRITES	= 8;	// per instruction, a 6502 does 3 at most
+	static constexpr uint32 BUFFER		= 64 * 1024;
+	
+	struct FileHeader
+	{
+		char Magic[4];		// "P6DT"
+		uint32 Version;		// 1
+		uint32 Interval;	// records per keyframe
+		uint32 Pad;
+	};
+	
+	struct FileFooter
+	{
+		uint64 Records;
+		uint64 IndexOffset;		// Keyframes x (record index, file offset), 2 uint64 each
+		uint32 Keyframes;
+		char Magic[4];			// "P6DT"
+	};
+	
+	// What both sides predict from. The keyframe writes it out as is, then
+	// the memory copy.
+	struct State
+	{
+		uint64 Index;	// records before this point
+		uint64 Cycle;
+		Word NextPC;	// guess for the next record's PC
+		Word SP;
+		Byte A, X, Y, P;
+	};
+	
+	struct Record
+	{
+		uint64 Index;
+		uint64 Cycle;	// when it started
+		Word PC;
+		Byte Opcode;
+		Byte Cycles;
+		Byte A, X, Y, P;	// after
+		Word SP;			// after
+		uint32 Writes;
+		Word WriteAddress[MAX_WRITES];
+		Byte WriteValue[MAX_WRITES];
+	};
+	
+	// P after an instruction, if it only touched N and Z and took them
+	// from the register it wrote (loads, transfers, logic, INX and so on)
+	static Byte PredictP(Byte p, Byte opcode, Byte a, Byte x, Byte y)
+	{
+		switch (OP_INFO.Ops[opcode].Instruction)
+		{
+			case MN_LDA: case MN_AND: case MN_ORA: case MN_EOR: case MN_PLA: case MN_TXA: case MN_TYA:
+			{
+			} break;
+			
+			case MN_LDX: case MN_TAX: case MN_TSX: case MN_INX: case MN_DEX:
+			{
+				a = x;
+			} break;
+			
+			case MN_LDY: case MN_TAY: case MN_INY: case MN_DEY:
+			{
+				a = y;
+			} break;
+			
+			default:
+			{
+				return p;
+			} break;
+		}
+		
+		return (p & 0b01111101) | (a == 0 ? 0b00000010 : 0) | (a & 0b10000000);
+	}
+};
+
+
+struct DeltaTraceWriter
+{
+	FILE* File;
+	uint32 Interval;
+	
+	DeltaTrace::State State;
+	Byte Memory[MEM::MAX_MEM];		// what the reader will think memory holds
+	
+	// This instruction's writes, from the MEM observer
+	uint32 Writes;
+	Word WriteAddress[DeltaTrace::MAX_WRITES];
+	Byte WriteValue[DeltaTrace::MAX_WRITES];
+	
+	WriteObserver Observer;
+	
+	// Bit packing
+	uint64 Bits;
+	uint32 BitCount;
+	Byte Buffer[DeltaTrace::BUFFER];
+	uint32 Used;
+	uint64 Offset;		// bytes out so far, buffered ones included
+	
+	// Keyframe (record index, offset) pairs for the footer
+	uint64* Index;
+	uint32 Keyframes, IndexCapacity;
+	
+	bool Ok;
+	
+	// Starts a trace of cpu/memory from where they are now. Hooks itself
+	// into both; Close unhooks.
+	bool Open(const char* path, CPU& cpu, MEM& memory, uint32 interval);
+	
+	bool Close(CPU& cpu, MEM& memory);
+	
+	// After every instruction, from CPU::ExecHooked
+	void Record(const CPU& cpu, Word pc, Byte opcode, sint32 cycles);
+	
+	static void ObserveWrite(void* context, uint32 address, Byte val)
+	{
+		DeltaTraceWriter* writer = (DeltaTraceWriter*)context;
+		
+		if (writer->Writes < DeltaTrace::MAX_WRITES)
+		{
+			writer->WriteAddress[writer->Writes] = address;
+			writer->WriteValue[writer->Writes] = val;
+			writer->Writes++;
+		}
+	}
+	
+	
+	void Flush()
+	{
+		if (Used && fwrite(Buffer, 1, Used, File) != Used)
+		{
+			Ok = false;
+		}
+		
+		Used = 0;
+	}
+	
+	
+	FORCE_INLINE void PutByte(Byte b)
+	{
+		Buffer[Used++] = b;
+		Offset++;
+		
+		if (Used == DeltaTrace::BUFFER)
+		{
+			Flush();
+		}
+	}
+	
+	
+	// count <= 32
+	FORCE_INLINE void Put(uint32 value, uint32 count)
+	{
+		Bits |= (uint64)value << BitCount;
+		BitCount += count;
+		
+		while (BitCount >= 8)
+		{
+			PutByte((Byte)Bits);
+			
+			Bits >>= 8;
+			BitCount -= 8;
+		}
+	}
+	
+	
+	void Align()
+	{
+		if (BitCount)
+		{
+			PutByte((Byte)Bits);
+		}
+		
+		Bits = 0;
+		BitCount = 0;
+	}
+	
+	
+	void PutBytes(const void* data, uint32 size)
+	{
+		for (uint32 i = 0; i < size; i++)
+		{
+			PutByte(((const Byte*)data)[i]);
+		}
+	}
+	
+	
+	void Keyframe()
+	{
+		Align();
+		
+		if (Keyframes == IndexCapacity)
+		{
+			IndexCapacity = IndexCapacity ? IndexCapacity * 2 : 64;
+			
+			uint64* index = new uint64[IndexCapacity * 2];
+			
+			if (Index)
+			{
+				memcpy(index, Index, Keyframes * 2 * sizeof(uint64));
+				delete[] Index;
+			}
+			
+			Index = index;
+		}
+		
+		Index[Keyframes * 2]		= State.Index;
+		Index[Keyframes * 2 + 1]	= Offset;
+		Keyframes++;
+		
+		PutBytes(&State, sizeof(State));
+		PutBytes(Memory, sizeof(Memory));
+	}
+};
+
+
+struct DeltaTraceReader
+{
+	FILE* File;
+	DeltaTrace::FileHeader Header;
+	DeltaTrace::FileFooter Footer;
+	uint64* Index;
+	
+	DeltaTrace::State State;
+	Byte Memory[MEM::MAX_MEM];
+	
+	uint64 Bits;
+	uint32 BitCount;
+	Byte Buffer[DeltaTrace::BUFFER];
+	uint32 Used, Size;
+	
+	bool Fresh;		// a keyframe was just read, the next record comes after it
+	
+	bool Open(const char* path)
+	{
+		Index = nullptr;
+		File = fopen(path, "rb");
+		
+		if (!File || fread(&Header, sizeof(Header), 1, File) != 1 || memcmp(Header.Magic, "P6DT", 4) != 0
+			|| fseek(File, -(long)sizeof(Footer), SEEK_END) != 0 || fread(&Footer, sizeof(Footer), 1, File) != 1
+			|| memcmp(Footer.Magic, "P6DT", 4) != 0 || Footer.Keyframes == 0)
+		{
+			Close();
+			return false;
+		}
+		
+		Index = new uint64[Footer.Keyframes * 2];
+		
+		if (fseek(File, (long)Footer.IndexOffset, SEEK_SET) != 0
+			|| fread(Index, sizeof(uint64) * 2, Footer.Keyframes, File) != Footer.Keyframes)
+		{
+			Close();
+			return false;
+		}
+		
+		return Seek(0);
+	}
+	
+	
+	void Close()
+	{
+		if (File)
+		{
+			fclose(File);
+		}
+		
+		delete[] Index;
+		
+		File = nullptr;
+		Index = nullptr;
+	}
+	
+	
+	// Next reads the keyframe's first record after this
+	bool Seek(uint32 keyframe)
+	{
+		if (keyframe >= Footer.Keyframes || fseek(File, (long)Index[keyframe * 2 + 1], SEEK_SET) != 0)
+		{
+			return false;
+		}
+		
+		Used = Size = 0;
+		
+		return ReadKeyframe();
+	}
+	
+	
+	Byte GetByte()
+	{
+		if (Used == Size)
+		{
+			Size = fread(Buffer, 1, DeltaTrace::BUFFER, File);
+			Used = 0;
+			
+			if (Size == 0)
+			{
+				return 0;
+			}
+		}
+		
+		return Buffer[Used++];
+	}
+	
+	
+	// count <= 32
+	FORCE_INLINE uint32 Get(uint32 count)
+	{
+		while (BitCount < count)
+		{
+			Bits |= (uint64)GetByte() << BitCount;
+			BitCount += 8;
+		}
+		
+		uint32 value = Bits & ((1ULL << count) - 1);
+		
+		Bits >>= count;
+		BitCount -= count;
+		
+		return value;
+	}
+	
+	
+	bool GetBytes(void* data, uint32 size)
+	{
+		for (uint32 i = 0; i < size; i++)
+		{
+			((Byte*)data)[i] = GetByte();
+		}
+		
+		return Size != 0;
+	}
+	
+	
+	bool ReadKeyframe()
+	{
+		Bits = 0;
+		BitCount = 0;
+		Fresh = true;
+		
+		return GetBytes(&State, sizeof(State)) && GetBytes(Memory, sizeof(Memory));
+	}
+	
+	
+	// False at the end of the trace
+	bool Next(DeltaTrace::Record& record)
+	{
+		if (State.Index >= Footer.Records)
+		{
+			return false;
+		}
+		
+		if (!Fresh && State.Index % Header.Interval == 0 && !ReadKeyframe())
+		{
+			return false;
+		}
+		
+		Fresh = false;
+		
+		record.Index	= State.Index;
+		record.Cycle	= State.Cycle;
+		record.PC		= Get(1) ? State.NextPC : Get(16);
+		record.Opcode	= Get(1) ? Memory[record.PC] : Get(8);
+		record.Cycles	= Get(1) ? OP_INFO.Ops[record.Opcode].Cycles : Get(8);
+		
+		record.X	= State.X;
+		record.Y	= State.Y;
+		record.SP	= State.SP;
+		
+		if (Get(1))
+		{
+			record.A = Get(1) ? Get(8) : State.A;
+			record.P = DeltaTrace::PredictP(State.P, record.Opcode, record.A, record.X, record.Y);
+		}
+		else
+		{
+			record.A	= Get(1) ? Get(8) : State.A;
+			record.X	= Get(1) ? Get(8) : State.X;
+			record.Y	= Get(1) ? Get(8) : State.Y;
+			record.SP	= Get(1) ? Get(16) : State.SP;
+			record.P	= Get(1) ? DeltaTrace::PredictP(State.P, record.Opcode, record.A, record.X, record.Y) : Get(8);
+		}
+		
+		record.Writes = 0;
+		
+		Word address = 0;
+		
+		while (Get(1))
+		{
+			address = Get(1) ? address + 1 : Get(16);
+			
+			Byte val = Get(8);
+			
+			if (record.Writes < DeltaTrace::MAX_WRITES)
+			{
+				record.WriteAddress[record.Writes] = address;
+				record.WriteValue[record.Writes] = val;
+				record.Writes++;
+			}
+			
+			Memory[address] = val;
+		}
+		
+		State.Index++;
+		State.Cycle		+= record.Cycles;
+		State.NextPC	= record.PC + OP_INFO.Ops[record.Opcode].Bytes;
+		State.A			= record.A;
+		State.X			= record.X;
+		State.Y			= record.Y;
+		State.P			= record.P;
+		State.SP		= record.SP;
+		
+		return true;
+	}
+};
+
+
+// NOTE: Undo log
+// Reverse execution. While CPU::History points at one, ExecHooked logs the
+// registers every instruction starts from and the old value of every byte
+// it writes, append only, so stepping back n instructions is undoing the
+// last n entries: it costs the distance, not the length of the run. Every
+// Interval instructions there is also a full checkpoint (Data), and a
+// target closer to a checkpoint than to the present is reached by
+// restoring that and running forward instead.
+// Only plain RAM is logged; writes to ROM, devices and remapped pages are
+// not undone, and running forward again assumes devices do not matter.
+struct UndoLog
+{
+	struct Step
+	{
+		uint32 FirstWrite;		// its writes are Writes[FirstWrite] up to the next step's
+		Word PC, SP, NZ;
+		Byte A, X, Y;
+		Byte Flags;				// CPU::Flags
+		Byte Cycles;
+		Byte Pad;
+	};
+	
+	struct WriteEntry
+	{
+		Word Address;
+		Byte Old;
+	};
+	
+	struct Checkpoint
+	{
+		uint64 Step;	// Data as it was before that step
+		Byte* Data;
+	};
+	
+	Step* Steps;
+	uint64 Count, Capacity;
+	
+	WriteEntry* Writes;
+	uint64 WriteCount, WriteCapacity;
+	
+	Checkpoint* Checkpoints;
+	uint64 CheckpointCount, CheckpointCapacity;
+	
+	uint32 Interval;
+	uint64 BaseInstructions;	// CPU::Instructions at Attach
+	
+	MEM* Memory;
+	WriteObserver Observer;
+	WriteObserver* Previous;	// the observer that was there first, still called
+	bool Paused;				// while running forward from a checkpoint
+	
+	void Attach(CPU& cpu, MEM& memory, uint32 interval);
+	void Detach(CPU& cpu);
+	void Free();
+	
+	// From CPU::ExecHooked around every instruction
+	void Begin(const CPU& cpu);
+	
+	void End(sint32 cycles)
+	{
+		Steps[Count - 1].Cycles = cycles < 255 ? cycles : 255;
+	}
+	
+	// Back to the state before instruction `step` (0 is where Attach found
+	// the CPU). Everything logged after it is dropped.
+	void GoTo(CPU& cpu, uint64 step);
+	
+	// Returns how many instructions it went back
+	uint64 StepBack(CPU& cpu, uint64 count)
+	{
+		count = count < Count ? count : Count;
+		
+		GoTo(cpu, Count - count);
+		
+		return count;
+	}
+	
+	// Back to just before the last instruction that wrote address. False
+	// (and nothing changes) if nothing in the log did.
+	bool BackToWrite(CPU& cpu, Word address);
+	
+	static void ObserveWrite(void* context, uint32 address, Byte val);
+	
+	template <typename T>
+	static void Grow(T*& array, uint64& capacity, uint64 needed)
+	{
+		if (needed <= capacity)
+		{
+			return;
+		}
+		
+		uint64 grown = capacity ? capacity * 2 : 1024;
+		
+		grown = grown < needed ? needed : grown;
+		
+		T* copy = new T[grown];
+		
+		if (array)
+		{
+			memcpy(copy, array, capacity * sizeof(T));
+			delete[] array;
+		}
+		
+		array = copy;
+		capacity = grown;
+	}
+};
+
+
+// NOTE: Conditions
+// Predicates for conditional breakpoints and tracepoints, like
+// `A == $42 && mem[$10] > 3`, compiled once into a little stack bytecode so
+// a hit costs a short loop over a few bytes instead of parsing text.
+// Operands: numbers ($hex, %binary or decimal), the registers A X Y SP PC P,
+// the flags C Z I D B V N (0 or 1) and mem[expr] (read without triggering
+// watchpoints). Operators, loosest first: || && then the comparisons,
+// | ^ &, + -, and unary ! - ~. Unlike C the bit operators bind tighter than the
+// comparisons, so `P & $80 == $80` means what it looks like.
+struct Condition
+{
+	static constexpr uint32 MAX_CODE	= 64;
+	static constexpr uint32 MAX_DEPTH	= 16;
+	
+	enum Op : Byte
+	{
+		OP_END,
+		OP_PUSH,	// 2 bytes of value follow
+		OP_REG,		// 1 byte of Register follows
+		OP_MEM,
+		OP_NOT, OP_NEG, OP_INV,
+		OP_ADD, OP_SUB, OP_AND, OP_OR, OP_XOR,
+		OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE,
+		OP_BOOL,
+		OP_JFALSE,	// 1 byte forward offset, jumps if the top is 0 and keeps it
+		OP_JTRUE,	// same if it is not 0
+		OP_POP,
+	};
+	
+	enum Register : Byte
+	{
+		REG_A, REG_X, REG_Y, REG_SP, REG_PC, REG_P,
+		REG_C, REG_Z, REG_I, REG_D, REG_B, REG_V, REG_N,
+	};
+	
+	Byte Code[MAX_CODE];
+	uint32 Length;
+	
+	// Compile errors
+	const char* Error;
+	uint32 ErrorAt;		// offset into the text
+	
+	// Evaluation
+	bool Eval(const CPU& cpu, const MEM& memory) const;
+	
+	// Compilation, recursive descent straight to code
+	const char* Text;
+	const char* At;
+	uint32 Depth, MaxDepth;
+	
+	bool Compile(const char* text)
+	{
+		Text = At = text;
+		Length = Depth = MaxDepth = 0;
+		Error = nullptr;
+		
+		Or();
+		
+		Skip();
+		
+		if (!Error && *At)
+		{
+			Fail("unexpected text");
+		}
+		
+		Emit(OP_END);
+		
+		if (!Error && MaxDepth > MAX_DEPTH)
+		{
+			Fail("expression too deep");
+		}
+		
+		return Error == nullptr;
+	}
+	
+	void Fail(const char* message)
+	{
+		if (!Error)
+		{
+			Error = message;
+			ErrorAt = At - Text;
+		}
+	}
+	
+	void Emit(Byte b)
+	{
+		if (Length < MAX_CODE)
+		{
+			Code[Length++] = b;
+		}
+		else
+		{
+			Fail("expression too long");
+			Code[MAX_CODE - 1] = OP_END;
+		}
+	}
+	
+	// Keeps track of the stack depth the code will need
+	void Push()
+	{
+		if (++Depth > MaxDepth)
+		{
+			MaxDepth = Depth;
+		}
+	}
+	
+	void Skip()
+	{
+		while (*At == ' ' || *At == '\t')
+		{
+			At++;
+		}
+	}
+	
+	bool Accept(const char* token)
+	{
+		Skip();
+		
+		uint32 length = strlen(token);
+		
+		if (strncmp(At, token, length) != 0)
+		{
+			return false;
+		}
+		
+		// `&` is not the start of `&&`, `<` not of `<=`
+		if (length == 1 && strchr("&|<>", token[0]) && (At[1] == token[0] || At[1] == '='))
+		{
+			return false;
+		}
+		
+		At += length;
+		
+		return true;
+	}
+	
+	// A jump over the right hand side, patched once that is compiled
+	void ShortCircuit(Op jump, void (Condition::*side)())
+	{
+		Emit(jump);
+		Emit(0);
+		
+		uint32 patch = Length - 1;
+		
+		Emit(OP_POP);
+		Depth--;
+		
+		(this->*side)();
+		
+		Emit(OP_BOOL);
+		
+		Code[patch] = Length - patch - 1;
+	}
+	
+	void Or()
+	{
+		And();
+		
+		while (!Error && Accept("||"))
+		{
+			Emit(OP_BOOL);
+			ShortCircuit(OP_JTRUE, &Condition::And);
+		}
+	}
+	
+	void And()
+	{
+		Compare();
+		
+		while (!Error && Accept("&&"))
+		{
+			Emit(OP_BOOL);
+			ShortCircuit(OP_JFALSE, &Condition::Compare);
+		}
+	}
+	
+	// Left associative binary operators over the next level down
+	void Binary(void (Condition::*next)(), std::initializer_list<const char*> tokens, std::initializer_list<Op> ops)
+	{
+		(this->*next)();
+		
+		while (!Error)
+		{
+			const Op* op = ops.begin();
+			const char* const* token = tokens.begin();
+			
+			while (token != tokens.end() && !Accept(*token))
+			{
+				token++;
+				op++;
+			}
+			
+			if (token == tokens.end())
+			{
+				return;
+			}
+			
+			(this->*next)();
+			
+			Emit(*op);
+			Depth--;
+		}
+	}
+	
+	void Compare()
+	{
+		Binary(&Condition::BitOr, { "==", "!=", "<=", ">=", "<", ">" }, { OP_EQ, OP_NE, OP_LE, OP_GE, OP_LT, OP_GT });
+	}
+	
+	void BitOr()	{ Binary(&Condition::BitXor, { "|" }, { OP_OR }); }
+	void BitXor()	{ Binary(&Condition::BitAnd, { "^" }, { OP_XOR }); }
+	void BitAnd()	{ Binary(&Condition::Sum, { "&" }, { OP_AND }); }
+	
+	void Sum()		{ Binary(&Condition::Unary, { "+", "-" }, { OP_ADD, OP_SUB }); }
+	
+	void Unary()
+	{
+		if (Accept("!"))
+		{
+			Unary();
+			Emit(OP_NOT);
+		}
+		else if (Accept("-"))
+		{
+			Unary();
+			Emit(OP_NEG);
+		}
+		else if (Accept("~"))
+		{
+			Unary();
+			Emit(OP_INV);
+		}
+		else
+		{
+			Primary();
+		}
+	}
+	
+	void Primary()
+	{
+		static const char* const NAMES[] = { "A", "X", "Y", "SP", "PC", "P", "C", "Z", "I", "D", "B", "V", "N" };
+		
+		Skip();
+		
+		if (Accept("("))
+		{
+			Or();
+			
+			if (!Accept(")"))
+			{
+				Fail("expected )");
+			}
+			
+			return;
+		}
+		
+		if (*At == '$' || *At == '%' || (*At >= '0' && *At <= '9'))
+		{
+			uint32 base = *At == '$' ? 16 : *At == '%' ? 2 : 10;
+			
+			if (base != 10)
+			{
+				At++;
+			}
+			
+			char* end;
+			unsigned long value = strtoul(At, &end, base);
+			
+			if (end == At || value > 0xFFFF)
+			{
+				Fail("bad number");
+				return;
+			}
+			
+			At = end;
+			
+			Emit(OP_PUSH);
+			Emit(value & 0xFF);
+			Emit(value >> 8);
+			Push();
+			
+			return;
+		}
+		
+		const char* start = At;
+		
+		while ((*At >= 'A' && *At <= 'Z') || (*At >= 'a' && *At <= 'z'))
+		{
+			At++;
+		}
+		
+		uint32 length = At - start;
+		
+		if (length == 3 && strncmp(start, "mem", 3) == 0)
+		{
+			if (!Accept("["))
+			{
+				Fail("expected [");
+				return;
+			}
+			
+			Or();
+			
+			if (!Accept("]"))
+			{
+				Fail("expected ]");
+			}
+			
+			Emit(OP_MEM);
+			
+			return;
+		}
+		
+		for (uint32 r = 0; r < sizeof(NAMES) / sizeof(NAMES[0]); r++)
+		{
+			if (length == strlen(NAMES[r]) && strncmp(start, NAMES[r], length) == 0)
+			{
+				Emit(OP_REG);
+				Emit(r);
+				Push();
+				
+				return;
+			}
+		}
+		
+		At = start;
+		
+		Fail("expected a number, register, flag or mem[]");
+	}
+};
+
+
+// NOTE: Breakpoints
+// One bit per address, so testing the next PC is one load and a bit test
+// however many breakpoints there are. Exec only tests while CPU::Breaks is
+// set (or MEM has watchpoints), otherwise it runs the loops that test
+// nothing. ExecCached tests between blocks and ends blocks before a
+// breakpoint; setting or clearing one counts as a write to its page, so
+// blocks decoded over it are decoded again. Attach it before decoding.
+// A PC with conditions (see Add) only stops when one of them holds, unless
+// there is a plain breakpoint on it as well. Tracepoints never stop, they
+// count (and print, with Output set) the times their condition held. Both
+// are only looked at after the bitmap hit.
+struct Breakpoints
+{
+	static constexpr uint32 MAX_CONDITIONS = 64;
+	
+	struct Conditional
+	{
+		Word PC;
+		bool Tracepoint;
+		uint64 Hits;
+		Condition When;
+	};
+	
+	uint64 Bits[MEM::MAX_MEM / 64];		// anything at all on the PC, what the loops test
+	uint64 Plain[MEM::MAX_MEM / 64];	// a breakpoint without a condition
+	uint32 Count;
+	
+	Conditional Conditions[MAX_CONDITIONS];
+	uint32 ConditionCount;
+	
+	FILE* Output;
+	
+	void Init()
+	{
+		for (uint32 w = 0; w < MEM::MAX_MEM / 64; w++)
+		{
+			Bits[w] = 0;
+			Plain[w] = 0;
+		}
+		
+		Count = 0;
+		ConditionCount = 0;
+		Output = nullptr;
+	}
+	
+	bool Has(Word pc) const
+	{
+		return (Bits[pc >> 6] >> (pc & 63)) & 1;
+	}
+	
+	void Mark(Word pc, MEM& memory)
+	{
+		if (!Has(pc))
+		{
+			Bits[pc >> 6] |= 1ULL << (pc & 63);
+			Count++;
+			memory.PageWrites[pc >> 8]++;
+		}
+	}
+	
+	void Set(Word pc, MEM& memory)
+	{
+		Plain[pc >> 6] |= 1ULL << (pc & 63);
+		
+		Mark(pc, memory);
+	}
+	
+	// False when all MAX_CONDITIONS are taken. when has to be compiled.
+	bool Add(Word pc, const Condition& when, bool tracepoint, MEM& memory)
+	{
+		if (ConditionCount == MAX_CONDITIONS)
+		{
+			return false;
+		}
+		
+		Conditions[ConditionCount++] = Conditional{ pc, tracepoint, 0, when };
+		
+		Mark(pc, memory);
+		
+		return true;
+	}
+	
+	// Drops everything on the PC, conditions included
+	void Clear(Word pc, MEM& memory)
+	{
+		uint32 kept = 0;
+		
+		for (uint32 i = 0; i < ConditionCount; i++)
+		{
+			if (Conditions[i].PC != pc)
+			{
+				Conditions[kept++] = Conditions[i];
+			}
+		}
+		
+		ConditionCount = kept;
+		
+		Plain[pc >> 6] &= ~(1ULL << (pc & 63));
+		
+		if (Has(pc))
+		{
+			Bits[pc >> 6] &= ~(1ULL << (pc & 63));
+			Count--;
+			memory.PageWrites[pc >> 8]++;
+		}
+	}
+	
+	// The bitmap hit on the CPU's PC, should it stop there
+	bool Hit(const CPU& cpu, const MEM& memory);
+	
+	// The bitmap the loops test, all clear without breakpoints
+	static const uint64* BitsOf(const Breakpoints* breaks)
+	{
+		static const uint64 NONE[MEM::MAX_MEM / 64] = {};
+		
+		return breaks ? breaks->Bits : NONE;
+	}
+};
+
+
+// NOTE: Status tables
+// N and Z as they sit in P, for every low byte CPU::NZ can have (bit 15 of
+// NZ adds N on top), so building P takes a load instead of two compares.
+// And the other way round, the NZ value for a wanted Z (index bit 0) and N
+// (index bit 1).
+struct NzTable
+{
+	Byte Status[256];
+};
+
+static constexpr NzTable BuildNzTable()
+{
+	NzTable table = {};
+	
+	for (uint32 i = 0; i < 256; i++)
+	{
+		table.Status[i] = (i == 0 ? 0b00000010 : 0) | (i & 0b10000000);
+	}
+	
+	return table;
+}
+
+static constexpr NzTable NZ_STATUS = BuildNzTable();
+
+static constexpr Word NZ_FOR[4] = { 0x01, 0x00, 0x80, 0x8000 };
+
+
+struct CPU
+{
+	Word PC;		// Program Counter
+	Byte SP;		// Stack Pointer, the stack is $0100 + SP and grows down
+	
+	Byte A, X, Y;	// GPRs
+	
+	// Bit field (status flags) (yes this is new) (yes i just learned this)
+	// Each one sits on its bit in P (bit fields fill from bit 0 up with gcc
+	// and clang), so Flags is P without N, Z and bit 5, and the unused bits
+	// stay 0. PHP and PLP are then a mask and an OR, not five shifts.
+	union
+	{
+		struct
+		{
+			Byte C : 1;		// Carry flag
+			Byte   : 1;		// (Z, see NZ)
+			Byte I : 1;		// Interrupt disable
+			Byte D : 1;		// Decimal mode
+			Byte B : 1;		// Break command
+			Byte   : 1;		// (bit 5, always reads 1)
+			Byte V : 1;		// Overflow flag
+			Byte   : 1;		// (N, see NZ)
+		};
+		
+		Byte Flags;
+	};
+	
+	// NOTE: Lazy N and Z
+	// Nearly every instruction sets N and Z, and nearly every time the next
+	// one overwrites them before anything looks. So instead of working them
+	// out, keep the value they come from and work them out on demand:
+	// Z is set when the low byte is 0, N when bit 7 or bit 15 is set. A
+	// plain result is stored as is, bit 15 is only there so SetNZ can
+	// express N and Z both set (which no result can).
+	Word NZ;
+	
+	bool GetZ() const { return (NZ & 0xFF) == 0; }
+	bool GetN() const { return (NZ & 0x8080) != 0; }
+	
+	void SetNZ(bool z, bool n)
+	{
+		NZ = NZ_FOR[z | (n << 1)];
+	}
+	
+	// The status register with bit 5 (always reads 1) and without B, which
+	// is not a flag: PHP and BRK OR it into the byte they push. The only
+	// place P exists as a whole, nothing in the loop needs it.
+	Byte GetStatus() const
+	{
+		return Flags | (1 << 5) | NZ_STATUS.Status[NZ & 0xFF] | ((NZ >> 8) & 0x80);
+	}
+	
+	void SetStatus(Byte p)
+	{
+		Flags = p & 0b01001101;	// C, I, D, V; B and bit 5 are not kept
+		NZ = NZ_FOR[((p >> 1) & 1) | ((p >> 6) & 2)];
+	}
+	
+	uint64 Instructions;	// executed since Reset, by every engine
+	uint64 Unknown;			// opcodes since Reset the chip has no instruction for
+	
+#if PROFILE
+	Profile* Counters = nullptr;	// counts go here when set, kept across Reset
+#endif
+	
+	Trace* Tracer = nullptr;	// Exec records every instruction here when set
+	DeltaTraceWriter* Recorder = nullptr;	// and here, see DeltaTraceWriter::Open
+	UndoLog* History = nullptr;				// and here, see UndoLog::Attach
+	
+	bool Hooked() const
+	{
+		return Tracer || Recorder || History;
+	}
+	
+	Breakpoints* Breaks = nullptr;	// Exec stops before any PC set in here
+	
+	enum StopReason : Byte
+	{
+		STOP_NONE,
+		STOP_BREAKPOINT,
+		STOP_WATCHPOINT,	// MEM::TrapAddress says where
+	};
+	
+	StopReason Stop = STOP_NONE;	// why the last Exec returned before its budget was spent
+	
+	// Between instructions: a breakpoint on the next one, or a watched access
+	// by the last one
+	FORCE_INLINE bool Stopping(const MEM& memory, const uint64* breaks)
+	{
+		bool bit = (breaks[PC >> 6] >> (PC & 63)) & 1;
+		
+		if (!(bit | memory.Trapped))
+		{
+			return false;
+		}
+		
+		// A set bit means Breaks is not null
+		bool hit = bit && Breaks->Hit(*this, memory);
+		
+		if (!hit && !memory.Trapped)
+		{
+			return false;
+		}
+		
+		Stop = memory.Trapped ? STOP_WATCHPOINT : STOP_BREAKPOINT;
+		
+		return true;
+	}
+	
+	template <typename Bus>
+	void Reset(Bus& memory)
+	{
+		PC = 0xFFFC;
+		SP = 0xFF;
+		
+		Flags = 0;
+		
+		SetNZ(false, false);
+		
+		A = X = Y = 0;
+		
+		Instructions = Unknown = 0;
+		
+		memory.Clear();
+	}
+	
+	
+	// The opcode fetch, the first cycle of every instruction. Like every
+	// access below, it goes through whatever bus the caller hands in (MEM,
+	// FlatBus, TracingBus), resolved at compile time.
+	template <typename Bus>
+	Byte FetchByte(sint32& cycles, Bus& memory)
+	{
+		Byte data = memory.ReadByte(PC);
+		
+		PC++;
+		cycles--;
+		
+		return data;
+	}
+	
+	
+	// Operand bytes. No cycles here, the handlers take the ISA's count for
+	// the whole instruction in one go.
+	template <typename Bus>
+	Byte NextByte(Bus& memory)
+	{
+		Byte data = memory.ReadByte(PC);
+		
+		PC++;
+		
+		return data;
+	}
+	
+	
+	template <typename Bus>
+	Word NextWord(Bus& memory)
+	{
+		// !!6502 was LITTLE ENDIAN!!
+		
+		Word data = NextByte(memory);
+		
+		data |= NextByte(memory) << 8;
+		
+		return data;
+	}
+	
+	
+	// The stack is page 1, SP points at the next free byte and it grows down
+	template <typename Bus>
+	void Push(Bus& memory, Byte val)
+	{
+		memory.WriteByte(0x0100 | SP, val);
+		
+		SP--;
+	}
+	
+	
+	template <typename Bus>
+	Byte Pull(Bus& memory)
+	{
+		SP++;
+		
+		return memory.ReadByte(0x0100 | SP);
+	}
+	
+	// NOTE: ISA
+#define X(opcode, name, ...) static constexpr Byte INS_##name = opcode;
+	CPU_ISA(X)
+#undef X
+	
+	
+	// NOTE: Instruction semantics
+	// One template for the whole ISA and every variant. OP is looked up in
+	// the variant's table at compile time, so each instantiation is only the
+	// code for its own mnemonic and addressing mode; what is left at run
+	// time is what depends on the data (page crossings, branches taken,
+	// carries).
+	
+	template <typename Chip, Byte OP, typename Bus>
+	FORCE_INLINE Word FetchOperand(Bus& memory)
+	{
+		constexpr Byte bytes = VARIANT_OPS<Chip>.Ops[OP].Bytes;
+		
+		if constexpr (bytes == 3)
+		{
+			return NextWord(memory);
+		}
+		else if constexpr (bytes == 2)
+		{
+			return NextByte(memory);
+		}
+		else
+		{
+			return 0;
+		}
+	}
+	
+	
+	// Effective address of the memory modes, plus the page crossing cycle
+	// where the ISA charges one
+	template <typename Chip, Byte OP, typename Bus>
+	FORCE_INLINE Word Address(sint32& cycles, Bus& memory, Word operand)
+	{
+		constexpr OpInfo info = VARIANT_OPS<Chip>.Ops[OP];
+		
+		if constexpr (info.Mode == AM_ZP || info.Mode == AM_ABS)
+		{
+			return operand;
+		}
+		else if constexpr (info.Mode == AM_ZPX)
+		{
+			return (Byte)(operand + X);
+		}
+		else if constexpr (info.Mode == AM_ZPY)
+		{
+			return (Byte)(operand + Y);
+		}
+		else if constexpr (info.Mode == AM_ABX || info.Mode == AM_ABY)
+		{
+			Word address = operand + (info.Mode == AM_ABX ? X : Y);
+			
+			if constexpr (info.Flags & OPF_PAGE)
+			{
+				cycles -= (address ^ operand) > 0xFF;
+			}
+			
+			return address;
+		}
+		else if constexpr (info.Mode == AM_IZX)
+		{
+			Byte pointer = operand + X;
+			
+			return memory.ReadByte(pointer) | (memory.ReadByte((Byte)(pointer + 1)) << 8);
+		}
+		else if constexpr (info.Mode == AM_IZY)
+		{
+			Word base = memory.ReadByte(operand) | (memory.ReadByte((Byte)(operand + 1)) << 8);
+			Word address = base + Y;
+			
+			if constexpr (info.Flags & OPF_PAGE)
+			{
+				cycles -= (address ^ base) > 0xFF;
+			}
+			
+			return address;
+		}
+		else if constexpr (info.Mode == AM_IZP)
+		{
+			return memory.ReadByte(operand) | (memory.ReadByte((Byte)(operand + 1)) << 8);
+		}
+		else if constexpr (info.Mode == AM_IAX)
+		{
+			Word pointer = operand + X;
+			
+			return memory.ReadByte(pointer) | (memory.ReadByte((Word)(pointer + 1)) << 8);
+		}
+		else
+		{
+			static_assert(info.Mode == AM_IND, "no address in this mode");
+			
+			if constexpr (Chip::JMP_BUG)
+			{
+				// NMOS bug: the high byte comes from the same page, JMP
+				// ($12FF) reads $12FF and $1200
+				return memory.ReadByte(operand) | (memory.ReadByte((operand & 0xFF00) | (Byte)(operand + 1)) << 8);
+			}
+			else
+			{
+				return memory.ReadByte(operand) | (memory.ReadByte((Word)(operand + 1)) << 8);
+			}
+		}
+	}
+	
+	
+	template <typename Chip, Byte OP, typename Bus>
+	FORCE_INLINE Byte Read(sint32& cycles, Bus& memory, Word operand)
+	{
+		if constexpr (VARIANT_OPS<Chip>.Ops[OP].Mode == AM_IMM)
+		{
+			return operand;
+		}
+		else
+		{
+			return memory.ReadByte(Address<Chip, OP>(cycles, memory, operand));
+		}
+	}
+	
+	
+	// Read-modify-write, on A or on memory. Returns the new value.
+	template <typename Chip, Byte OP, typename Bus, typename F>
+	FORCE_INLINE Byte Modify(sint32& cycles, Bus& memory, Word operand, F f)
+	{
+		if constexpr (VARIANT_OPS<Chip>.Ops[OP].Mode == AM_ACC)
+		{
+			A = f(A);
+			NZ = A;
+			
+			return A;
+		}
+		else
+		{
+			Word address = Address<Chip, OP>(cycles, memory, operand);
+			Byte val = f(memory.ReadByte(address));
+			
+			memory.WriteByte(address, val);
+			NZ = val;
+			
+			return val;
+		}
+	}
+	
+	
+	template <typename Chip>
+	void Add(sint32& cycles, Byte m)
+	{
+		uint32 sum = A + m + C;
+		
+		if (!Chip::DECIMAL || !D)
+		{
+			V = (~(A ^ m) & (A ^ sum) & 0x80) != 0;
+			C = sum > 0xFF;
+			A = sum;
+			NZ = A;
+			
+			return;
+		}
+		
+		// NMOS decimal mode: Z from the binary sum, N and V from the high
+		// digit before it is adjusted
+		uint32 lo = (A & 0x0F) + (m & 0x0F) + C;
+		
+		if (lo > 0x09)
+		{
+			lo += 0x06;
+		}
+		
+		uint32 hi = (A >> 4) + (m >> 4) + (lo > 0x0F);
+		
+		V = (~(A ^ m) & (A ^ (hi << 4)) & 0x80) != 0;
+		
+		SetNZ((Byte)sum == 0, hi & 0x08);
+		
+		if (hi > 0x09)
+		{
+			hi += 0x06;
+		}
+		
+		C = hi > 0x0F;
+		A = (hi << 4) | (lo & 0x0F);
+		
+		// The 65C02 takes a cycle more to get N and Z from the result
+		if constexpr (Chip::CMOS)
+		{
+			NZ = A;
+			cycles--;
+		}
+	}
+	
+	
+	template <typename Chip>
+	void Subtract(sint32& cycles, Byte m)
+	{
+		Byte borrow = !C;
+		uint32 diff = A - m - borrow;
+		
+		// V and C come from the binary difference on every chip, and NMOS
+		// decimal mode only changes A
+		V = ((A ^ m) & (A ^ diff) & 0x80) != 0;
+		C = diff < 0x100;
+		NZ = (Byte)diff;
+		
+		Byte result = diff;
+		
+		if (Chip::DECIMAL && D)
+		{
+			uint32 lo = (A & 0x0F) - (m & 0x0F) - borrow;
+			uint32 hi = (A >> 4) - (m >> 4);
+			
+			if (lo & 0x10)
+			{
+				lo -= 0x06;
+				hi--;
+			}
+			
+			if (hi & 0x10)
+			{
+				hi -= 0x06;
+			}
+			
+			result = (hi << 4) | (lo & 0x0F);
+			
+			if constexpr (Chip::CMOS)
+			{
+				NZ = result;
+				cycles--;
+			}
+		}
+		
+		A = result;
+	}
+
+
+	void Compare(Byte reg, Byte m)
+	{
+		C = reg >= m;
+		NZ = (Byte)(reg - m);
+	}
+	
+	
+	void Branch(sint32& cycles, Word operand, bool taken)
+	{
+		if (taken)
+		{
+			Word target = PC + (signed char)operand;
+			
+			cycles -= 1 + ((target ^ PC) > 0xFF);
+			PC = target;
+		}
+	}
+	
+	
+	template <typename Chip, Byte OP, typename Bus>
+	FORCE_INLINE void Execute(sint32& cycles, Bus& memory, Word operand)
+	{
+		constexpr Mnemonic MN = VARIANT_OPS<Chip>.Ops[OP].Instruction;
+		
+		// Loads and stores
+		if constexpr (MN == MN_LDA) { A = Read<Chip, OP>(cycles, memory, operand); NZ = A; }
+		else if constexpr (MN == MN_LDX) { X = Read<Chip, OP>(cycles, memory, operand); NZ = X; }
+		else if constexpr (MN == MN_LDY) { Y = Read<Chip, OP>(cycles, memory, operand); NZ = Y; }
+		else if constexpr (MN == MN_STA) memory.WriteByte(Address<Chip, OP>(cycles, memory, operand), A);
+		else if constexpr (MN == MN_STX) memory.WriteByte(Address<Chip, OP>(cycles, memory, operand), X);
+		else if constexpr (MN == MN_STY) memory.WriteByte(Address<Chip, OP>(cycles, memory, operand), Y);
+		else if constexpr (MN == MN_STZ) memory.WriteByte(Address<Chip, OP>(cycles, memory, operand), 0);
+		
+		// Arithmetic and logic
+		else if constexpr (MN == MN_ADC) Add<Chip>(cycles, Read<Chip, OP>(cycles, memory, operand));
+		else if constexpr (MN == MN_SBC) Subtract<Chip>(cycles, Read<Chip, OP>(cycles, memory, operand));
+		else if constexpr (MN == MN_AND) { A &= Read<Chip, OP>(cycles, memory, operand); NZ = A; }
+		else if constexpr (MN == MN_ORA) { A |= Read<Chip, OP>(cycles, memory, operand); NZ = A; }
+		else if constexpr (MN == MN_EOR) { A ^= Read<Chip, OP>(cycles, memory, operand); NZ = A; }
+		else if constexpr (MN == MN_CMP) Compare(A, Read<Chip, OP>(cycles, memory, operand));
+		else if constexpr (MN == MN_CPX) Compare(X, Read<Chip, OP>(cycles, memory, operand));
+		else if constexpr (MN == MN_CPY) Compare(Y, Read<Chip, OP>(cycles, memory, operand));
+		else if constexpr (MN == MN_BIT)
+		{
+			Byte m = Read<Chip, OP>(cycles, memory, operand);
+			
+			if constexpr (VARIANT_OPS<Chip>.Ops[OP].Mode == AM_IMM)
+			{
+				SetNZ((A & m) == 0, GetN());	// 65C02 BIT #, only Z
+			}
+			else
+			{
+				V = m >> 6;
+				NZ = (A & m) | ((m & 0x80) << 8);	// Z from A AND m, N from m
+			}
+		}
+		else if constexpr (MN == MN_TRB || MN == MN_TSB)
+		{
+			Word address = Address<Chip, OP>(cycles, memory, operand);
+			Byte m = memory.ReadByte(address);
+			
+			SetNZ((A & m) == 0, GetN());
+			memory.WriteByte(address, MN == MN_TSB ? m | A : m & ~A);
+		}
+		
+		// Shifts, increments and decrements
+		else if constexpr (MN == MN_ASL) Modify<Chip, OP>(cycles, memory, operand, [this](Byte v) { C = v >> 7; return (Byte)(v << 1); });
+		else if constexpr (MN == MN_LSR) Modify<Chip, OP>(cycles, memory, operand, [this](Byte v) { C = v; return (Byte)(v >> 1); });
+		else if constexpr (MN == MN_ROL) Modify<Chip, OP>(cycles, memory, operand, [this](Byte v) { Byte c = C; C = v >> 7; return (Byte)((v << 1) | c); });
+		else if constexpr (MN == MN_ROR) Modify<Chip, OP>(cycles, memory, operand, [this](Byte v) { Byte c = C; C = v; return (Byte)((v >> 1) | (c << 7)); });
+		else if constexpr (MN == MN_INC) Modify<Chip, OP>(cycles, memory, operand, [](Byte v) { return (Byte)(v + 1); });
+		else if constexpr (MN == MN_DEC) Modify<Chip, OP>(cycles, memory, operand, [](Byte v) { return (Byte)(v - 1); });
+		else if constexpr (MN == MN_INX) { X++; NZ = X; }
+		else if constexpr (MN == MN_INY) { Y++; NZ = Y; }
+		else if constexpr (MN == MN_DEX) { X--; NZ = X; }
+		else if constexpr (MN == MN_DEY) { Y--; NZ = Y; }
+		
+		// Transfers
+		else if constexpr (MN == MN_TAX) { X = A; NZ = X; }
+		else if constexpr (MN == MN_TAY) { Y = A; NZ = Y; }
+		else if constexpr (MN == MN_TXA) { A = X; NZ = A; }
+		else if constexpr (MN == MN_TYA) { A = Y; NZ = A; }
+		else if constexpr (MN == MN_TSX) { X = SP; NZ = X; }
+		else if constexpr (MN == MN_TXS) SP = X;
+		
+		// Stack
+		else if constexpr (MN == MN_PHA) Push(memory, A);
+		else if constexpr (MN == MN_PHP) Push(memory, GetStatus() | 0x10);
+		else if constexpr (MN == MN_PLA) { A = Pull(memory); NZ = A; }
+		else if constexpr (MN == MN_PLP) SetStatus(Pull(memory));
+		else if constexpr (MN == MN_PHX) Push(memory, X);
+		else if constexpr (MN == MN_PHY) Push(memory, Y);
+		else if constexpr (MN == MN_PLX) { X = Pull(memory); NZ = X; }
+		else if constexpr (MN == MN_PLY) { Y = Pull(memory); NZ = Y; }
+		
+		// Flags
+		else if constexpr (MN == MN_CLC) C = 0;
+		else if constexpr (MN == MN_SEC) C = 1;
+		else if constexpr (MN == MN_CLI) I = 0;
+		else if constexpr (MN == MN_SEI) I = 1;
+		else if constexpr (MN == MN_CLD) D = 0;
+		else if constexpr (MN == MN_SED) D = 1;
+		else if constexpr (MN == MN_CLV) V = 0;
+		
+		// Branches, relative to the PC after the instruction
+		else if constexpr (MN == MN_BCC) Branch(cycles, operand, !C);
+		else if constexpr (MN == MN_BCS) Branch(cycles, operand, C);
+		else if constexpr (MN == MN_BNE) Branch(cycles, operand, !GetZ());
+		else if constexpr (MN == MN_BEQ) Branch(cycles, operand, GetZ());
+		else if constexpr (MN == MN_BPL) Branch(cycles, operand, !GetN());
+		else if constexpr (MN == MN_BMI) Branch(cycles, operand, GetN());
+		else if constexpr (MN == MN_BVC) Branch(cycles, operand, !V);
+		else if constexpr (MN == MN_BVS) Branch(cycles, operand, V);
+		else if constexpr (MN == MN_BRA) Branch(cycles, operand, true);
+		
+		// Jumps
+		else if constexpr (MN == MN_JMP)
+		{
+			if constexpr (VARIANT_OPS<Chip>.Ops[OP].Mode == AM_ABS)
+			{
+				PC = operand;
+			}
+			else
+			{
+				PC = Address<Chip, OP>(cycles, memory, operand);
+			}
+		}
+		else if constexpr (MN == MN_JSR)
+		{
+			// PUSH the return address to the stack (Because JSR), minus one
+			Push(memory, (PC - 1) >> 8);
+			Push(memory, (PC - 1) & 0xFF);
+			
+			PC = operand;
+		}
+		else if constexpr (MN == MN_RTS)
+		{
+			Word address = Pull(memory);
+			
+			address |= Pull(memory) << 8;
+			
+			PC = address + 1;
+		}
+		else if constexpr (MN == MN_BRK)
+		{
+			// Skips the byte after the opcode
+			Word address = PC + 1;
+			
+			Push(memory, address >> 8);
+			Push(memory, address & 0xFF);
+			Push(memory, GetStatus() | 0x10);
+			
+			I = 1;
+			
+			if constexpr (Chip::CMOS)
+			{
+				D = 0;
+			}
+			
+			PC = memory.ReadByte(0xFFFE) | (memory.ReadByte(0xFFFF) << 8);
+		}
+		else if constexpr (MN == MN_RTI)
+		{
+			SetStatus(Pull(memory));
+			
+			Word address = Pull(memory);
+			
+			address |= Pull(memory) << 8;
+			
+			PC = address;
+		}
+		
+		// Undocumented NMOS opcodes: a read-modify-write and an ALU op on
+		// the result in one, or two registers at once
+		else if constexpr (MN == MN_SLO) { Byte m = Modify<Chip, OP>(cycles, memory, operand, [this](Byte v) { C = v >> 7; return (Byte)(v << 1); }); A |= m; NZ = A; }
+		else if constexpr (MN == MN_RLA) { Byte m = Modify<Chip, OP>(cycles, memory, operand, [this](Byte v) { Byte c = C; C = v >> 7; return (Byte)((v << 1) | c); }); A &= m; NZ = A; }
+		else if constexpr (MN == MN_SRE) { Byte m = Modify<Chip, OP>(cycles, memory, operand, [this](Byte v) { C = v; return (Byte)(v >> 1); }); A ^= m; NZ = A; }
+		else if constexpr (MN == MN_RRA) Add<Chip>(cycles, Modify<Chip, OP>(cycles, memory, operand, [this](Byte v) { Byte c = C; C = v; return (Byte)((v >> 1) | (c << 7)); }));
+		else if constexpr (MN == MN_DCP) Compare(A, Modify<Chip, OP>(cycles, memory, operand, [](Byte v) { return (Byte)(v - 1); }));
+		else if constexpr (MN == MN_ISC) Subtract<Chip>(cycles, Modify<Chip, OP>(cycles, memory, operand, [](Byte v) { return (Byte)(v + 1); }));
+		else if constexpr (MN == MN_SAX) memory.WriteByte(Address<Chip, OP>(cycles, memory, operand), A & X);
+		else if constexpr (MN == MN_LAX) { A = X = Read<Chip, OP>(cycles, memory, operand); NZ = A; }
+		else if constexpr (MN == MN_ANC) { A &= operand; NZ = A; C = A >> 7; }
+		else if constexpr (MN == MN_ALR) { A &= operand; C = A; A >>= 1; NZ = A; }
+		else if constexpr (MN == MN_ARR)
+		{
+			// Binary mode only, the decimal quirks are not modelled
+			A = ((A & operand) >> 1) | (C << 7);
+			NZ = A;
+			C = A >> 6;
+			V = (A >> 6) ^ (A >> 5);
+		}
+		else if constexpr (MN == MN_SBX)
+		{
+			Byte ax = A & X;
+			
+			C = ax >= (Byte)operand;
+			X = ax - operand;
+			NZ = X;
+		}
+		else
+		{
+			static_assert(MN == MN_NOP, "mnemonic without semantics");
+			
+			// The undocumented NOPs still do their read
+			if constexpr (VARIANT_OPS<Chip>.Ops[OP].Mode != AM_IMP && VARIANT_OPS<Chip>.Ops[OP].Mode != AM_IMM)
+			{
+				Read<Chip, OP>(cycles, memory, operand);
+			}
+		}
+	}
+	
+	
+	// Executing (FETCH - DECODE - EXECUTE)
+	// Op_ handlers fetch the operand and hand it to the matching Do_, which
+	// does the work. The block cache calls the Do_ directly with operands it
+	// fetched once at decode time (PC already past the instruction). The Do_
+	// only counts the cycles the ISA does not know in advance (page
+	// crossings, branches), the rest comes from the table.
+#define X(opcode, name, ...) \
+	template <typename Bus> \
+	void Do_##name(sint32& cycles, Bus& memory, Word operand) \
+	{ \
+		Execute<Nmos6502, opcode>(cycles, memory, operand); \
+	} \
+	\
+	template <typename Bus> \
+	FORCE_INLINE void Op_##name(sint32& cycles, Bus& memory) \
+	{ \
+		cycles -= OP_INFO.Ops[opcode].Cycles - 1; \
+		\
+		Do_##name(cycles, memory, FetchOperand<Nmos6502, opcode>(memory)); \
+	}
+	CPU_ISA(X)
+#undef X
+	
+	
+	// Counted, not reported: the core does no I/O while it runs, the host
+	// looks at Unknown afterwards if it cares.
+	template <typename Bus>
+	void Op_Unknown(sint32& /*cycles*/, Bus& /*memory*/)
+	{
+		Unknown++;
+	}
+	
+	
+	// Handler for an opcode known at compile time, on any variant. Same as
+	// the Op_ handler for the NMOS opcodes, falls back to Op_Unknown.
+	template <uint32 OP, typename Chip = Nmos6502, typename Bus>
+	FORCE_INLINE void OpFor(sint32& cycles, Bus& memory)
+	{
+		constexpr OpInfo info = VARIANT_OPS<Chip>.Ops[OP];
+		
+		if constexpr (info.Name != nullptr)
+		{
+			cycles -= info.Cycles - 1;
+			
+			Execute<Chip, OP>(cycles, memory, FetchOperand<Chip, OP>(memory));
+		}
+		else
+		{
+			Op_Unknown(cycles, memory);
+		}
+	}
+	
+	
+	// NOTE: Dispatch table
+	// Plain function pointers (not pointers to members) so a call is a
+	// single indirect jump with no this-adjustment. One table per bus.
+	template <typename Bus>
+	using Handler = void (*)(CPU& cpu, sint32& cycles, Bus& memory);
+	
+	template <typename Bus>
+	struct DispatchTable
+	{
+		Handler<Bus> Ops[256];
+	};
+	
+	template <typename Bus, void (CPU::*Op)(sint32&, Bus&)>
+	static void Thunk(CPU& cpu, sint32& cycles, Bus& memory)
+	{
+		(cpu.*Op)(cycles, memory);
+	}
+	
+	
+	template <typename Bus>
+	static constexpr DispatchTable<Bus> BuildDispatchTable()
+	{
+		DispatchTable<Bus> table = {};
+		
+		for (uint32 i = 0; i < 256; i++)
+		{
+			table.Ops[i] = &Thunk<Bus, &CPU::Op_Unknown<Bus>>;
+		}
+		
+#define X(opcode, name, ...) table.Ops[opcode] = &Thunk<Bus, &CPU::Op_##name<Bus>>;
+		CPU_ISA(X)
+#undef X
+		
+		return table;
+	}
+	
+	template <typename Bus>
+	static const DispatchTable<Bus> DISPATCH;
+	
+	
+	// One instruction whose opcode was already fetched.
+	template <typename Bus>
+	FORCE_INLINE void Dispatch(Byte instruction, sint32& cycles, Bus& memory)
+	{
+		Instructions++;
+		
+#if PROFILE
+		// The opcode fetch (1 cycle) already happened
+		Word pc = PC - 1;
+		sint32 before = cycles + 1;
+#endif
+		
+#if defined(DISPATCH_TABLE)
+		DISPATCH<Bus>.Ops[instruction](*this, cycles, memory);
+#else
+		switch (instruction)
+		{
+#define X(opcode, name, ...) case INS_##name: Op_##name(cycles, memory); break;
+			CPU_ISA(X)
+#undef X
+			
+			default:
+			{
+				Op_Unknown(cycles, memory);
+			} break;
+		}
+#endif
+		
+#if PROFILE
+		if (Counters)
+		{
+			Counters->Count(pc, instruction, before - cycles);
+		}
+#endif
+	}
+	
+	
+	// NOTE: Block decoding
+	template <void (CPU::*Do)(sint32&, MEM&, Word)>
+	static void DecodedThunk(CPU& cpu, sint32& cycles, MEM& memory, Word operand)
+	{
+		(cpu.*Do)(cycles, memory, operand);
+	}
+	
+	
+	// Decodes the straight-line code at pc into block. Stops after a jump,
+	// before an opcode the ISA does not know, before a breakpoint, or when
+	// the block is full. Leaves Count at 0 if the very first opcode is
+	// unknown.
+	// The most cycles an instruction can take on top of its table count: a
+	// taken branch and the page it crosses, or a read across a page
+	static constexpr sint32 BranchOrPageExtra(AddressMode mode, Byte flags)
+	{
+		return mode == AM_REL ? 2 : (flags & OPF_PAGE) ? 1 : 0;
+	}
+	
+	
+	static void DecodeBlock(Word pc, const MEM& memory, BlockCache::Block& block, const uint64* breaks)
+	{
+		block.Start		= pc;
+		block.Count		= 0;
+		block.Flags		= 0;
+		block.Cycles	= 0;
+		block.Extra		= 0;
+		
+		Word last = pc;
+		
+		while (block.Count < BlockCache::MAX_OPS)
+		{
+			if (block.Count > 0 && ((breaks[pc >> 6] >> (pc & 63)) & 1))
+			{
+				break;
+			}
+			
+			BlockCache::MicroOp& op = block.Ops[block.Count];
+			
+			Byte opcode = memory.Peek(pc);
+			Byte bytes = 0;
+			
+			op.Opcode = opcode;
+			
+			switch (opcode)
+			{
+#define X(opcode, name, mnemonic, mode, ncycles, flags) \
+				case INS_##name: \
+				{ \
+					op.Do		= &DecodedThunk<&CPU::Do_##name<MEM>>; \
+					op.Cycles	= ncycles; \
+					op.Flags	= flags; \
+					bytes		= ModeBytes(AM_##mode); \
+					block.Extra	+= BranchOrPageExtra(AM_##mode, flags); \
+				} break;
+				CPU_ISA(X)
+#undef X
+			}
+			
+			if (bytes == 0)
+			{
+				break;
+			}
+			
+			op.Operand = 0;
+			
+			if (bytes >= 2) op.Operand = memory.Peek((Word)(pc + 1));
+			if (bytes >= 3) op.Operand |= memory.Peek((Word)(pc + 2)) << 8;
+			
+			last = pc + bytes - 1;
+			pc += bytes;
+			
+			op.Next = pc;
+			
+			block.Cycles += op.Cycles;
+			block.Flags |= op.Flags;
+			block.Count++;
+			
+			if (op.Flags & OPF_JUMP)
+			{
+				break;
+			}
+		}
+		
+		block.Entries	= 0;
+		block.Native	= nullptr;
+		
+		block.Page[0]	= block.Start >> 8;
+		block.Page[1]	= last >> 8;
+		block.Writes[0]	= memory.PageWrites[block.Page[0]];
+		block.Writes[1]	= memory.PageWrites[block.Page[1]];
+	}
+	
+	
+	// Same contract as Exec, but replays decoded blocks from cache where it
+	// can and interprets one instruction at a time where it can not. With a
+	// jit, blocks that keep coming back get compiled to native code.
+	sint32 ExecCached(sint32 cycles, MEM& memory, BlockCache& cache, Jit* jit = nullptr)
+	{
+		// Blocks skip the per-instruction hooks, so traces and the undo log
+		// go the slow way, same as from Exec
+		if (Hooked())
+		{
+			return ExecHooked(cycles, memory);
+		}
+		
+		const sint32 requested = cycles;
+		const uint64* breaks = Breakpoints::BitsOf(Breaks);
+		const bool watching = memory.Watches != 0;
+		
+		Stop = STOP_NONE;
+		memory.Trapped = false;
+		
+		while (cycles > 0)
+		{
+			// Not before the first block, so calling again continues
+			if (cycles != requested && Stopping(memory, breaks))
+			{
+				break;
+			}
+			
+			BlockCache::Block& block = cache.SlotFor(PC);
+			
+			if (block.Count != 0 && block.Start == PC)
+			{
+				if (BlockCache::IsValid(block, memory))
+				{
+					cache.Hits++;
+				}
+				else
+				{
+					cache.Invalidations++;
+					DecodeBlock(PC, memory, block, breaks);
+				}
+			}
+			else
+			{
+				cache.Misses++;
+				DecodeBlock(PC, memory, block, breaks);
+			}
+			
+			if (block.Count == 0)
+			{
+				Dispatch(FetchByte(cycles, memory), cycles, memory);
+				continue;
+			}
+			
+			// Compiled code goes straight to MEM::Data, so no devices or ROM
+			if (jit && cycles >= block.Cycles + block.Extra && memory.Mapped == 0 && !memory.Observer && !memory.Snap)
+			{
+				if (!jit->IsNative(block) && ++block.Entries == Jit::HOT)
+				{
+					jit->Compile(block);
+				}
+				
+				if (jit->IsNative(block))
+				{
+					sint32 used = block.Native(this, &memory);
+					
+					if (used >= 0)
+					{
+						cycles -= used;
+						jit->NativeRuns++;
+						
+						continue;
+					}
+				}
+			}
+			
+			// The block knows the base cycles up front, the Do_ handlers
+			// only take off the extras (page crossings, taken branches).
+			// With room for all the extras no instruction but the last can
+			// find the budget spent, same as Exec.
+			if (cycles >= block.Cycles + block.Extra && !(block.Flags & OPF_WRITE) && !watching)
+			{
+				// Fast path: nothing in here can run out of cycles or
+				// modify code, just run it.
+				cycles -= block.Cycles;
+				
+				for (uint32 i = 0; i < block.Count; i++)
+				{
+					const BlockCache::MicroOp& op = block.Ops[i];
+					
+					PC = op.Next;
+					op.Do(*this, cycles, memory, op.Operand);
+				}
+				
+				Instructions += block.Count;
+			}
+			else
+			{
+				for (uint32 i = 0; i < block.Count; i++)
+				{
+					const BlockCache::MicroOp& op = block.Ops[i];
+					
+					PC = op.Next;
+					op.Do(*this, cycles, memory, op.Operand);
+					
+					cycles -= op.Cycles;
+					Instructions++;
+					
+					if (cycles <= 0 || memory.Trapped)
+					{
+						break;
+					}
+					
+					// A store may have just rewritten the rest of this block
+					if ((op.Flags & OPF_WRITE) && !BlockCache::IsValid(block, memory))
+					{
+						break;
+					}
+				}
+			}
+		}
+		
+		return requested - cycles;
+	}
+	
+	
+#if defined(DISPATCH_THREADED)
+	// Threaded interpreter: every opcode gets its own label and its own copy
+	// of the fetch + indirect jump, so the host branch predictor keeps a
+	// separate history per guest opcode instead of one shared jump.
+	// Works on a local copy of the registers so the compiler can keep them in
+	// host registers (stores to MEM::Data may alias *this, locals can not).
+	template <typename Bus>
+	sint32 ExecThreaded(sint32 cycles, Bus& memory)
+	{
+#define X(n) &&op_##n,
+		static void* const LABELS[256] = { CPU_ALL_OPCODES(X) };
+#undef X
+		
+		const sint32 requested = cycles;
+		
+		CPU regs = *this;
+		
+		if (cycles <= 0)
+		{
+			return 0;
+		}
+		
+		goto *LABELS[regs.FetchByte(cycles, memory)];
+		
+#if PROFILE
+#define X(n) \
+		op_##n: \
+		{ \
+			Word pc = regs.PC - 1; \
+			sint32 before = cycles + 1; \
+			regs.OpFor<n>(cycles, memory); \
+			regs.Instructions++; \
+			if (regs.Counters) regs.Counters->Count(pc, n, before - cycles); \
+		} \
+			if (cycles <= 0) goto done; \
+			goto *LABELS[regs.FetchByte(cycles, memory)];
+#else
+#define X(n) \
+		op_##n: \
+			regs.OpFor<n>(cycles, memory); \
+			regs.Instructions++; \
+			if (cycles <= 0) goto done; \
+			goto *LABELS[regs.FetchByte(cycles, memory)];
+#endif
+		CPU_ALL_OPCODES(X)
+#undef X
+		
+	done:
+		*this = regs;
+		
+		return requested - cycles;
+	}
+#endif
+	
+	
+	// One instruction, no hooks. Returns the cycles it took.
+	sint32 Step(MEM& memory)
+	{
+		sint32 cycles = 0;
+		
+		Byte instruction = FetchByte(cycles, memory);
+		
+		Dispatch(instruction, cycles, memory);
+		
+		return -cycles;
+	}
+	
+	
+	// NOTE: Hooked execution
+	// One instruction at a time with the debugging hooks in between. Exec
+	// switches to it on entry when any hook is set, so the plain loops above
+	// never pay for them.
+	sint32 ExecHooked(sint32 cycles, MEM& memory)
+	{
+		const sint32 requested = cycles;
+		const uint64* breaks = Breakpoints::BitsOf(Breaks);
+		
+		while (cycles > 0)
+		{
+			sint32 before = cycles;
+			Word pc = PC;
+			
+			if (History)
+			{
+				History->Begin(*this);
+			}
+			
+			Byte instruction = FetchByte(cycles, memory);
+			
+			if (Tracer)
+			{
+				Trace::Record record = {};
+				
+				record.Cycle	= (uint32)Tracer->Cycle;
+				record.PC		= pc;
+				record.SP		= SP;
+				record.Opcode	= instruction;
+				record.A		= A;
+				record.X		= X;
+				record.Y		= Y;
+				record.P		= GetStatus();
+				
+				Tracer->Push(record);
+			}
+			
+			Dispatch(instruction, cycles, memory);
+			
+			if (Recorder)
+			{
+				Recorder->Record(*this, pc, instruction, before - cycles);
+			}
+			
+			if (History)
+			{
+				History->End(before - cycles);
+			}
+			
+			if (Tracer)
+			{
+				Tracer->Cycle += before - cycles;
+				
+				if (!OP_INFO.Ops[instruction].Name && Tracer->TrapPath)
+				{
+					Tracer->Dump(Tracer->TrapPath);
+				}
+			}
+			
+			// Last, so the instruction a breakpoint stops after is all
+			// accounted for
+			if (Stopping(memory, breaks))
+			{
+				break;
+			}
+		}
+		
+		return requested - cycles;
+	}
+	
+	
+	// NOTE: Breakable execution
+	// Breakpoints and watchpoints, one test after every instruction. The
+	// instruction Exec starts on always runs, so calling it again continues
+	// from where it stopped.
+	sint32 ExecBreakable(sint32 cycles, MEM& memory)
+	{
+		const sint32 requested = cycles;
+		const uint64* breaks = Breakpoints::BitsOf(Breaks);
+		
+		while (cycles > 0)
+		{
+			Byte instruction = FetchByte(cycles, memory);
+			
+			Dispatch(instruction, cycles, memory);
+			
+			if (Stopping(memory, breaks))
+			{
+				break;
+			}
+		}
+		
+		return requested - cycles;
+	}
+	
+	
+	// Runs until the cycle budget is spent, or to a breakpoint or
+	// watchpoint (see Stop). Returns the cycles actually used, which can
+	// overshoot the budget by the tail of the last instruction.
+	sint32 Exec(sint32 cycles, MEM& memory)
+	{
+		Stop = STOP_NONE;
+		memory.Trapped = false;
+		
+		if (Hooked())
+		{
+			return ExecHooked(cycles, memory);
+		}
+		
+		if (Breaks || memory.Watches)
+		{
+			return ExecBreakable(cycles, memory);
+		}
+		
+		// Plain RAM: the same engine, minus the page table test on every
+		// access
+		if (RamBus::Usable(memory))
+		{
+			RamBus ram = { &memory };
+			
+			return ExecPlain(cycles, ram);
+		}
+		
+		return ExecPlain(cycles, memory);
+	}
+	
+	
+	// The loop DISPATCH picked, nothing tested between instructions. Exec
+	// hands every engine the same bus.
+	template <typename Bus>
+	sint32 ExecPlain(sint32 cycles, Bus& memory)
+	{
+#if defined(DISPATCH_THREADED)
+		return ExecThreaded(cycles, memory);
+#else
+		const sint32 requested = cycles;
+		
+		while (cycles > 0)
+		{
+			Byte instruction = FetchByte(cycles, memory);
+			
+			Dispatch(instruction, cycles, memory);
+		}
+		
+		return requested - cycles;
+#endif
+	}
+	
+	
+	// Exec for another chip (see the variant policies) and/or another bus
+	// (see FlatBus): its own switch over all 256 opcodes with every handler
+	// specialized for both, so nothing in the loop looks at the variant and
+	// every access is a direct call into the bus. No hooks, breakpoints or
+	// block cache here, those are on Exec.
+	template <typename Chip, typename Bus>
+	sint32 ExecVariant(sint32 cycles, Bus& memory)
+	{
+		const sint32 requested = cycles;
+		
+		while (cycles > 0)
+		{
+			Byte instruction = FetchByte(cycles, memory);
+			
+			Instructions++;
+			
+			switch (instruction)
+			{
+#define X(n) case n: OpFor<n, Chip>(cycles, memory); break;
+				CPU_ALL_OPCODES(X)
+#undef X
+			}
+		}
+		
+		return requested - cycles;
+	}
+	
+	
+	// Exec in slices that end on the scheduler's deadlines, firing the
+	// events in between. An event fires at the end of the instruction that
+	// crosses its cycle, so it can be late by a few cycles but never early.
+	// Returns early when Exec stops on a breakpoint or watchpoint.
+	sint32 ExecScheduled(sint32 cycles, MEM& memory, Scheduler& scheduler)
+	{
+		sint32 used = 0;
+		
+		while (used < cycles)
+		{
+			sint32 slice = cycles - used;
+			
+			if (scheduler.Deadline - scheduler.Now < (uint64)slice)
+			{
+				slice = scheduler.Deadline - scheduler.Now;
+			}
+			
+			if (slice > 0)
+			{
+				sint32 ran = Exec(slice, memory);
+				
+				used += ran;
+				scheduler.RunUntil(scheduler.Now + ran);
+				
+				if (Stop != STOP_NONE)
+				{
+					break;
+				}
+			}
+			else
+			{
+				scheduler.RunUntil(scheduler.Now);
+			}
+		}
+		
+		return used;
+	}
+};
+
+
+// Out here because the table needs CPU complete. Inline, so DISPATCH_TABLE
+// builds stay header-only like the others.
+template <typename Bus>
+inline const CPU::DispatchTable<Bus> CPU::DISPATCH = CPU::BuildDispatchTable<Bus>();
+
+
+// NOTE: Snapshots
+// CPU registers plus copy-on-write memory (see MEM::Snap). Taking one is
+// O(1) and makes it the MEM's active snapshot; a restore of the active one
+// copies back just the pages that changed since. Taking another snapshot
+// detaches the old one, which then gets the pages it was still sharing
+// copied in, so it stays restorable (at the cost of a full copy on its
+// next restore). Only Data is saved, not the page table or devices.
+struct Snapshot
+{
+	CPU Cpu;
+	SnapshotPages Pages;
+	
+	void Take(const CPU& cpu, MEM& memory)
+	{
+		if (memory.Snap != &Pages)
+		{
+			memory.Detach();
+		}
+		
+		Cpu = cpu;
+		
+		for (uint32 w = 0; w < MEM::PAGES / 64; w++)
+		{
+			Pages.Saved[w] = 0;
+			memory.Shared[w] = ~0ULL;
+		}
+		
+		memory.Snap = &Pages;
+	}
+	
+	
+	// Puts cpu and memory back to how they were at Take. The hooks on cpu
+	// (trace, profile) stay as they are now.
+	void Restore(CPU& cpu, MEM& memory)
+	{
+		if (memory.Snap != &Pages)
+		{
+			memory.Detach();
+			memory.Snap = &Pages;
+			
+			for (uint32 w = 0; w < MEM::PAGES / 64; w++)
+			{
+				memory.Shared[w] = 0;
+			}
+		}
+		
+		for (uint32 w = 0; w < MEM::PAGES / 64; w++)
+		{
+			uint64 bits = Pages.Saved[w] & ~memory.Shared[w];
+			
+			while (bits)
+			{
+				uint32 page = w * 64 + __builtin_ctzll(bits);
+				
+				memcpy(memory.Data + page * 256, Pages.Data + page * 256, 256);
+				memory.PageWrites[page]++;
+				
+				bits &= bits - 1;
+			}
+			
+			memory.Dirty[w] |= Pages.Saved[w] & ~memory.Shared[w];
+			memory.Shared[w] = ~0ULL;
+		}
+		
+		cpu.PC				= Cpu.PC;
+		cpu.SP				= Cpu.SP;
+		cpu.A				= Cpu.A;
+		cpu.X				= Cpu.X;
+		cpu.Y				= Cpu.Y;
+		cpu.Flags			= Cpu.Flags;
+		cpu.NZ				= Cpu.NZ;
+		cpu.Instructions	= Cpu.Instructions;
+		cpu.Unknown			= Cpu.Unknown;
+	}
+};
+
+
+// NOTE: Lockstep batch
+// Up to 32 CPUs running the same ROM on different data, registers kept as
+// structure-of-arrays (one 32-bit slot per lane) so 8 lanes fit one AVX2
+// register. Every step picks the lowest PC among the lanes still running and
+// executes that instruction for every lane sitting on it, so lanes that took
+// different paths fall back in line when the slower ones catch up. With
+// AVX2 the loads, stores, transfers, ALU ops, compares and branches run on 8
+// lanes at a time out of each lane's own MEM (see IsVector). Anything else,
+// and all of it when the host has no AVX2, goes through CPU::Dispatch one
+// lane at a time.
+// Each lane ends up exactly where Exec(budget) would have left it.
+struct Batch
+{
+	static constexpr uint32 MAX_LANES	= 32;
+	static constexpr uint32 CHUNK		= 8;	// lanes per AVX2 register
+	
+	uint32 Lanes;		// multiple of CHUNK
+	MEM* Mems;			// one per lane, back to back
+	
+	alignas(32) uint32 PC[MAX_LANES];
+	alignas(32) uint32 SP[MAX_LANES];
+	alignas(32) uint32 A[MAX_LANES];
+	alignas(32) uint32 X[MAX_LANES];
+	alignas(32) uint32 Y[MAX_LANES];
+	alignas(32) uint32 NZ[MAX_LANES];		// CPU::NZ, lazy like there
+	alignas(32) uint32 Other[MAX_LANES];	// CPU::Flags, see StoreLane
+	alignas(32) sint32 Cycles[MAX_LANES];	// budget left
+	
+	bool Avx2;
+	bool Plain;			// every lane RamBus::Usable, set by Run
+	
+	// Stats
+	uint64 Instructions, Steps, VectorSteps;
+	
+	// Sets up one lane (program, registers), called once per lane
+	using Loader = void (*)(uint32 lane, CPU& cpu, MEM& memory);
+	
+	void Init(uint32 lanes, Loader load, bool allowAvx2 = true)
+	{
+		Lanes = (lanes + CHUNK - 1) / CHUNK * CHUNK;
+		
+		if (Lanes > MAX_LANES)
+		{
+			Lanes = MAX_LANES;
+		}
+		
+		Mems = new MEM[Lanes];
+		
+		for (uint32 l = 0; l < Lanes; l++)
+		{
+			CPU cpu;
+			
+			cpu.Reset(Mems[l]);
+			
+			load(l, cpu, Mems[l]);
+			
+			StoreLane(l, cpu);
+			
+			Cycles[l] = 0;
+		}
+		
+		Avx2 = false;
+		Plain = false;
+		
+#if SIMD_AVX2
+		Avx2 = allowAvx2 && __builtin_cpu_supports("avx2");
+#else
+		(void)allowAvx2;
+#endif
+		
+		Instructions = Steps = VectorSteps = 0;
+	}
+	
+	
+	void Free()
+	{
+		delete[] Mems;
+	}
+	
+	
+	void StoreLane(uint32 l, const CPU& cpu)
+	{
+		PC[l]		= cpu.PC;
+		SP[l]		= cpu.SP;
+		A[l]		= cpu.A;
+		X[l]		= cpu.X;
+		Y[l]		= cpu.Y;
+		NZ[l]		= cpu.NZ;
+		Other[l]	= cpu.Flags;
+	}
+	
+	
+	void LoadLane(uint32 l, CPU& cpu) const
+	{
+		cpu.PC	= PC[l];
+		cpu.SP	= SP[l];
+		cpu.A	= A[l];
+		cpu.X	= X[l];
+		cpu.Y	= Y[l];
+		cpu.NZ	= NZ[l];
+		cpu.Flags	= Other[l];
+		
+		cpu.Instructions = cpu.Unknown = 0;
+	}
+	
+	
+	// One instruction for one lane, the slow way
+	void StepLane(uint32 l)
+	{
+		CPU cpu;
+		
+		LoadLane(l, cpu);
+		
+		sint32 cycles = Cycles[l];
+		
+		if (Plain)
+		{
+			RamBus ram{ &Mems[l] };
+			
+			cpu.Dispatch(cpu.FetchByte(cycles, ram), cycles, ram);
+		}
+		else
+		{
+			cpu.Dispatch(cpu.FetchByte(cycles, Mems[l]), cycles, Mems[l]);
+		}
+		
+		Cycles[l] = cycles;
+		
+		StoreLane(l, cpu);
+		
+		Instructions++;
+	}
+	
+	
+	// Every lane at the lowest PC, one lane at a time. False when all lanes
+	// are out of cycles.
+	bool StepScalar()
+	{
+		uint32 minPC = 0xFFFFFFFF;
+		
+		for (uint32 l = 0; l < Lanes; l++)
+		{
+			if (Cycles[l] > 0 && PC[l] < minPC)
+			{
+				minPC = PC[l];
+			}
+		}
+		
+		if (minPC == 0xFFFFFFFF)
+		{
+			return false;
+		}
+		
+		for (uint32 l = 0; l < Lanes; l++)
+		{
+			if (Cycles[l] > 0 && PC[l] == minPC)
+			{
+				StepLane(l);
+			}
+		}
+		
+		Steps++;
+		
+		return true;
+	}
+	
+	
+#if SIMD_AVX2
+	// What StepAvx2 runs for 8 lanes at a time. Anything else (stack, calls,
+	// memory read-modify-writes) goes one lane at a time through StepScalar.
+	static bool IsVector(Byte opcode)
+	{
+		const OpInfo& info = OP_INFO.Ops[opcode];
+		
+		switch (info.Instruction)
+		{
+			// Loads and stores
+			case MN_LDA: case MN_LDX: case MN_LDY:
+			case MN_STA: case MN_STX: case MN_STY:
+			
+			// Transfers, and the index increments
+			case MN_TAX: case MN_TAY: case MN_TXA: case MN_TYA: case MN_TSX: case MN_TXS:
+			case MN_INX: case MN_INY: case MN_DEX: case MN_DEY:
+			
+			// Logic, arithmetic and compares
+			case MN_AND: case MN_ORA: case MN_EOR: case MN_ADC: case MN_SBC:
+			case MN_CMP: case MN_CPX: case MN_CPY: case MN_BIT:
+			
+			// Branches and flags
+			case MN_BCC: case MN_BCS: case MN_BEQ: case MN_BNE:
+			case MN_BMI: case MN_BPL: case MN_BVC: case MN_BVS:
+			case MN_CLC: case MN_SEC: case MN_CLI: case MN_SEI:
+			case MN_CLD: case MN_SED: case MN_CLV: case MN_NOP:
+				return true;
+			
+			case MN_ASL: case MN_LSR: case MN_ROL: case MN_ROR:
+				return info.Mode == AM_ACC;
+			
+			case MN_JMP:
+				return info.Mode == AM_ABS;
+			
+			default:
+				return false;
+		}
+	}
+	
+	
+	// One byte per lane, each out of its own MEM (lane is the byte offset of
+	// the lane's MEM from Mems[0])
+	__attribute__((target("avx2")))
+	static FORCE_INLINE __m256i Gather(const int* base, __m256i lane, __m256i address)
+	{
+		return _mm256_and_si256(_mm256_i32gather_epi32(base, _mm256_add_epi32(lane, address), 1), _mm256_set1_epi32(0xFF));
+	}
+	
+	
+	// Effective address per lane, plus the page crossing cycle where the ISA
+	// charges one. Same as CPU::Address.
+	__attribute__((target("avx2")))
+	static FORCE_INLINE __m256i Address(const OpInfo& info, Word operand, const int* base, __m256i lane,
+		__m256i x, __m256i y, __m256i& extra)
+	{
+		const __m256i byteMask = _mm256_set1_epi32(0xFF);
+		const __m256i wordMask = _mm256_set1_epi32(0xFFFF);
+		
+		__m256i op = _mm256_set1_epi32(operand);
+		
+		bool page = info.Flags & OPF_PAGE;
+		
+		switch (info.Mode)
+		{
+			case AM_ZPX:
+			case AM_ZPY:
+			{
+				return _mm256_and_si256(_mm256_add_epi32(op, info.Mode == AM_ZPX ? x : y), byteMask);
+			}
+			
+			case AM_ABX:
+			case AM_ABY:
+			{
+				__m256i index = info.Mode == AM_ABX ? x : y;
+				
+				if (page)
+				{
+					extra = _mm256_srli_epi32(_mm256_add_epi32(_mm256_set1_epi32(operand & 0xFF), index), 8);
+				}
+				
+				return _mm256_and_si256(_mm256_add_epi32(op, index), wordMask);
+			}
+			
+			case AM_IZX:
+			{
+				__m256i pointer = _mm256_and_si256(_mm256_add_epi32(op, x), byteMask);
+				__m256i lo = Gather(base, lane, pointer);
+				__m256i hi = Gather(base, lane, _mm256_and_si256(_mm256_add_epi32(pointer, _mm256_set1_epi32(1)), byteMask));
+				
+				return _mm256_or_si256(lo, _mm256_slli_epi32(hi, 8));
+			}
+			
+			case AM_IZY:
+			{
+				__m256i lo = Gather(base, lane, op);
+				__m256i hi = Gather(base, lane, _mm256_set1_epi32((Byte)(operand + 1)));
+				
+				if (page)
+				{
+					extra = _mm256_srli_epi32(_mm256_add_epi32(lo, y), 8);
+				}
+				
+				return _mm256_and_si256(_mm256_add_epi32(_mm256_or_si256(lo, _mm256_slli_epi32(hi, 8)), y), wordMask);
+			}
+			
+			default:
+			{
+				return op;		// zero page, absolute
+			}
+		}
+	}
+	
+	
+	// The 4 bytes at the same address in 8 lanes from c on. The lanes sit
+	// sizeof(MEM) apart, so these are plain loads, which cost less than a
+	// gather where all the addresses are the same.
+	__attribute__((target("avx2")))
+	FORCE_INLINE __m256i Column(uint32 c, Word address) const
+	{
+		const Byte* p = Mems[c].Data + address;
+		
+		auto at = [p](uint32 i) { uint32 w; memcpy(&w, p + i * sizeof(MEM), 4); return (int)w; };
+		
+		return _mm256_setr_epi32(at(0), at(1), at(2), at(3), at(4), at(5), at(6), at(7));
+	}
+	
+	
+	// Flags with C replaced by carry (0 or 1)
+	__attribute__((target("avx2")))
+	static FORCE_INLINE __m256i WithCarry(__m256i flags, __m256i carry)
+	{
+		return _mm256_or_si256(_mm256_andnot_si256(_mm256_set1_epi32(1), flags), carry);
+	}
+	
+	
+	__attribute__((target("avx2")))
+	bool StepAvx2()
+	{
+		const __m256i zero		= _mm256_setzero_si256();
+		const __m256i allOnes	= _mm256_set1_epi32(-1);
+		
+		// Lowest PC among the running lanes
+		__m256i vmin = allOnes;
+		
+		for (uint32 c = 0; c < Lanes; c += CHUNK)
+		{
+			__m256i pc		= _mm256_load_si256((const __m256i*)(PC + c));
+			__m256i active	= _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i*)(Cycles + c)), zero);
+			
+			vmin = _mm256_min_epu32(vmin, _mm256_blendv_epi8(allOnes, pc, active));
+		}
+		
+		vmin = _mm256_min_epu32(vmin, _mm256_shuffle_epi32(vmin, 0b01001110));
+		vmin = _mm256_min_epu32(vmin, _mm256_shuffle_epi32(vmin, 0b10110001));
+		vmin = _mm256_min_epu32(vmin, _mm256_permute2x128_si256(vmin, vmin, 0x01));
+		
+		uint32 minPC = _mm256_cvtsi256_si32(vmin);
+		
+		if (minPC == 0xFFFFFFFF)
+		{
+			return false;
+		}
+		
+		// The first lane there decides what the instruction is
+		uint32 leader = 0;
+		
+		while (!(Cycles[leader] > 0 && PC[leader] == minPC))
+		{
+			leader++;
+		}
+		
+		const Byte* code = Mems[leader].Data;
+		
+		Byte opcode = code[minPC];
+		
+		// The gathers read 4 bytes from PC on, keep them away from the wrap
+		if (!IsVector(opcode) || minPC > 0xFFFC)
+		{
+			return StepScalar();
+		}
+		
+		const OpInfo& info = OP_INFO.Ops[opcode];
+		const Mnemonic mn = info.Instruction;
+		
+		// Decimal mode ADC/SBC goes one lane at a time. Lanes in decimal mode
+		// drop out of the vector step below and lead a step of their own.
+		bool arithmetic = mn == MN_ADC || mn == MN_SBC;
+		
+		if (arithmetic && (Other[leader] & 0x08))
+		{
+			return StepScalar();
+		}
+		
+		uint32 lengthMask = info.Bytes == 3 ? 0xFFFFFF : info.Bytes == 2 ? 0xFFFF : 0xFF;
+		uint32 bytes = (opcode | (code[minPC + 1] << 8) | (code[minPC + 2] << 16)) & lengthMask;
+		
+		Word operand = bytes >> 8;
+		
+		bool memory = info.Mode != AM_IMP && info.Mode != AM_ACC && info.Mode != AM_IMM && info.Mode != AM_REL
+			&& mn != MN_JMP;
+		bool store = mn == MN_STA || mn == MN_STX || mn == MN_STY;
+		
+		// Lanes only go together if their bytes match the leader's
+		__m256i match	= _mm256_set1_epi32(bytes);
+		__m256i mask	= _mm256_set1_epi32(lengthMask);
+		__m256i vpc		= _mm256_set1_epi32(minPC);
+		__m256i cost	= _mm256_set1_epi32(info.Cycles);
+		__m256i byteMask = _mm256_set1_epi32(0xFF);
+		__m256i stride	= _mm256_set1_epi32(sizeof(MEM));
+		__m256i iota	= _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		__m256i one		= _mm256_set1_epi32(1);
+		
+		const int* base = (const int*)Mems[0].Data;
+		
+		for (uint32 c = 0; c < Lanes; c += CHUNK)
+		{
+			__m256i pc		= _mm256_load_si256((const __m256i*)(PC + c));
+			__m256i cycles	= _mm256_load_si256((const __m256i*)(Cycles + c));
+			
+			// Byte offset of each lane's MEM from Mems[0]
+			__m256i lane	= _mm256_mullo_epi32(_mm256_add_epi32(iota, _mm256_set1_epi32(c)), stride);
+			
+			__m256i m = _mm256_and_si256(_mm256_cmpgt_epi32(cycles, zero), _mm256_cmpeq_epi32(pc, vpc));
+			
+			if (_mm256_testz_si256(m, m))
+			{
+				continue;
+			}
+			
+			__m256i fetched = Column(c, minPC);
+			
+			m = _mm256_and_si256(m, _mm256_cmpeq_epi32(_mm256_and_si256(fetched, mask), match));
+			
+			__m256i a		= _mm256_load_si256((const __m256i*)(A + c));
+			__m256i x		= _mm256_load_si256((const __m256i*)(X + c));
+			__m256i y		= _mm256_load_si256((const __m256i*)(Y + c));
+			__m256i sp		= _mm256_load_si256((const __m256i*)(SP + c));
+			__m256i nz		= _mm256_load_si256((const __m256i*)(NZ + c));
+			__m256i other	= _mm256_load_si256((const __m256i*)(Other + c));
+			
+			if (arithmetic)
+			{
+				m = _mm256_andnot_si256(_mm256_cmpgt_epi32(_mm256_and_si256(other, _mm256_set1_epi32(0x08)), zero), m);
+			}
+			
+			if (_mm256_testz_si256(m, m))
+			{
+				continue;
+			}
+			
+			// The operand, and the address it came from
+			__m256i extra	= zero;
+			__m256i address	= zero;
+			__m256i val		= _mm256_set1_epi32(operand & 0xFF);
+			
+			if (memory)
+			{
+				address = Address(info, operand, base, lane, x, y, extra);
+				
+				if (!store)
+				{
+					bool direct = info.Mode == AM_ZP || info.Mode == AM_ABS;
+					
+					val = direct ? _mm256_and_si256(Column(c, operand), byteMask) : Gather(base, lane, address);
+				}
+			}
+			
+			__m256i na = a, nx = x, ny = y, nsp = sp, nz2 = nz, nother = other;
+			__m256i next = _mm256_set1_epi32((Word)(minPC + info.Bytes));
+			
+			switch (mn)
+			{
+				// Loads and stores
+				case MN_LDA: na = nz2 = val; break;
+				case MN_LDX: nx = nz2 = val; break;
+				case MN_LDY: ny = nz2 = val; break;
+				
+				case MN_STA:
+				case MN_STX:
+				case MN_STY:
+				{
+					// No scatter in AVX2. RamBus keeps the page counters and
+					// dirty bits right, there is nothing else to tell.
+					alignas(32) uint32 addresses[CHUNK];
+					alignas(32) uint32 values[CHUNK];
+					
+					_mm256_store_si256((__m256i*)addresses, address);
+					_mm256_store_si256((__m256i*)values, mn == MN_STA ? a : mn == MN_STX ? x : y);
+					
+					uint32 lanes = _mm256_movemask_ps(_mm256_castsi256_ps(m));
+					
+					while (lanes)
+					{
+						uint32 i = __builtin_ctz(lanes);
+						
+						RamBus{ &Mems[c + i] }.WriteByte(addresses[i], values[i]);
+						
+						lanes &= lanes - 1;
+					}
+				} break;
+				
+				// Transfers
+				case MN_TAX: nx = nz2 = a; break;
+				case MN_TAY: ny = nz2 = a; break;
+				case MN_TXA: na = nz2 = x; break;
+				case MN_TYA: na = nz2 = y; break;
+				case MN_TSX: nx = nz2 = sp; break;
+				case MN_TXS: nsp = x; break;
+				
+				case MN_INX: nx = nz2 = _mm256_and_si256(_mm256_add_epi32(x, one), byteMask); break;
+				case MN_INY: ny = nz2 = _mm256_and_si256(_mm256_add_epi32(y, one), byteMask); break;
+				case MN_DEX: nx = nz2 = _mm256_and_si256(_mm256_sub_epi32(x, one), byteMask); break;
+				case MN_DEY: ny = nz2 = _mm256_and_si256(_mm256_sub_epi32(y, one), byteMask); break;
+				
+				// Logic and arithmetic
+				case MN_AND: na = nz2 = _mm256_and_si256(a, val); break;
+				case MN_ORA: na = nz2 = _mm256_or_si256(a, val); break;
+				case MN_EOR: na = nz2 = _mm256_xor_si256(a, val); break;
+				
+				case MN_ADC:
+				case MN_SBC:
+				{
+					// Binary SBC is ADC of the complement
+					__m256i m8 = mn == MN_SBC ? _mm256_xor_si256(val, byteMask) : val;
+					__m256i sum = _mm256_add_epi32(_mm256_add_epi32(a, m8), _mm256_and_si256(other, one));
+					
+					// V: both inputs had the same sign and the sum has the other
+					__m256i v = _mm256_and_si256(_mm256_and_si256(_mm256_xor_si256(a, sum), _mm256_xor_si256(m8, sum)),
+						_mm256_set1_epi32(0x80));
+					
+					nother = _mm256_andnot_si256(_mm256_set1_epi32(0x41), nother);
+					nother = _mm256_or_si256(nother, _mm256_or_si256(_mm256_srli_epi32(v, 1), _mm256_srli_epi32(sum, 8)));
+					na = nz2 = _mm256_and_si256(sum, byteMask);
+				} break;
+				
+				case MN_CMP:
+				case MN_CPX:
+				case MN_CPY:
+				{
+					__m256i reg = mn == MN_CMP ? a : mn == MN_CPX ? x : y;
+					
+					nother = WithCarry(other, _mm256_andnot_si256(_mm256_cmpgt_epi32(val, reg), one));
+					nz2 = _mm256_and_si256(_mm256_sub_epi32(reg, val), byteMask);
+				} break;
+				
+				case MN_BIT:
+				{
+					__m256i vbit = _mm256_set1_epi32(0x40);
+					
+					nother = _mm256_or_si256(_mm256_andnot_si256(vbit, nother), _mm256_and_si256(val, vbit));
+					nz2 = _mm256_or_si256(_mm256_and_si256(a, val), _mm256_slli_epi32(_mm256_and_si256(val, _mm256_set1_epi32(0x80)), 8));
+				} break;
+				
+				// Shifts, on A only
+				case MN_ASL:
+				{
+					nother = WithCarry(other, _mm256_srli_epi32(a, 7));
+					na = nz2 = _mm256_and_si256(_mm256_slli_epi32(a, 1), byteMask);
+				} break;
+				
+				case MN_LSR:
+				{
+					nother = WithCarry(other, _mm256_and_si256(a, one));
+					na = nz2 = _mm256_srli_epi32(a, 1);
+				} break;
+				
+				case MN_ROL:
+				{
+					nother = WithCarry(other, _mm256_srli_epi32(a, 7));
+					na = nz2 = _mm256_and_si256(_mm256_or_si256(_mm256_slli_epi32(a, 1), _mm256_and_si256(other, one)), byteMask);
+				} break;
+				
+				case MN_ROR:
+				{
+					nother = WithCarry(other, _mm256_and_si256(a, one));
+					na = nz2 = _mm256_or_si256(_mm256_srli_epi32(a, 1), _mm256_slli_epi32(_mm256_and_si256(other, one), 7));
+				} break;
+				
+				// Flags
+				case MN_CLC: nother = _mm256_andnot_si256(_mm256_set1_epi32(0x01), other); break;
+				case MN_SEC: nother = _mm256_or_si256(_mm256_set1_epi32(0x01), other); break;
+				case MN_CLI: nother = _mm256_andnot_si256(_mm256_set1_epi32(0x04), other); break;
+				case MN_SEI: nother = _mm256_or_si256(_mm256_set1_epi32(0x04), other); break;
+				case MN_CLD: nother = _mm256_andnot_si256(_mm256_set1_epi32(0x08), other); break;
+				case MN_SED: nother = _mm256_or_si256(_mm256_set1_epi32(0x08), other); break;
+				case MN_CLV: nother = _mm256_andnot_si256(_mm256_set1_epi32(0x40), other); break;
+				
+				case MN_JMP: next = _mm256_set1_epi32(operand); break;
+				
+				// Branches: the target is the same for every lane, taken or
+				// not is per lane
+				case MN_BCC: case MN_BCS: case MN_BEQ: case MN_BNE:
+				case MN_BMI: case MN_BPL: case MN_BVC: case MN_BVS:
+				{
+					__m256i set;	// the flag the branch tests is set
+					
+					if (mn == MN_BEQ || mn == MN_BNE)
+					{
+						set = _mm256_cmpeq_epi32(_mm256_and_si256(nz, byteMask), zero);
+					}
+					else if (mn == MN_BMI || mn == MN_BPL)
+					{
+						set = _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_and_si256(nz, _mm256_set1_epi32(0x8080)), zero), allOnes);
+					}
+					else
+					{
+						__m256i bit = _mm256_set1_epi32(mn == MN_BCC || mn == MN_BCS ? 0x01 : 0x40);
+						
+						set = _mm256_cmpeq_epi32(_mm256_and_si256(other, bit), bit);
+					}
+					
+					bool onSet = mn == MN_BEQ || mn == MN_BMI || mn == MN_BCS || mn == MN_BVS;
+					
+					__m256i taken = onSet ? set : _mm256_xor_si256(set, allOnes);
+					
+					Word from = minPC + info.Bytes;
+					Word target = from + (signed char)operand;
+					
+					next	= _mm256_blendv_epi8(next, _mm256_set1_epi32(target), taken);
+					extra	= _mm256_and_si256(taken, _mm256_set1_epi32(1 + ((target ^ from) > 0xFF)));
+				} break;
+				
+				default:
+					break;
+			}
+			
+			_mm256_store_si256((__m256i*)(A + c), _mm256_blendv_epi8(a, na, m));
+			_mm256_store_si256((__m256i*)(X + c), _mm256_blendv_epi8(x, nx, m));
+			_mm256_store_si256((__m256i*)(Y + c), _mm256_blendv_epi8(y, ny, m));
+			_mm256_store_si256((__m256i*)(SP + c), _mm256_blendv_epi8(sp, nsp, m));
+			_mm256_store_si256((__m256i*)(NZ + c), _mm256_blendv_epi8(nz, nz2, m));
+			_mm256_store_si256((__m256i*)(Other + c), _mm256_blendv_epi8(other, nother, m));
+			_mm256_store_si256((__m256i*)(PC + c), _mm256_blendv_epi8(pc, next, m));
+			_mm256_store_si256((__m256i*)(Cycles + c),
+				_mm256_blendv_epi8(cycles, _mm256_sub_epi32(cycles, _mm256_add_epi32(cost, extra)), m));
+			
+			Instructions += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+		}
+		
+		Steps++;
+		VectorSteps++;
+		
+		return true;
+	}
+#endif
+	
+	
+	// Runs every lane for budget cycles
+	void Run(sint32 budget)
+	{
+		for (uint32 l = 0; l < Lanes; l++)
+		{
+			Cycles[l] = budget;
+		}
+		
+		// Straight to RAM when every lane can take it. The vector step reads
+		// and writes MEM::Data directly, so it only runs then.
+		Plain = true;
+		
+		for (uint32 l = 0; l < Lanes; l++)
+		{
+			Plain = Plain && RamBus::Usable(Mems[l]);
+		}
+		
+#if SIMD_AVX2
+		if (Avx2 && Plain)
+		{
+			while (StepAvx2());
+			return;
+		}
+#endif
+		
+		while (StepScalar());
+	}
+};
+
+
+// NOTE: Work-stealing deque
+// Chase-Lev deque of instance indices. The owning worker pushes at the
+// bottom, anyone (the owner included) takes from the top. Taking from the
+// top on the owner side too makes each worker go round its instances in
+// order, which is what makes the slice size mean something. Fixed capacity,
+// an instance is only ever in one deque at a time so the fleet size is
+// always enough.
+struct StealDeque
+{
+	std::atomic<long long> Top;
+	std::atomic<long long> Bottom;
+	std::atomic<uint32>* Items;
+	uint32 Mask;
+	
+	void Init(uint32 capacity)
+	{
+		uint32 size = 1;
+		
+		while (size < capacity)
+		{
+			size <<= 1;
+		}
+		
+		Items = new std::atomic<uint32>[size];
+		Mask = size - 1;
+		
+		Top.store(0);
+		Bottom.store(0);
+	}
+	
+	
+	void Free()
+	{
+		delete[] Items;
+	}
+	
+	
+	// Owner only
+	void Push(uint32 item)
+	{
+		long long b = Bottom.load(std::memory_order_relaxed);
+		
+		Items[b & Mask].store(item, std::memory_order_relaxed);
+		
+		std::atomic_thread_fence(std::memory_order_release);
+		
+		Bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	
+	
+	// Anyone. False if empty or another thread won the race for the item.
+	bool Steal(uint32& item)
+	{
+		long long t = Top.load(std::memory_order_acquire);
+		
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		
+		long long b = Bottom.load(std::memory_order_acquire);
+		
+		if (t >= b)
+		{
+			return false;
+		}
+		
+		item = Items[t & Mask].load(std::memory_order_relaxed);
+		
+		return Top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+	}
+};
+
+
+// NOTE: Fleet
+// Runs many independent CPU+MEM pairs on all cores. Every instance gets a
+// cycle budget which is handed out in slices of Slice cycles, one slice per
+// trip through a worker's deque. Workers that run dry steal from the
+// others. Instances share nothing, so the only shared writes are the deque
+// indices and the count of instances still running.
+// Each instance is its own allocation, held through a pointer: a MEM is
+// most of it (64K of RAM plus the page table, page counters and watch
+// bits), and the fleet only ever moves indices around, never instances.
+struct Fleet
+{
+	struct Instance
+	{
+		CPU Cpu;
+		sint32 Remaining;	// cycles left in the budget
+		MEM Memory;			// last, so the CPU and Remaining share a line
+	};
+	
+	// Sets up one instance (program, registers), called once per index
+	using Loader = void (*)(uint32 index, CPU& cpu, MEM& memory);
+	
+	struct Worker
+	{
+		StealDeque Queue;
+		uint64 Slices, Steals;
+		
+		// Keep workers off each other's cache lines
+		char Pad[64];
+	};
+	
+	Instance** Instances;
+	uint32 Count;
+	
+	Worker* Workers;
+	uint32 Threads;
+	
+	sint32 Slice;
+	
+	std::atomic<uint32> Running;
+	
+	void Init(uint32 count, uint32 threads, sint32 slice, sint32 budget, Loader load)
+	{
+		Count	= count;
+		Threads	= threads ? threads : 1;
+		Slice	= slice;
+		
+		Instances = new Instance*[Count];
+		Workers = new Worker[Threads];
+		
+		for (uint32 i = 0; i < Threads; i++)
+		{
+			Workers[i].Queue.Init(Count);
+			Workers[i].Slices = Workers[i].Steals = 0;
+		}
+		
+		for (uint32 i = 0; i < Count; i++)
+		{
+			Instances[i] = new Instance;
+			
+			Instance& instance = *Instances[i];
+			
+			instance.Cpu.Reset(instance.Memory);
+			
+			load(i, instance.Cpu, instance.Memory);
+			
+			instance.Remaining = budget;
+			
+			Workers[i % Threads].Queue.Push(i);
+		}
+		
+		Running.store(Count);
+	}
+	
+	
+	void Free()
+	{
+		for (uint32 i = 0; i < Threads; i++)
+		{
+			Workers[i].Queue.Free();
+		}
+		
+		for (uint32 i = 0; i < Count; i++)
+		{
+			delete Instances[i];
+		}
+		
+		delete[] Workers;
+		delete[] Instances;
+	}
+	
+	
+	void Work(uint32 self)
+	{
+		Worker& me = Workers[self];
+		
+		uint32 victim = self;
+		
+		while (Running.load(std::memory_order_relaxed) > 0)
+		{
+			uint32 index;
+			
+			if (!me.Queue.Steal(index))
+			{
+				victim = (victim + 1) % Threads;
+				
+				if (victim == self || !Workers[victim].Queue.Steal(index))
+				{
+					std::this_thread::yield();
+					continue;
+				}
+				
+				me.Steals++;
+			}
+			
+			Instance& instance = *Instances[index];
+			
+			sint32 slice = instance.Remaining < Slice ? instance.Remaining : Slice;
+			
+			instance.Remaining -= instance.Cpu.Exec(slice, instance.Memory);
+			
+			me.Slices++;
+			
+			if (instance.Remaining > 0)
+			{
+				me.Queue.Push(index);
+			}
+			else
+			{
+				Running.fetch_sub(1, std::memory_order_relaxed);
+			}
+		}
+	}
+	
+	
+	// Runs every instance to the end of its budget
+	void Run()
+	{
+		std::thread* threads = new std::thread[Threads];
+		
+		for (uint32 i = 1; i < Threads; i++)
+		{
+			threads[i] = std::thread(&Fleet::Work, this, i);
+		}
+		
+		Work(0);
+		
+		for (uint32 i = 1; i < Threads; i++)
+		{
+			threads[i].join();
+		}
+		
+		delete[] threads;
+	}
+	
+	
+	uint64 Instructions() const
+	{
+		uint64 total = 0;
+		
+		for (uint32 i = 0; i < Count; i++)
+		{
+			total += Instances[i]->Cpu.Instructions;
+		}
+		
+		return total;
+	}
+	
+	
+	// What one instance costs, its pointer included
+	static constexpr uint32 BYTES_PER_INSTANCE = sizeof(Instance) + sizeof(Instance*);
+};
+
+
+// NOTE: Disassembler
+// One instruction at pc into text, in the usual syntax (LDA $12,X, JMP
+// ($1234), branches with their target). Reads with Peek so watchpoints do
+// not go off. Returns the instruction's length, 1 for an opcode the ISA
+// does not have (written as .BYTE).
+template <typename Chip = Nmos6502>
+static uint32 Disassemble(const MEM& memory, Word pc, char* text, uint32 size)
+{
+	Byte opcode = memory.Peek(pc);
+	const OpInfo& info = VARIANT_OPS<Chip>.Ops[opcode];
+	
+	if (!info.Name)
+	{
+		snprintf(text, size, ".BYTE $%02X", opcode);
+		return 1;
+	}
+	
+	const char* mnemonic = MNEMONIC_NAMES[info.Instruction];
+	
+	Word operand = 0;
+	
+	if (info.Bytes >= 2) operand = memory.Peek((Word)(pc + 1));
+	if (info.Bytes >= 3) operand |= memory.Peek((Word)(pc + 2)) << 8;
+	
+	switch (info.Mode)
+	{
+		case AM_IMP:	snprintf(text, size, "%s", mnemonic);						break;
+		case AM_ACC:	snprintf(text, size, "%s A", mnemonic);						break;
+		case AM_IMM:	snprintf(text, size, "%s #$%02X", mnemonic, operand);		break;
+		case AM_ZP:		snprintf(text, size, "%s $%02X", mnemonic, operand);		break;
+		case AM_ZPX:	snprintf(text, size, "%s $%02X,X", mnemonic, operand);		break;
+		case AM_ZPY:	snprintf(text, size, "%s $%02X,Y", mnemonic, operand);		break;
+		case AM_ABS:	snprintf(text, size, "%s $%04X", mnemonic, operand);		break;
+		case AM_ABX:	snprintf(text, size, "%s $%04X,X", mnemonic, operand);		break;
+		case AM_ABY:	snprintf(text, size, "%s $%04X,Y", mnemonic, operand);		break;
+		case AM_IND:	snprintf(text, size, "%s ($%04X)", mnemonic, operand);		break;
+		case AM_IZX:	snprintf(text, size, "%s ($%02X,X)", mnemonic, operand);	break;
+		case AM_IZY:	snprintf(text, size, "%s ($%02X),Y", mnemonic, operand);	break;
+		case AM_IZP:	snprintf(text, size, "%s ($%02X)", mnemonic, operand);		break;
+		case AM_IAX:	snprintf(text, size, "%s ($%04X,X)", mnemonic, operand);	break;
+		case AM_REL:	snprintf(text, size, "%s $%04X", mnemonic, (Word)(pc + 2 + (signed char)operand));	break;
+	}
+	
+	return info.Bytes;
+}
+
+
+// NOTE: Implementation
+// What is not inline, see the top of the file.
+#if defined(PAL6502_IMPLEMENTATION)
+
+// NOTE: Delta trace writer
+bool DeltaTraceWriter::Open(const char* path, CPU& cpu, MEM& memory, uint32 interval)
+{
+	File = fopen(path, "wb");
+	
+	if (!File)
+	{
+		return false;
+	}
+	
+	Interval = interval ? interval : 1;
+	Ok = true;
+	
+	Bits = 0;
+	BitCount = 0;
+	Used = 0;
+	Offset = 0;
+	
+	Index = nullptr;
+	Keyframes = IndexCapacity = 0;
+	
+	State.Index		= 0;
+	State.Cycle		= 0;
+	State.NextPC	= cpu.PC;
+	State.SP		= cpu.SP;
+	State.A			= cpu.A;
+	State.X			= cpu.X;
+	State.Y			= cpu.Y;
+	State.P			= cpu.GetStatus();
+	
+	memcpy(Memory, memory.Data, sizeof(Memory));
+	
+	Writes = 0;
+	
+	Observer = WriteObserver{ ObserveWrite, this };
+	
+	memory.Observer = &Observer;
+	cpu.Recorder = this;
+	
+	DeltaTrace::FileHeader header = { { 'P', '6', 'D', 'T' }, 1, Interval, 0 };
+	
+	PutBytes(&header, sizeof(header));
+	
+	Keyframe();
+	
+	return true;
+}
+
+
+void DeltaTraceWriter::Record(const CPU& cpu, Word pc, Byte opcode, sint32 cycles)
+{
+	if (State.Index != 0 && State.Index % Interval == 0)
+	{
+		Keyframe();
+	}
+	
+	const OpInfo& info = OP_INFO.Ops[opcode];
+	
+	Put(pc == State.NextPC, 1);
+	
+	if (pc != State.NextPC)
+	{
+		Put(pc, 16);
+	}
+	
+	Put(opcode == Memory[pc], 1);
+	
+	if (opcode != Memory[pc])
+	{
+		Put(opcode, 8);
+	}
+	
+	Byte spent = cycles < 255 ? cycles : 255;
+	
+	Put(spent == info.Cycles, 1);
+	
+	if (spent != info.Cycles)
+	{
+		Put(spent, 8);
+	}
+	
+	Byte p = cpu.GetStatus();
+	bool predicted = p == DeltaTrace::PredictP(State.P, opcode, cpu.A, cpu.X, cpu.Y);
+	
+	if (cpu.X == State.X && cpu.Y == State.Y && cpu.SP == State.SP && predicted)
+	{
+		Put(1, 1);
+		
+		Put(cpu.A != State.A, 1);
+		
+		if (cpu.A != State.A)
+		{
+			Put(cpu.A, 8);
+		}
+	}
+	else
+	{
+		Put(0, 1);
+		
+		Put(cpu.A != State.A, 1);
+		
+		if (cpu.A != State.A)
+		{
+			Put(cpu.A, 8);
+		}
+		
+		Put(cpu.X != State.X, 1);
+		
+		if (cpu.X != State.X)
+		{
+			Put(cpu.X, 8);
+		}
+		
+		Put(cpu.Y != State.Y, 1);
+		
+		if (cpu.Y != State.Y)
+		{
+			Put(cpu.Y, 8);
+		}
+		
+		Put(cpu.SP != State.SP, 1);
+		
+		if (cpu.SP != State.SP)
+		{
+			Put(cpu.SP, 16);
+		}
+		
+		Put(predicted, 1);
+		
+		if (!predicted)
+		{
+			Put(p, 8);
+		}
+	}
+	
+	Word address = 0;
+	
+	for (uint32 i = 0; i < Writes; i++)
+	{
+		Put(1, 1);
+		
+		Put(WriteAddress[i] == (Word)(address + 1), 1);
+		
+		if (WriteAddress[i] != (Word)(address + 1))
+		{
+			Put(WriteAddress[i], 16);
+		}
+		
+		Put(WriteValue[i], 8);
+		
+		address = WriteAddress[i];
+		Memory[address] = WriteValue[i];
+	}
+	
+	Put(0, 1);
+	
+	Writes = 0;
+	
+	State.Index++;
+	State.Cycle		+= spent;
+	State.NextPC	= pc + info.Bytes;
+	State.A			= cpu.A;
+	State.X			= cpu.X;
+	State.Y			= cpu.Y;
+	State.P			= p;
+	State.SP		= cpu.SP;
+}
+
+
+bool DeltaTraceWriter::Close(CPU& cpu, MEM& memory)
+{
+	memory.Observer = nullptr;
+	cpu.Recorder = nullptr;
+	
+	Align();
+	
+	DeltaTrace::FileFooter footer = { State.Index, Offset, Keyframes, { 'P', '6', 'D', 'T' } };
+	
+	PutBytes(Index, Keyframes * 2 * sizeof(uint64));
+	PutBytes(&footer, sizeof(footer));
+	
+	Flush();
+	
+	delete[] Index;
+	Index = nullptr;
+	
+	return fclose(File) == 0 && Ok;
+}
+
+
+// NOTE: Condition evaluation
+bool Condition::Eval(const CPU& cpu, const MEM& memory) const
+{
+	sint32 stack[MAX_DEPTH];
+	uint32 depth = 0;
+	
+	for (uint32 i = 0; ; )
+	{
+		switch (Code[i++])
+		{
+			case OP_END:
+			{
+				return stack[0] != 0;
+			}
+			
+			case OP_PUSH:
+			{
+				stack[depth++] = Code[i] | (Code[i + 1] << 8);
+				i += 2;
+			} break;
+			
+			case OP_REG:
+			{
+				sint32 val = 0;
+				
+				switch (Code[i++])
+				{
+					case REG_A:		val = cpu.A;			break;
+					case REG_X:		val = cpu.X;			break;
+					case REG_Y:		val = cpu.Y;			break;
+					case REG_SP:	val = cpu.SP;			break;
+					case REG_PC:	val = cpu.PC;			break;
+					case REG_P:		val = cpu.GetStatus();	break;
+					case REG_C:		val = cpu.C;			break;
+					case REG_Z:		val = cpu.GetZ();		break;
+					case REG_I:		val = cpu.I;			break;
+					case REG_D:		val = cpu.D;			break;
+					case REG_B:		val = cpu.B;			break;
+					case REG_V:		val = cpu.V;			break;
+					case REG_N:		val = cpu.GetN();		break;
+				}
+				
+				stack[depth++] = val;
+			} break;
+			
+			case OP_MEM:	stack[depth - 1] = memory.Peek(stack[depth - 1] & (MEM::MAX_MEM - 1));	break;
+			case OP_NOT:	stack[depth - 1] = !stack[depth - 1];	break;
+			case OP_NEG:	stack[depth - 1] = -stack[depth - 1];	break;
+			case OP_INV:	stack[depth - 1] = ~stack[depth - 1];	break;
+			case OP_BOOL:	stack[depth - 1] = stack[depth - 1] != 0;	break;
+			case OP_POP:	depth--;	break;
+			
+#define BINARY(op, expr) \
+			case op: \
+			{ \
+				sint32 b = stack[--depth]; \
+				sint32 a = stack[depth - 1]; \
+				stack[depth - 1] = (expr); \
+			} break;
+			
+			BINARY(OP_ADD, a + b)
+			BINARY(OP_SUB, a - b)
+			BINARY(OP_AND, a & b)
+			BINARY(OP_OR, a | b)
+			BINARY(OP_XOR, a ^ b)
+			BINARY(OP_EQ, a == b)
+			BINARY(OP_NE, a != b)
+			BINARY(OP_LT, a < b)
+			BINARY(OP_LE, a <= b)
+			BINARY(OP_GT, a > b)
+			BINARY(OP_GE, a >= b)
+#undef BINARY
+			
+			case OP_JFALSE:
+			{
+				Byte offset = Code[i++];
+				
+				if (stack[depth - 1] == 0)
+				{
+					i += offset;
+				}
+			} break;
+			
+			case OP_JTRUE:
+			{
+				Byte offset = Code[i++];
+				
+				if (stack[depth - 1] != 0)
+				{
+					i += offset;
+				}
+			} break;
+		}
+	}
+}
+
+
+bool Breakpoints::Hit(const CPU& cpu, const MEM& memory)
+{
+	Word pc = cpu.PC;
+	bool stop = (Plain[pc >> 6] >> (pc & 63)) & 1;
+	
+	for (uint32 i = 0; i < ConditionCount; i++)
+	{
+		Conditional& conditional = Conditions[i];
+		
+		if (conditional.PC != pc || !conditional.When.Eval(cpu, memory))
+		{
+			continue;
+		}
+		
+		conditional.Hits++;
+		
+		if (!conditional.Tracepoint)
+		{
+			stop = true;
+		}
+		else if (Output)
+		{
+			fprintf(Output, "tracepoint pc=%04X a=%02X x=%02X y=%02X sp=%02X p=%02X\n",
+				pc, cpu.A, cpu.X, cpu.Y, cpu.SP, cpu.GetStatus());
+		}
+	}
+	
+	return stop;
+}
+
+
+// NOTE: Undo log
+void UndoLog::Attach(CPU& cpu, MEM& memory, uint32 interval)
+{
+	Steps = nullptr;
+	Writes = nullptr;
+	Checkpoints = nullptr;
+	Count = Capacity = 0;
+	WriteCount = WriteCapacity = 0;
+	CheckpointCount = CheckpointCapacity = 0;
+	
+	Interval = interval ? interval : 1;
+	BaseInstructions = cpu.Instructions;
+	Paused = false;
+	
+	Memory = &memory;
+	Observer = WriteObserver{ ObserveWrite, this };
+	Previous = memory.Observer;
+	
+	memory.Observer = &Observer;
+	cpu.History = this;
+}
+
+
+void UndoLog::Detach(CPU& cpu)
+{
+	if (Memory->Observer == &Observer)
+	{
+		Memory->Observer = Previous;
+	}
+	
+	cpu.History = nullptr;
+}
+
+
+void UndoLog::Free()
+{
+	for (uint64 i = 0; i < CheckpointCount; i++)
+	{
+		delete[] Checkpoints[i].Data;
+	}
+	
+	delete[] Checkpoints;
+	delete[] Writes;
+	delete[] Steps;
+	
+	Steps = nullptr;
+	Writes = nullptr;
+	Checkpoints = nullptr;
+	Count = WriteCount = CheckpointCount = 0;
+}
+
+
+void UndoLog::ObserveWrite(void* context, uint32 address, Byte val)
+{
+	UndoLog* log = (UndoLog*)context;
+	
+	if (log->Previous)
+	{
+		log->Previous->Write(log->Previous->Context, address, val);
+	}
+	
+	if (log->Paused || !log->Memory->IsPlain(address >> 8))
+	{
+		return;
+	}
+	
+	Grow(log->Writes, log->WriteCapacity, log->WriteCount + 1);
+	
+	log->Writes[log->WriteCount++] = WriteEntry{ (Word)address, log->Memory->Data[address] };
+}
+
+
+void UndoLog::Begin(const CPU& cpu)
+{
+	if (Count % Interval == 0 && (CheckpointCount == 0 || Checkpoints[CheckpointCount - 1].Step != Count))
+	{
+		Grow(Checkpoints, CheckpointCapacity, CheckpointCount + 1);
+		
+		Byte* data = new Byte[MEM::MAX_MEM];
+		
+		memcpy(data, Memory->Data, MEM::MAX_MEM);
+		
+		Checkpoints[CheckpointCount++] = Checkpoint{ Count, data };
+	}
+	
+	Grow(Steps, Capacity, Count + 1);
+	
+	Step& step = Steps[Count++];
+	
+	step.FirstWrite	= WriteCount;
+	step.PC			= cpu.PC;
+	step.SP			= cpu.SP;
+	step.NZ			= cpu.NZ;
+	step.A			= cpu.A;
+	step.X			= cpu.X;
+	step.Y			= cpu.Y;
+	step.Flags		= cpu.Flags;
+	step.Cycles		= 0;
+	step.Pad		= 0;
+}
+
+
+void UndoLog::GoTo(CPU& cpu, uint64 step)
+{
+	if (step >= Count)
+	{
+		return;
+	}
+	
+	// Closest checkpoint at or below the target
+	uint64 c = CheckpointCount;
+	
+	while (c > 0 && Checkpoints[c - 1].Step > step)
+	{
+		c--;
+	}
+	
+	bool forward = c > 0 && step - Checkpoints[c - 1].Step < Count - step;
+	
+	if (forward)
+	{
+		const Checkpoint& checkpoint = Checkpoints[c - 1];
+		
+		for (uint32 page = 0; page < MEM::PAGES; page++)
+		{
+			if (Memory->IsPlain(page) && memcmp(Memory->Data + page * 256, checkpoint.Data + page * 256, 256) != 0)
+			{
+				Memory->Load(page * 256, checkpoint.Data + page * 256, 256);
+			}
+		}
+	}
+	else
+	{
+		for (uint64 w = WriteCount; w > Steps[step].FirstWrite; w--)
+		{
+			Memory->Load(Writes[w - 1].Address, &Writes[w - 1].Old, 1);
+		}
+	}
+	
+	// Registers as the run left them at the checkpoint, or at the target
+	const Step& from = Steps[forward ? Checkpoints[c - 1].Step : step];
+	
+	cpu.PC	= from.PC;
+	cpu.SP	= from.SP;
+	cpu.NZ	= from.NZ;
+	cpu.A	= from.A;
+	cpu.X	= from.X;
+	cpu.Y	= from.Y;
+	cpu.Flags	= from.Flags;
+	
+	cpu.Instructions = BaseInstructions + (forward ? Checkpoints[c - 1].Step : step);
+	
+	if (forward)
+	{
+		Paused = true;
+		
+		for (uint64 i = Checkpoints[c - 1].Step; i < step; i++)
+		{
+			cpu.Step(*Memory);
+		}
+		
+		Paused = false;
+	}
+	
+	WriteCount = Steps[step].FirstWrite;
+	Count = step;
+	
+	while (CheckpointCount > 0 && Checkpoints[CheckpointCount - 1].Step > step)
+	{
+		delete[] Checkpoints[--CheckpointCount].Data;
+	}
+}
+
+
+bool UndoLog::BackToWrite(CPU& cpu, Word address)
+{
+	uint64 w = WriteCount;
+	
+	while (w > 0 && Writes[w - 1].Address != address)
+	{
+		w--;
+	}
+	
+	if (w == 0)
+	{
+		return false;
+	}
+	
+	// Last step whose writes start at or before it
+	uint64 low = 0, high = Count;
+	
+	while (high - low > 1)
+	{
+		uint64 mid = (low + high) / 2;
+		
+		if (Steps[mid].FirstWrite <= w - 1)
+		{
+			low = mid;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	
+	GoTo(cpu, low);
+	
+	return true;
+}
+
+
+// NOTE: x86-64 code generation
+// Register use inside a block:
+//	rdi		CPU*
+//	rsi		MEM* (MEM::Data is at offset 0)
+//	r8d		A
+//	r9d		X
+//	r10d	Y
+//	r11d	NZ
+//	ebx		CPU::Flags (saved, it is callee-saved)
+//	ecx		cycles taken past the base ones (page crossings, branches)
+//	eax, edx	scratch, edx holds the effective address
+// Carry and overflow come straight out of the host's CF and OF: x86 ADC,
+// SBB, RCL and friends do the same thing to them as the 6502 in binary mode.
+struct Emitter
+{
+	Byte* Code;
+	uint32 Size;
+	
+	void B(Byte b)
+	{
+		Code[Size++] = b;
+	}
+	
+	
+	void Bytes(std::initializer_list<Byte> bytes)
+	{
+		for (Byte b : bytes)
+		{
+			B(b);
+		}
+	}
+	
+	
+	void D16(uint32 v)
+	{
+		B(v & 0xFF);
+		B((v >> 8) & 0xFF);
+	}
+	
+	
+	void D32(uint32 v)
+	{
+		D16(v & 0xFFFF);
+		D16(v >> 16);
+	}
+	
+	
+	// A short forward jump; returns where it ends, for Land
+	uint32 Skip(Byte jcc)
+	{
+		Bytes({ jcc, 0x00 });
+		
+		return Size;
+	}
+	
+	
+	void Land(uint32 from)
+	{
+		Code[from - 1] = Size - from;
+	}
+	
+	
+	void StorePC(Word pc)
+	{
+		Bytes({ 0x66, 0xC7, 0x87 }); D32(offsetof(CPU, PC)); D16(pc);	// mov word [rdi+PC], imm16
+	}
+	
+	
+	// CPU::C from the host carry: bit 0 of bl goes out and CF comes in
+	void CarryFromHost()
+	{
+		Bytes({ 0xD0, 0xDB });						// rcr bl, 1
+		Bytes({ 0xD0, 0xC3 });						// rol bl, 1
+	}
+	
+	
+	void CarryToHost()
+	{
+		Bytes({ 0x0F, 0xBA, 0xE3, 0x00 });			// bt ebx, 0
+	}
+	
+	
+	// N and Z from the low byte of a host register, like `NZ = A`
+	void SetNZ(Byte reg)
+	{
+		Bytes({ 0x45, 0x89, (Byte)(0xC3 | (reg << 3)) });	// mov r11d, r8d/r9d/r10d
+	}
+	
+	
+	// Effective address of op into edx, and the page crossing cycle into
+	// ecx where the ISA charges one. Same as CPU::Address.
+	void Address(const BlockCache::MicroOp& op, AddressMode mode)
+	{
+		bool page = op.Flags & OPF_PAGE;
+		
+		switch (mode)
+		{
+			case AM_ZP:
+			case AM_ABS:
+			{
+				B(0xBA); D32(op.Operand);							// mov edx, imm32
+			} break;
+			
+			
+			case AM_ZPX:
+			case AM_ZPY:
+			{
+				Bytes({ 0x41, 0x8D, (Byte)(mode == AM_ZPX ? 0x91 : 0x92) }); D32(op.Operand);	// lea edx, [r9/r10+zp]
+				Bytes({ 0x0F, 0xB6, 0xD2 });						// movzx edx, dl (wraps in the zero page)
+			} break;
+			
+			
+			case AM_ABX:
+			case AM_ABY:
+			{
+				Byte index = mode == AM_ABX ? 0x01 : 0x02;
+				
+				if (page)
+				{
+					Bytes({ 0x41, 0x8D, (Byte)(0x80 | index) }); D32(op.Operand & 0xFF);	// lea eax, [r9/r10+lo]
+					Bytes({ 0xC1, 0xE8, 0x08 });					// shr eax, 8 (1 if it carried into the high byte)
+					Bytes({ 0x01, 0xC1 });							// add ecx, eax
+				}
+				
+				Bytes({ 0x41, 0x8D, (Byte)(0x90 | index) }); D32(op.Operand);	// lea edx, [r9/r10+abs]
+				Bytes({ 0x0F, 0xB7, 0xD2 });						// movzx edx, dx
+			} break;
+			
+			
+			case AM_IZX:
+			{
+				Bytes({ 0x41, 0x8D, 0x81 }); D32(op.Operand);		// lea eax, [r9+zp]
+				Bytes({ 0x0F, 0xB6, 0xC0 });						// movzx eax, al
+				Bytes({ 0x0F, 0xB6, 0x14, 0x06 });					// movzx edx, byte [rsi+rax]
+				Bytes({ 0xFE, 0xC0 });								// inc al (the pointer wraps in the zero page too)
+				Bytes({ 0x0F, 0xB6, 0x04, 0x06 });					// movzx eax, byte [rsi+rax]
+				Bytes({ 0xC1, 0xE0, 0x08 });						// shl eax, 8
+				Bytes({ 0x09, 0xC2 });								// or edx, eax
+			} break;
+			
+			
+			case AM_IZY:
+			{
+				Bytes({ 0x0F, 0xB6, 0x96 }); D32(op.Operand);			// movzx edx, byte [rsi+zp]
+				Bytes({ 0x0F, 0xB6, 0x86 }); D32((Byte)(op.Operand + 1));	// movzx eax, byte [rsi+zp+1]
+				Bytes({ 0xC1, 0xE0, 0x08 });						// shl eax, 8
+				Bytes({ 0x09, 0xC2 });								// or edx, eax
+				
+				if (page)
+				{
+					Bytes({ 0x0F, 0xB6, 0xC2 });					// movzx eax, dl
+					Bytes({ 0x44, 0x01, 0xD0 });					// add eax, r10d
+					Bytes({ 0xC1, 0xE8, 0x08 });					// shr eax, 8
+					Bytes({ 0x01, 0xC1 });							// add ecx, eax
+				}
+				
+				Bytes({ 0x44, 0x01, 0xD2 });						// add edx, r10d
+				Bytes({ 0x0F, 0xB7, 0xD2 });						// movzx edx, dx
+			} break;
+			
+			
+			default:
+				break;
+		}
+	}
+	
+	
+	// The value op reads into eax
+	void Operand(const BlockCache::MicroOp& op, AddressMode mode)
+	{
+		if (mode == AM_IMM)
+		{
+			B(0xB8); D32(op.Operand & 0xFF);						// mov eax, imm32
+			
+			return;
+		}
+		
+		Address(op, mode);
+		Bytes({ 0x0F, 0xB6, 0x04, 0x16 });							// movzx eax, byte [rsi+rdx]
+	}
+	
+	
+	// What MEM::WriteByte does besides the store, for the address in edx:
+	// bump the page write counter and set the page's dirty bit. Leaves the
+	// page in edx.
+	void MarkPageWritten()
+	{
+		Bytes({ 0xC1, 0xEA, 0x08 });				// shr edx, 8
+		Bytes({ 0xFF, 0x84, 0x96 });				// inc dword [rsi+rdx*4+PageWrites]
+		D32(offsetof(MEM, PageWrites));
+		Bytes({ 0x0F, 0xAB, 0x96 });				// bts dword [rsi+Dirty], edx
+		D32(offsetof(MEM, Dirty));
+	}
+	
+	
+	// The way out with everything up to and including `count` instructions
+	// done. Jumps to `exit` when it is known, otherwise adds itself to the
+	// list Compile patches once it is.
+	void Leave(const BlockCache::Block& block, uint32 count, uint32* exits, uint32& exitCount)
+	{
+		sint32 base = 0;
+		
+		for (uint32 i = 0; i < count; i++)
+		{
+			base += block.Ops[i].Cycles;
+		}
+		
+		Bytes({ 0x81, 0xC1 }); D32(base);			// add ecx, base cycles
+		B(0xBA); D32(count);						// mov edx, count
+		B(0xE9); D32(0);							// jmp exit
+		
+		exits[exitCount++] = Size;
+	}
+	
+	
+	// After a store (page in edx): if it went to a page the block was
+	// decoded from, leave right after it, so the interpreter decodes the
+	// rest again. Same as the check in ExecCached.
+	void CheckOwnPage(const BlockCache::Block& block, uint32 i, uint32* exits, uint32& exitCount)
+	{
+		if (i + 1 == block.Count)
+		{
+			return;		// nothing left to go stale
+		}
+		
+		Bytes({ 0x81, 0xFA }); D32(block.Page[0]);		// cmp edx, page 0
+		uint32 own = Skip(0x74);						// je own
+		Bytes({ 0x81, 0xFA }); D32(block.Page[1]);		// cmp edx, page 1
+		uint32 other = Skip(0x75);						// jne other
+		Land(own);
+		StorePC(block.Ops[i].Next);
+		Leave(block, i + 1, exits, exitCount);
+		Land(other);
+	}
+};
+
+
+bool Jit::Compile(BlockCache::Block& block)
+{
+#if JIT_AVAILABLE
+	if (!Arena)
+	{
+		return false;
+	}
+	
+	if (Used + MAX_CODE > ARENA_SIZE)
+	{
+		Used = 0;
+		Epoch++;
+		Flushes++;
+	}
+	
+	// Written through one view, run from the other. Every jump in a block
+	// is relative and stays inside it, so the code does not mind.
+	Emitter e = { Writable + Used, 0 };
+	
+	uint32 exits[BlockCache::MAX_OPS + 1];
+	uint32 exitCount = 0;
+	
+	bool decimal = false;
+	bool known = true;
+	
+	for (uint32 i = 0; i < block.Count; i++)
+	{
+		decimal |= OP_INFO.Ops[block.Ops[i].Opcode].Instruction == MN_ADC
+			|| OP_INFO.Ops[block.Ops[i].Opcode].Instruction == MN_SBC;
+	}
+	
+	// Prologue: guest registers into host registers
+	e.B(0x53);														// push rbx
+	e.Bytes({ 0x0F, 0xB6, 0x9F }); e.D32(offsetof(CPU, Flags));	// movzx ebx, byte [rdi+Flags]
+	
+	// Only binary ADC/SBC are compiled: in decimal mode hand the block
+	// back to the interpreter before it has done anything
+	if (decimal)
+	{
+		e.Bytes({ 0xF6, 0xC3, 0x08 });								// test bl, D
+		uint32 binary = e.Skip(0x74);								// jz binary
+		e.B(0xB8); e.D32(~0u);										// mov eax, -1
+		e.B(0x5B);													// pop rbx
+		e.B(0xC3);													// ret
+		e.Land(binary);
+	}
+	
+	e.Bytes({ 0x44, 0x0F, 0xB6, 0x87 }); e.D32(offsetof(CPU, A));	// movzx r8d, byte [rdi+A]
+	e.Bytes({ 0x44, 0x0F, 0xB6, 0x8F }); e.D32(offsetof(CPU, X));	// movzx r9d, byte [rdi+X]
+	e.Bytes({ 0x44, 0x0F, 0xB6, 0x97 }); e.D32(offsetof(CPU, Y));	// movzx r10d, byte [rdi+Y]
+	e.Bytes({ 0x44, 0x0F, 0xB7, 0x9F }); e.D32(offsetof(CPU, NZ));	// movzx r11d, word [rdi+NZ]
+	e.Bytes({ 0x31, 0xC9 });										// xor ecx, ecx
+	
+	const BlockCache::MicroOp& last = block.Ops[block.Count - 1];
+	bool pcSet = false;		// by the last instruction itself
+	
+	for (uint32 i = 0; i < block.Count && known; i++)
+	{
+		const BlockCache::MicroOp& op = block.Ops[i];
+		const OpInfo& info = OP_INFO.Ops[op.Opcode];
+		
+		// Room for the longest instruction and the way out
+		if (e.Size + 256 > MAX_CODE)
+		{
+			known = false;
+			break;
+		}
+		
+		switch (info.Instruction)
+		{
+			// Loads and stores
+			case MN_LDA:
+			case MN_LDX:
+			case MN_LDY:
+			{
+				Byte reg = info.Instruction == MN_LDA ? 0 : info.Instruction == MN_LDX ? 1 : 2;
+				
+				e.Operand(op, info.Mode);
+				e.Bytes({ 0x41, 0x89, (Byte)(0xC0 | reg) });				// mov r8d/r9d/r10d, eax
+				e.Bytes({ 0x41, 0x89, 0xC3 });								// mov r11d, eax
+			} break;
+			
+			
+			case MN_STA:
+			case MN_STX:
+			case MN_STY:
+			{
+				Byte reg = info.Instruction == MN_STA ? 0 : info.Instruction == MN_STX ? 1 : 2;
+				
+				e.Address(op, info.Mode);
+				e.Bytes({ 0x44, 0x88, (Byte)(0x04 | (reg << 3)), 0x16 });	// mov [rsi+rdx], r8b/r9b/r10b
+				e.MarkPageWritten();
+				e.CheckOwnPage(block, i, exits, exitCount);
+			} break;
+			
+			
+			// Transfers
+			case MN_TAX: { e.Bytes({ 0x45, 0x89, 0xC1 }); e.SetNZ(1); } break;	// mov r9d, r8d
+			case MN_TAY: { e.Bytes({ 0x45, 0x89, 0xC2 }); e.SetNZ(2); } break;	// mov r10d, r8d
+			case MN_TXA: { e.Bytes({ 0x45, 0x89, 0xC8 }); e.SetNZ(0); } break;	// mov r8d, r9d
+			case MN_TYA: { e.Bytes({ 0x45, 0x89, 0xD0 }); e.SetNZ(0); } break;	// mov r8d, r10d
+			
+			case MN_TSX:
+			{
+				e.Bytes({ 0x44, 0x0F, 0xB6, 0x8F }); e.D32(offsetof(CPU, SP));	// movzx r9d, byte [rdi+SP]
+				e.SetNZ(1);
+			} break;
+			
+			
+			case MN_TXS:
+			{
+				e.Bytes({ 0x44, 0x88, 0x8F }); e.D32(offsetof(CPU, SP));		// mov [rdi+SP], r9b
+			} break;
+			
+			
+			case MN_INX: { e.Bytes({ 0x41, 0xFE, 0xC1 }); e.SetNZ(1); } break;	// inc r9b
+			case MN_INY: { e.Bytes({ 0x41, 0xFE, 0xC2 }); e.SetNZ(2); } break;	// inc r10b
+			case MN_DEX: { e.Bytes({ 0x41, 0xFE, 0xC9 }); e.SetNZ(1); } break;	// dec r9b
+			case MN_DEY: { e.Bytes({ 0x41, 0xFE, 0xCA }); e.SetNZ(2); } break;	// dec r10b
+			
+			
+			// Arithmetic and logic
+			case MN_AND:
+			case MN_ORA:
+			case MN_EOR:
+			{
+				Byte alu = info.Instruction == MN_AND ? 0x21 : info.Instruction == MN_ORA ? 0x09 : 0x31;
+				
+				e.Operand(op, info.Mode);
+				e.Bytes({ 0x41, alu, 0xC0 });								// and/or/xor r8d, eax
+				e.SetNZ(0);
+			} break;
+			
+			
+			case MN_ADC:
+			case MN_SBC:
+			{
+				e.Operand(op, info.Mode);
+				e.CarryToHost();
+				
+				if (info.Instruction == MN_ADC)
+				{
+					e.Bytes({ 0x41, 0x10, 0xC0 });							// adc r8b, al
+				}
+				else
+				{
+					// The 6502 borrows when C is clear, x86 when CF is set
+					e.B(0xF5);												// cmc
+					e.Bytes({ 0x41, 0x18, 0xC0 });							// sbb r8b, al
+					e.B(0xF5);												// cmc
+				}
+				
+				e.Bytes({ 0x0F, 0x90, 0xC0 });								// seto al
+				e.Bytes({ 0x0F, 0x92, 0xC2 });								// setc dl
+				e.Bytes({ 0xC0, 0xE0, 0x06 });								// shl al, 6
+				e.Bytes({ 0x08, 0xD0 });									// or al, dl
+				e.Bytes({ 0x80, 0xE3, 0xBE });								// and bl, ~(V | C)
+				e.Bytes({ 0x08, 0xC3 });									// or bl, al
+				e.SetNZ(0);
+			} break;
+			
+			
+			case MN_CMP:
+			case MN_CPX:
+			case MN_CPY:
+			{
+				Byte reg = info.Instruction == MN_CMP ? 0 : info.Instruction == MN_CPX ? 1 : 2;
+				
+				e.Operand(op, info.Mode);
+				e.Bytes({ 0x44, 0x89, (Byte)(0xC2 | (reg << 3)) });		// mov edx, r8d/r9d/r10d
+				e.Bytes({ 0x29, 0xC2 });									// sub edx, eax
+				e.B(0xF5);													// cmc (C is "no borrow")
+				e.CarryFromHost();
+				e.Bytes({ 0x44, 0x0F, 0xB6, 0xDA });						// movzx r11d, dl
+			} break;
+			
+			
+			case MN_BIT:
+			{
+				e.Operand(op, info.Mode);
+				e.Bytes({ 0x41, 0x89, 0xC3 });								// mov r11d, eax
+				e.Bytes({ 0x41, 0x83, 0xE3, 0x40 });						// and r11d, V
+				e.Bytes({ 0x80, 0xE3, 0xBF });								// and bl, ~V
+				e.Bytes({ 0x44, 0x09, 0xDB });								// or ebx, r11d
+				e.Bytes({ 0x89, 0xC2 });									// mov edx, eax
+				e.Bytes({ 0x81, 0xE2 }); e.D32(0x80);						// and edx, 0x80
+				e.Bytes({ 0xC1, 0xE2, 0x08 });								// shl edx, 8 (N from m)
+				e.Bytes({ 0x44, 0x21, 0xC0 });								// and eax, r8d (Z from A AND m)
+				e.Bytes({ 0x09, 0xD0 });									// or eax, edx
+				e.Bytes({ 0x41, 0x89, 0xC3 });								// mov r11d, eax
+			} break;
+			
+			
+			// Shifts, increments and decrements
+			case MN_ASL:
+			case MN_LSR:
+			case MN_ROL:
+			case MN_ROR:
+			{
+				// shl, shr, rcl, rcr by 1
+				Byte shift = info.Instruction == MN_ASL ? 0xE0 : info.Instruction == MN_LSR ? 0xE8
+					: info.Instruction == MN_ROL ? 0xD0 : 0xD8;
+				
+				bool rotate = info.Instruction == MN_ROL || info.Instruction == MN_ROR;
+				
+				if (info.Mode == AM_ACC)
+				{
+					if (rotate)
+					{
+						e.CarryToHost();
+					}
+					
+					e.Bytes({ 0x41, 0xD0, shift });							// shift r8b, 1
+					e.CarryFromHost();
+					e.SetNZ(0);
+				}
+				else
+				{
+					e.Address(op, info.Mode);
+					e.Bytes({ 0x0F, 0xB6, 0x04, 0x16 });					// movzx eax, byte [rsi+rdx]
+					
+					if (rotate)
+					{
+						e.CarryToHost();
+					}
+					
+					e.Bytes({ 0xD0, shift });								// shift al, 1
+					e.CarryFromHost();
+					e.Bytes({ 0x88, 0x04, 0x16 });							// mov [rsi+rdx], al
+					e.Bytes({ 0x44, 0x0F, 0xB6, 0xD8 });					// movzx r11d, al
+					e.MarkPageWritten();
+					e.CheckOwnPage(block, i, exits, exitCount);
+				}
+			} break;
+			
+			
+			case MN_INC:
+			case MN_DEC:
+			{
+				e.Address(op, info.Mode);
+				e.Bytes({ 0xFE, (Byte)(info.Instruction == MN_INC ? 0x04 : 0x0C), 0x16 });	// inc/dec byte [rsi+rdx]
+				e.Bytes({ 0x44, 0x0F, 0xB6, 0x1C, 0x16 });					// movzx r11d, byte [rsi+rdx]
+				e.MarkPageWritten();
+				e.CheckOwnPage(block, i, exits, exitCount);
+			} break;
+			
+			
+			// Flags. No SED: a block that could switch to decimal mode
+			// halfway has to stay with the interpreter.
+			case MN_CLC: { e.Bytes({ 0x80, 0xE3, 0xFE }); } break;		// and bl, ~C
+			case MN_SEC: { e.Bytes({ 0x80, 0xCB, 0x01 }); } break;		// or bl, C
+			case MN_CLI: { e.Bytes({ 0x80, 0xE3, 0xFB }); } break;		// and bl, ~I
+			case MN_SEI: { e.Bytes({ 0x80, 0xCB, 0x04 }); } break;		// or bl, I
+			case MN_CLD: { e.Bytes({ 0x80, 0xE3, 0xF7 }); } break;		// and bl, ~D
+			case MN_CLV: { e.Bytes({ 0x80, 0xE3, 0xBF }); } break;		// and bl, ~V
+			case MN_NOP: break;
+			
+			
+			// Stack, into $0100 + SP going down, same as Push/Pull
+			case MN_PHA:
+			{
+				e.Bytes({ 0x0F, 0xB6, 0x87 }); e.D32(offsetof(CPU, SP));	// movzx eax, byte [rdi+SP]
+				e.Bytes({ 0x44, 0x88, 0x84, 0x06 }); e.D32(0x100);			// mov [rsi+rax+0x100], r8b
+				e.Bytes({ 0x8D, 0x90 }); e.D32(0x100);						// lea edx, [rax+0x100]
+				e.Bytes({ 0xFE, 0xC8 });									// dec al (wraps in the page)
+				e.Bytes({ 0x88, 0x87 }); e.D32(offsetof(CPU, SP));			// mov byte [rdi+SP], al
+				e.MarkPageWritten();
+				e.CheckOwnPage(block, i, exits, exitCount);
+			} break;
+			
+			
+			case MN_PLA:
+			{
+				e.Bytes({ 0x0F, 0xB6, 0x87 }); e.D32(offsetof(CPU, SP));	// movzx eax, byte [rdi+SP]
+				e.Bytes({ 0xFE, 0xC0 });									// inc al
+				e.Bytes({ 0x88, 0x87 }); e.D32(offsetof(CPU, SP));			// mov byte [rdi+SP], al
+				e.Bytes({ 0x44, 0x0F, 0xB6, 0x84, 0x06 }); e.D32(0x100);	// movzx r8d, byte [rsi+rax+0x100]
+				e.SetNZ(0);
+			} break;
+			
+			
+			// Jumps and branches, only ever the last instruction
+			case MN_JMP:
+			{
+				if (info.Mode != AM_ABS)
+				{
+					known = false;
+					break;
+				}
+				
+				e.StorePC(op.Operand);
+				pcSet = true;
+			} break;
+			
+			
+			case MN_JSR:
+			{
+				Word ret = op.Next - 1;
+				
+				e.Bytes({ 0x0F, 0xB6, 0x87 }); e.D32(offsetof(CPU, SP));	// movzx eax, byte [rdi+SP]
+				e.Bytes({ 0xC6, 0x84, 0x06 }); e.D32(0x100); e.B(ret >> 8);	// mov byte [rsi+rax+0x100], hi
+				e.Bytes({ 0x8D, 0x90 }); e.D32(0x100);						// lea edx, [rax+0x100]
+				e.MarkPageWritten();
+				e.Bytes({ 0xFE, 0xC8 });									// dec al
+				e.Bytes({ 0xC6, 0x84, 0x06 }); e.D32(0x100); e.B(ret & 0xFF);	// mov byte [rsi+rax+0x100], lo
+				e.Bytes({ 0x8D, 0x90 }); e.D32(0x100);						// lea edx, [rax+0x100]
+				e.MarkPageWritten();
+				e.Bytes({ 0xFE, 0xC8 });									// dec al
+				e.Bytes({ 0x88, 0x87 }); e.D32(offsetof(CPU, SP));			// mov byte [rdi+SP], al
+				e.StorePC(op.Operand);
+				pcSet = true;
+			} break;
+			
+			
+			case MN_RTS:
+			{
+				e.Bytes({ 0x0F, 0xB6, 0x87 }); e.D32(offsetof(CPU, SP));	// movzx eax, byte [rdi+SP]
+				e.Bytes({ 0xFE, 0xC0 });									// inc al
+				e.Bytes({ 0x0F, 0xB6, 0x94, 0x06 }); e.D32(0x100);			// movzx edx, byte [rsi+rax+0x100]
+				e.Bytes({ 0xFE, 0xC0 });									// inc al
+				e.Bytes({ 0x88, 0x87 }); e.D32(offsetof(CPU, SP));			// mov byte [rdi+SP], al
+				e.Bytes({ 0x0F, 0xB6, 0x84, 0x06 }); e.D32(0x100);			// movzx eax, byte [rsi+rax+0x100]
+				e.Bytes({ 0xC1, 0xE0, 0x08 });								// shl eax, 8
+				e.Bytes({ 0x09, 0xD0 });									// or eax, edx
+				e.Bytes({ 0x66, 0xFF, 0xC0 });								// inc ax
+				e.Bytes({ 0x66, 0x89, 0x87 }); e.D32(offsetof(CPU, PC));	// mov word [rdi+PC], ax
+				pcSet = true;
+			} break;
+			
+			
+			case MN_BCC: case MN_BCS: case MN_BEQ: case MN_BNE:
+			case MN_BMI: case MN_BPL: case MN_BVC: case MN_BVS:
+			{
+				Mnemonic mn = info.Instruction;
+				Word target = op.Next + (signed char)op.Operand;
+				
+				if (mn == MN_BEQ || mn == MN_BNE)
+				{
+					e.Bytes({ 0x45, 0x84, 0xDB });							// test r11b, r11b
+				}
+				else if (mn == MN_BMI || mn == MN_BPL)
+				{
+					e.Bytes({ 0x41, 0xF7, 0xC3 }); e.D32(0x8080);			// test r11d, 0x8080
+				}
+				else
+				{
+					e.Bytes({ 0xF6, 0xC3, (Byte)(mn == MN_BCC || mn == MN_BCS ? 0x01 : 0x40) });	// test bl, C/V
+				}
+				
+				// Taken on ZF for these: Z set, or the flag bit clear
+				bool takenOnZero = mn == MN_BEQ || mn == MN_BPL || mn == MN_BCC || mn == MN_BVC;
+				
+				e.StorePC(op.Next);											// (mov leaves the flags)
+				uint32 notTaken = e.Skip(takenOnZero ? 0x75 : 0x74);		// jnz/jz
+				e.Bytes({ 0x83, 0xC1, (Byte)(1 + ((target ^ op.Next) > 0xFF)) });	// add ecx, 1 or 2
+				e.StorePC(target);
+				e.Land(notTaken);
+				pcSet = true;
+			} break;
+			
+			
+			default:
+			{
+				// PHP, PLP, SED, BRK, RTI, JMP ($xxxx): left to the interpreter
+				known = false;
+			} break;
+		}
+	}
+	
+	if (!known)
+	{
+		// Do not come back to this one until it is decoded again
+		block.Entries = HOT;
+		Rejected++;
+		
+		return false;
+	}
+	
+	// Epilogue: host registers back, PC to where the block ends up, and
+	// the cycles taken as the return value
+	if (!pcSet)
+	{
+		e.StorePC(last.Next);
+	}
+	
+	e.Bytes({ 0x81, 0xC1 }); e.D32(block.Cycles);					// add ecx, base cycles
+	e.B(0xBA); e.D32(block.Count);									// mov edx, count
+	
+	for (uint32 i = 0; i < exitCount; i++)
+	{
+		uint32 rel = e.Size - exits[i];
+		
+		memcpy(e.Code + exits[i] - 4, &rel, 4);
+	}
+	
+	e.Bytes({ 0x44, 0x88, 0x87 }); e.D32(offsetof(CPU, A));		// mov byte [rdi+A], r8b
+	e.Bytes({ 0x44, 0x88, 0x8F }); e.D32(offsetof(CPU, X));		// mov byte [rdi+X], r9b
+	e.Bytes({ 0x44, 0x88, 0x97 }); e.D32(offsetof(CPU, Y));		// mov byte [rdi+Y], r10b
+	e.Bytes({ 0x66, 0x44, 0x89, 0x9F }); e.D32(offsetof(CPU, NZ));	// mov word [rdi+NZ], r11w
+	e.Bytes({ 0x88, 0x9F }); e.D32(offsetof(CPU, Flags));			// mov byte [rdi+Flags], bl
+	e.Bytes({ 0x48, 0x01, 0x97 }); e.D32(offsetof(CPU, Instructions));	// add qword [rdi+Instructions], rdx
+	e.Bytes({ 0x89, 0xC8 });										// mov eax, ecx
+	e.B(0x5B);														// pop rbx
+	e.B(0xC3);														// ret
+	
+	block.Native		= (BlockCache::NativeCode)(void*)(Arena + Used);
+	block.NativeEpoch	= Epoch;
+	
+	Used += e.Size;
+	Compiled++;
+	
+	return true;
+#else
+	(void)block;
+	
+	return false;
+#endif
+}
+
+
+#endif // PAL6502_IMPLEMENTATION
+
+#endif // PAL6502_H